@@ -0,0 +1,75 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#define CL_HPP_ENABLE_EXCEPTIONS
+#define CL_HPP_TARGET_OPENCL_VERSION 300
+#include <CL/opencl.hpp>
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    /* local work-group shape of a 2D kernel, 0x0 leaves the choice to the driver */
+    struct TileSize
+    {
+        std::uint32_t mWidth;
+        std::uint32_t mHeight;
+    };
+
+    ////////////////////////////////////////
+    cl::NDRange GetLocalRange(TileSize tile);
+    cl::NDRange GetGlobalRange(TileSize tile, std::uint32_t width, std::uint32_t height);
+
+    ////////////////////////////////////////
+    /*
+     * Picks the fastest local size for each 2D kernel by timing a fixed set of tile shapes on
+     * the current device. Winners are kept in a plain text cache keyed by a hash of the device
+     * and driver and a hash of the kernel source, build options and entry point, so only the
+     * first run on a device, or after a kernel changes, pays for the search. Kernels are timed
+     * with whatever arguments are bound at the time, which must keep every launch valid.
+     */
+    struct Autotuner
+    {
+    private:
+        using Key = std::pair<std::uint64_t, std::uint64_t>;   /* device hash, kernel hash */
+
+        cl::Device mDevice;
+        std::string mCacheFile;
+        std::uint64_t mDeviceHash;
+        std::map<Key, TileSize> mEntries;
+        bool mIsDirty;
+
+    public:
+        Autotuner(const cl::Device& device, const char* cacheFile, bool retune);
+
+        TileSize Tune(const cl::CommandQueue& queue, const cl::Kernel& kernel, std::uint64_t kernelHash,
+                      const char* kernelName, std::uint32_t width, std::uint32_t height);
+        void Save();
+
+        static std::uint64_t Hash(std::string_view text, std::uint64_t seed = 0xcbf29ce484222325ull);
+
+        /* fastest of DEFAULT_TUNING_RUNS timed launches in nanoseconds, the queue needs profiling enabled */
+        static double Benchmark(const cl::CommandQueue& queue, const cl::Kernel& kernel,
+                                const cl::NDRange& globalRange, const cl::NDRange& localRange);
+    };
+}
@@ -17,6 +17,11 @@
 #pragma once
 
 #include <glm/vec3.hpp>
+#include <glm/geometric.hpp>
+#include <glm/trigonometric.hpp>
+
+#include <algorithm>
+#include <cmath>
 
 namespace CursedRay
 {
@@ -26,12 +31,35 @@ namespace CursedRay
     private:
         glm::vec3 mPosition;
         float mFocalLength;
+        float mYaw;
+        float mPitch;
 
     public:
-        Camera(const glm::vec3& position, float focalLength)
-            : mPosition{position}, mFocalLength{focalLength} {}
+        Camera(const glm::vec3& position, float focalLength, float yaw = 0.0f, float pitch = 0.0f)
+            : mPosition{position}, mFocalLength{focalLength}, mYaw{yaw}, mPitch{pitch} {}
 
         glm::vec3 GetPosition() const { return mPosition; }
         float GetFocalLength() const { return mFocalLength; }
+        float GetYaw() const { return mYaw; }
+        float GetPitch() const { return mPitch; }
+
+        glm::vec3 GetForward() const
+        {
+            return glm::vec3(-std::sin(mYaw) * std::cos(mPitch), std::sin(mPitch), -std::cos(mYaw) * std::cos(mPitch));
+        }
+        glm::vec3 GetRight() const { return glm::vec3(std::cos(mYaw), 0.0f, -std::sin(mYaw)); }
+        glm::vec3 GetUp() const { return glm::cross(GetRight(), GetForward()); }
+
+        void Translate(const glm::vec3& localOffset)
+        {
+            mPosition += GetRight() * localOffset.x + GetUp() * localOffset.y + GetForward() * localOffset.z;
+        }
+        void Rotate(float yawDelta, float pitchDelta)
+        {
+            mYaw += yawDelta;
+            mPitch = std::clamp(mPitch + pitchDelta, -1.5f, 1.5f);
+        }
+
+        bool operator==(const Camera&) const = default;
     };
 }
@@ -0,0 +1,120 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "HWDeviceOptions.hpp"
+#include "Scene.hpp"
+
+#define CL_HPP_ENABLE_EXCEPTIONS
+#define CL_HPP_TARGET_OPENCL_VERSION 300
+#include <CL/opencl.hpp>
+
+#include <glm/vec4.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    struct Camera;
+
+    ////////////////////////////////////////
+    /*
+     * Everything besides the accumulation buffer that a render needs to continue bit-exactly:
+     * the sampler position and every option that changes which samples are drawn or how they
+     * are traced. Per-pixel sample counts travel in the w channel of the accumulation buffer.
+     */
+    struct CheckpointHeader
+    {
+        std::uint32_t mMagic;
+        std::uint32_t mVersion;
+        std::uint32_t mSequence;        /* 0 while the slot is being written */
+        std::uint32_t mWidth;
+        std::uint32_t mHeight;
+        std::uint32_t mSampleIndex;
+        std::uint32_t mFrameIndex;
+        std::uint32_t mSamplesPerPixel;
+        std::uint32_t mMaxDepth;
+        std::uint32_t mRouletteDepth;
+        std::uint32_t mNextEventEstimation;
+        std::uint32_t mSampler;
+        std::uint32_t mIntegrator;
+        std::uint32_t mSceneType;
+        float mCameraPosition[3];
+        float mFocalLength;
+        float mYaw;
+        float mPitch;
+        float mClearColor[4];           /* the radiance of every miss without an environment map */
+        std::uint64_t mEnvironmentHash; /* of the --env-map path, 0 without one */
+        std::uint32_t mEnvironmentWidth;
+        std::uint32_t mEnvironmentHeight;
+    };
+
+    ////////////////////////////////////////
+    CheckpointHeader MakeCheckpointHeader(const HWDeviceOptions& options, SceneType sceneType, const Camera& camera,
+                                          const glm::vec4& clearColor,
+                                          std::uint32_t environmentWidth, std::uint32_t environmentHeight,
+                                          std::uint32_t width, std::uint32_t height,
+                                          std::uint32_t sampleIndex, std::uint32_t frameIndex);
+    bool IsCheckpointCompatible(const CheckpointHeader& checkpoint, const CheckpointHeader& expected);
+
+    ////////////////////////////////////////
+    /*
+     * A memory-mapped file with two slots that are written alternately, so a checkpoint that is
+     * interrupted halfway never destroys the previous one. The device reads the accumulation
+     * buffer straight into the mapping without blocking. The slot header is only stamped with a
+     * sequence number once that read has completed, and resuming picks the highest stamped slot.
+     */
+    struct Checkpoint
+    {
+    private:
+        int mFile;
+        std::uint8_t* mData;
+        std::size_t mSize;
+        std::size_t mNumPixels;
+
+        std::uint32_t mSequence;
+        std::uint32_t mPendingSlot;
+        CheckpointHeader mPendingHeader;
+        std::vector<cl::Event> mPendingEvents;
+        bool mIsPending;
+
+        std::size_t GetSlotOffset(std::uint32_t slot) const;
+        CheckpointHeader& GetHeader(std::uint32_t slot) const;
+
+    public:
+        Checkpoint(const char* url, std::uint32_t width, std::uint32_t height);
+        ~Checkpoint();
+
+        Checkpoint(const Checkpoint&) = delete;
+        Checkpoint& operator=(const Checkpoint&) = delete;
+        Checkpoint(Checkpoint&&) = delete;
+        Checkpoint& operator=(Checkpoint&&) = delete;
+
+        const CheckpointHeader* FindLatest() const;
+        const glm::vec4* GetPixels(const CheckpointHeader& header) const;
+
+        glm::vec4* BeginWrite(const CheckpointHeader& header);
+        void EndWrite(const std::vector<cl::Event>& events);
+        bool Poll(bool wait = false);
+
+        bool IsOpen() const { return mData != nullptr; }
+        bool IsPending() const { return mIsPending; }
+    };
+}
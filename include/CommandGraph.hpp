@@ -0,0 +1,92 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#define CL_HPP_ENABLE_EXCEPTIONS
+#define CL_HPP_TARGET_OPENCL_VERSION 300
+#include <CL/opencl.hpp>
+#include <CL/cl_ext.h>
+
+#include <cstddef>
+#include <vector>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    /*
+     * A per-frame sequence of kernel launches and copies that is recorded once and replayed.
+     * Devices exposing cl_khr_command_buffer get a finalized command buffer that is submitted
+     * with a single call, everything else replays the recorded list from the host. Kernel
+     * arguments are captured when a command is recorded on the native path, so every recorded
+     * launch keeps its own kernel object and the arguments must not change afterwards unless
+     * the graph is recorded again.
+     */
+    struct CommandGraph
+    {
+    private:
+        struct Command
+        {
+            cl::Kernel mKernel;
+            cl::NDRange mGlobal;
+            cl::NDRange mLocal;
+            cl::Buffer mSource;
+            cl::Buffer mDestination;
+            std::size_t mSize;
+        };
+
+        struct Dispatch
+        {
+            clCreateCommandBufferKHR_fn mCreate;
+            clFinalizeCommandBufferKHR_fn mFinalize;
+            clReleaseCommandBufferKHR_fn mRelease;
+            clEnqueueCommandBufferKHR_fn mEnqueue;
+            clCommandNDRangeKernelKHR_fn mNDRangeKernel;
+            clCommandCopyBufferKHR_fn mCopyBuffer;
+        };
+
+        cl::CommandQueue mCmdQueue;
+        std::vector<Command> mCommands;
+
+        Dispatch mDispatch;
+        cl_command_buffer_khr mCommandBuffer;
+        cl_sync_point_khr mLastSyncPoint;
+        bool mIsFinalized;
+
+        void Release();
+
+    public:
+        CommandGraph();
+        CommandGraph(const cl::CommandQueue& queue, const cl::Device& device);
+        ~CommandGraph();
+
+        CommandGraph(const CommandGraph&) = delete;
+        CommandGraph& operator=(const CommandGraph&) = delete;
+
+        CommandGraph(CommandGraph&& other) noexcept;
+        CommandGraph& operator=(CommandGraph&& other) noexcept;
+
+        void RecordKernel(const cl::Kernel& kernel, const cl::NDRange& global, const cl::NDRange& local = cl::NullRange);
+        void RecordCopy(const cl::Buffer& source, const cl::Buffer& destination, std::size_t size);
+        void Finalize();
+
+        std::vector<cl::Event> Enqueue(const std::vector<cl::Event>& events = {});
+
+        bool IsNative() const { return mCommandBuffer != nullptr; }
+        bool IsFinalized() const { return mIsFinalized; }
+        std::size_t GetNumCommands() const { return mCommands.size(); }
+    };
+}
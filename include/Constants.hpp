@@ -20,6 +20,9 @@
 #include <glm/vec4.hpp>
 #include <notcurses/notcurses.h>
 
+#include <cstdint>
+#include <cstddef>
+
 namespace CursedRay
 {
     ////////////////////////////////////////
@@ -44,10 +47,113 @@ namespace CursedRay
     constexpr glm::vec4 DEFAULT_CLEAR_COLOR         { glm::vec4(0.2f, 0.2f, 0.3f, 1.0f) };
     constexpr glm::vec3 DEFAULT_CAMERA_POSITION     { glm::vec3(0.0f, 0.0f, 0.0f) };
     constexpr float DEFAULT_CAMERA_FOCAL_LENGTH     { 1.0f };
+    constexpr float DEFAULT_CAMERA_MOVE_SPEED       { 0.1f };
+    constexpr float DEFAULT_CAMERA_TURN_SPEED       { 0.05f };
+
+    ////////////////////////////////////////
+    constexpr std::uint32_t DEFAULT_SCENE_LAMPS_PER_SIDE { 20 };
+    constexpr float DEFAULT_SCENE_BOUNCE_HEIGHT     { 0.6f };
+    constexpr float DEFAULT_SCENE_BOUNCE_PERIOD     { 2.0f };
+    constexpr double DEFAULT_BVH_REBUILD_INFLATION  { 1.5 };
+
+    ////////////////////////////////////////
+    constexpr std::uint32_t DEFAULT_SAMPLES_PER_PIXEL   { 4 };
+    constexpr std::uint32_t DEFAULT_MAX_DEPTH           { 6 };
+    constexpr bool DEFAULT_NEXT_EVENT_ESTIMATION        { true };
+    constexpr std::uint32_t DEFAULT_ROULETTE_DEPTH      { 3 };
+
+    ////////////////////////////////////////
+    constexpr std::uint32_t DEFAULT_PERSISTENT_GROUP_SIZE       { 64 };
+    constexpr std::uint32_t DEFAULT_PERSISTENT_GROUPS_PER_UNIT  { 4 };
+
+    ////////////////////////////////////////
+    constexpr std::size_t DEFAULT_ARENA_BLOCK_SIZE      { std::size_t{64} << 20 };
+
+    ////////////////////////////////////////
+    constexpr const char DEFAULT_TUNING_CACHE_FILE[]    { "cray_tuning.cache" };
+    constexpr std::uint32_t DEFAULT_TUNING_RUNS         { 3 };
+
+    ////////////////////////////////////////
+    constexpr const char DEFAULT_DEVICE_CACHE_FILE[]    { "cray_device.cache" };
+    constexpr std::uint32_t DEFAULT_CALIBRATION_WIDTH   { 256 };
+    constexpr std::uint32_t DEFAULT_CALIBRATION_HEIGHT  { 256 };
+
+    ////////////////////////////////////////
+    constexpr std::uint32_t DEFAULT_SEQUENCE_SAMPLES        { 64 };
+    constexpr const char DEFAULT_SEQUENCE_OUTPUT[]          { "frame_####.png" };
+    constexpr std::uint32_t DEFAULT_SEQUENCE_WIDTH          { 640 };
+    constexpr std::uint32_t DEFAULT_SEQUENCE_HEIGHT         { 360 };
+    constexpr glm::vec3 DEFAULT_TURNTABLE_CENTER            { glm::vec3(0.0f, 0.0f, -1.5f) };
+    constexpr std::size_t DEFAULT_MAX_ENCODER_THREADS       { 8 };
+
+    ////////////////////////////////////////
+    constexpr std::size_t DEFAULT_MAX_MEMORY                { std::size_t{1024} << 20 };
+    constexpr std::uint32_t DEFAULT_TILE_WRITES_IN_FLIGHT   { 3 };
+    constexpr std::uint32_t DEFAULT_MIN_TILE_SIZE           { 64 };
+    constexpr std::uint32_t DEFAULT_TILE_ALIGNMENT          { 16 };
+
+    ////////////////////////////////////////
+    constexpr std::uint32_t DEFAULT_CHECKPOINT_INTERVAL     { 60 };
+    constexpr std::uint32_t DEFAULT_PUBLISH_SLOTS           { 4 };
+
+    ////////////////////////////////////////
+    constexpr const char DEFAULT_FARM_ADDRESS[]             { "unix:cray_farm.sock" };
+    constexpr std::uint32_t DEFAULT_FARM_BATCH_FRAMES       { 4 };
+    constexpr int DEFAULT_FARM_POLL_TIMEOUT                 { 16 };
+    constexpr std::uint32_t DEFAULT_FARM_CONNECT_ATTEMPTS   { 50 };
+    constexpr std::uint32_t DEFAULT_FARM_CONNECT_INTERVAL   { 100 };
+    constexpr std::uint64_t DEFAULT_FARM_MAX_MESSAGE_SIZE   { std::uint64_t{1} << 30 };
+
+    ////////////////////////////////////////
+    constexpr std::uint32_t DEFAULT_FRAMES_IN_FLIGHT    { 1 };
+    constexpr std::size_t DEFAULT_FRAME_GRAPH_MAX_READERS { 8 };
+
+    ////////////////////////////////////////
+    constexpr std::uint32_t DEFAULT_METRICS_LOG_INTERVAL { 60 };
+    constexpr double DEFAULT_METRICS_SMOOTHING          { 0.1 };
+    constexpr std::uint32_t DEFAULT_HUD_INTERVAL_MS     { 250 };
+    constexpr std::uint32_t DEFAULT_HUD_WIDTH           { 30 };
+
+    ////////////////////////////////////////
+    constexpr float DEFAULT_RENDER_SCALE_STEP           { 0.125f };
+    constexpr float DEFAULT_MIN_RENDER_SCALE            { 0.25f };
+    constexpr double DEFAULT_FRAME_TIME_SMOOTHING       { 0.25 };
+    constexpr double DEFAULT_RENDER_SCALE_HEADROOM      { 0.85 };
+    constexpr std::uint32_t DEFAULT_RENDER_SCALE_SETTLE_FRAMES { 4 };
+    constexpr std::uint32_t DEFAULT_RENDER_SCALE_STILL_FRAMES { 4 };
+
+    ////////////////////////////////////////
+    constexpr std::uint32_t DEFAULT_DENOISE_ITERATIONS  { 5 };
+    constexpr std::uint32_t MAX_DENOISE_ITERATIONS      { 8 };
+    constexpr float DEFAULT_DENOISE_SIGMA_COLOR         { 0.6f };
+    constexpr float DEFAULT_DENOISE_SIGMA_ALBEDO        { 0.1f };
+    constexpr float DEFAULT_DENOISE_SIGMA_NORMAL        { 64.0f };
+    constexpr float DEFAULT_DENOISE_SIGMA_DEPTH         { 0.05f };
+
+    ////////////////////////////////////////
+    constexpr bool DEFAULT_REPROJECTION                 { true };
+    constexpr std::uint32_t DEFAULT_MAX_HISTORY_SAMPLES { 64 };
+    constexpr float DEFAULT_REPROJECTION_DEPTH_THRESHOLD { 0.05f };
+    constexpr float DEFAULT_REPROJECTION_NORMAL_THRESHOLD { 0.9f };
 
     ////////////////////////////////////////
+    constexpr const char KERNEL_INCLUDE_DIR[]       { "../kernels" };
     constexpr const char KERNEL_CLEAR_COLOR_PATH[]  { "../kernels/clear_color.cl" };
+    constexpr const char KERNEL_PATH_TRACE_PATH[]   { "../kernels/path_trace.cl" };
+    constexpr const char KERNEL_PATH_TRACE_PERSISTENT_PATH[] { "../kernels/path_trace_persistent.cl" };
+    constexpr const char KERNEL_DENOISE_PATH[]      { "../kernels/denoise.cl" };
+    constexpr const char KERNEL_TONEMAP_PATH[]      { "../kernels/tonemap.cl" };
+    constexpr const char KERNEL_REPROJECT_PATH[]    { "../kernels/reproject.cl" };
+    constexpr const char KERNEL_CALIBRATE_PATH[]    { "../kernels/calibrate.cl" };
 
     ////////////////////////////////////////
     constexpr const char KERNEL_CLEAR_COLOR_NAME[]  { "clear_color" };
+    constexpr const char KERNEL_PATH_TRACE_NAME[]   { "path_trace" };
+    constexpr const char KERNEL_PATH_TRACE_PERSISTENT_NAME[] { "path_trace_persistent" };
+    constexpr const char KERNEL_DENOISE_NAME[]      { "denoise_atrous" };
+    constexpr const char KERNEL_TONEMAP_NAME[]      { "tonemap" };
+    constexpr const char KERNEL_RESOLVE_FLOAT_NAME[] { "resolve_float" };
+    constexpr const char KERNEL_RESOLVE_HALF_NAME[]  { "resolve_half" };
+    constexpr const char KERNEL_REPROJECT_NAME[]    { "reproject" };
+    constexpr const char KERNEL_CALIBRATE_NAME[]    { "calibrate" };
 }
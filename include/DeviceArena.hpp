@@ -0,0 +1,65 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#define CL_HPP_ENABLE_EXCEPTIONS
+#define CL_HPP_TARGET_OPENCL_VERSION 300
+#include <CL/opencl.hpp>
+
+#include <cstddef>
+#include <vector>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    /*
+     * Reserves large device allocations up front and carves them into aligned sub-buffers.
+     * Every buffer is sized for the framebuffer when the device is created and lives as long
+     * as the device: render size changes and scene refits reuse the same sub-buffers, so the
+     * arena only ever grows and all of it is released at once with the device.
+     */
+    struct DeviceArena
+    {
+    private:
+        struct Block
+        {
+            cl::Buffer mBuffer;
+            std::size_t mSize;
+            std::size_t mOffset;        /* everything below has been handed out */
+        };
+
+        cl::Context mCtx;
+        std::vector<Block> mBlocks;
+
+        std::size_t mAlignment;
+        std::size_t mBlockSize;
+        std::size_t mUsage;
+        std::size_t mReservedSize;
+
+    public:
+        DeviceArena();
+        DeviceArena(const cl::Context& ctx, const cl::Device& device, std::size_t blockSize);
+
+        cl::Buffer Allocate(std::size_t size, cl_mem_flags flags = CL_MEM_READ_WRITE);
+
+        std::size_t GetUsage() const { return mUsage; }
+        std::size_t GetReservedSize() const { return mReservedSize; }
+        std::size_t GetNumBlocks() const { return mBlocks.size(); }
+
+        void LogUsage() const;
+    };
+}
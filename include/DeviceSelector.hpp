@@ -0,0 +1,39 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "HWDeviceOptions.hpp"
+
+#define CL_HPP_ENABLE_EXCEPTIONS
+#define CL_HPP_TARGET_OPENCL_VERSION 300
+#include <CL/opencl.hpp>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    /* prints every platform and device with the <platform>:<device> index --device accepts */
+    void ListDevices();
+
+    ////////////////////////////////////////
+    /*
+     * Finds the device to render on. An explicit --device index is taken as is; 'auto' times a
+     * short calibration trace on every device of the requested type, keeps the fastest and caches
+     * the choice keyed by the host name and its set of devices and drivers; otherwise the first
+     * device of the requested type wins. Returns false when no device matches.
+     */
+    bool SelectDevice(const HWDeviceOptions& options, cl::Device& device);
+}
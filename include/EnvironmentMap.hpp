@@ -0,0 +1,71 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    struct EnvironmentAlias
+    {
+        float mThreshold;           /* probability of keeping this entry rather than taking its alias */
+        std::uint32_t mAlias;
+        float mPdf;                 /* probability of the texel within its row, or of the row itself */
+    };
+
+    ////////////////////////////////////////
+    static_assert(sizeof(EnvironmentAlias) == 12, "EnvironmentAlias must match the layout in kernels/environment.h");
+
+    ////////////////////////////////////////
+    /*
+     * Equirectangular HDR environment with a two-level alias table for importance sampling: one
+     * conditional table per row over its texels, followed by a marginal table over the rows. Texels
+     * are weighted by luminance times the sine of their latitude, so the table samples radiance per
+     * solid angle rather than per texel. Rows are independent of each other and are built in
+     * parallel, only the marginal table waits for all of them. Sampling picks a row and then a
+     * texel in constant time, and the leftover of each uniform places the direction within the texel.
+     */
+    struct EnvironmentMap
+    {
+    private:
+        std::vector<std::uint16_t> mPixels;         /* half RGB, rows from the zenith down */
+        std::vector<EnvironmentAlias> mAlias;       /* width * height conditional entries, then height marginal entries */
+        std::uint32_t mWidth;
+        std::uint32_t mHeight;
+
+        bool Load(const char* url, std::vector<float>& radiance);
+        std::uint32_t BuildAliasTable(const std::vector<float>& radiance);
+
+    public:
+        EnvironmentMap();
+        explicit EnvironmentMap(const std::string& url);
+
+        bool IsEmpty() const { return mWidth == 0; }
+        std::uint32_t GetWidth() const { return mWidth; }
+        std::uint32_t GetHeight() const { return mHeight; }
+
+        const std::vector<std::uint16_t>& GetPixels() const { return mPixels; }
+        const std::vector<EnvironmentAlias>& GetAlias() const { return mAlias; }
+
+        std::size_t GetPixelsSizeInBytes() const { return mPixels.size() * sizeof(std::uint16_t); }
+        std::size_t GetAliasSizeInBytes() const { return mAlias.size() * sizeof(EnvironmentAlias); }
+    };
+}
@@ -0,0 +1,64 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#define CL_HPP_ENABLE_EXCEPTIONS
+#define CL_HPP_TARGET_OPENCL_VERSION 300
+#include <CL/opencl.hpp>
+
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    using PassFunction = std::function<std::vector<cl::Event>(const std::vector<cl::Event>& waitList)>;
+
+    ////////////////////////////////////////
+    /*
+     * Dependency tracking for an out-of-order queue. Every pass declares the buffers it reads
+     * and writes; a pass waits on the last writer of everything it reads (read after write) and
+     * on the last writer plus all readers since of everything it writes (write after write,
+     * write after read). Passes touching disjoint buffers carry no dependency and may overlap,
+     * across frame boundaries as well. Buffers that are only ever read after setup need not be
+     * declared.
+     */
+    struct FrameGraph
+    {
+    private:
+        struct ResourceState
+        {
+            cl::Event mLastWrite;
+            std::vector<cl::Event> mReadsSinceWrite;
+        };
+
+        cl::CommandQueue mCmdQueue;
+        std::unordered_map<cl_mem, ResourceState> mResources;
+
+        cl::Event Join(const std::vector<cl::Event>& events) const;
+
+    public:
+        FrameGraph() = default;
+        explicit FrameGraph(const cl::CommandQueue& queue);
+
+        std::vector<cl::Event> AddPass(const std::vector<cl::Buffer>& reads,
+                                       const std::vector<cl::Buffer>& writes,
+                                       const PassFunction& pass,
+                                       const std::vector<cl::Event>& events = {});
+    };
+}
@@ -0,0 +1,119 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "Framebuffer.hpp"
+
+#define CL_HPP_ENABLE_EXCEPTIONS
+#define CL_HPP_TARGET_OPENCL_VERSION 300
+#include <CL/opencl.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    /*
+     * Shared-memory layout for consumers, in host byte order. The ring header sits at offset 0,
+     * followed by mNumSlots slots of mSlotStride bytes, the first at mSlotOffset. Each slot starts
+     * with a SharedFrameSlot and holds its pixels mPixelOffset bytes further in. Frame n, counting
+     * from 1, goes into slot (n - 1) % mNumSlots. A slot's mSequence
+     * is odd while the device writes into it and twice the frame number once the frame is complete.
+     * To read without copying, a consumer loads mLatest, checks that the slot's sequence is twice
+     * that number, uses the pixels in place and checks the sequence again. If it changed, the
+     * producer lapped the consumer and the frame has to be dropped.
+     */
+    struct SharedFrameRing
+    {
+        std::uint32_t mMagic;
+        std::uint32_t mVersion;
+        std::uint32_t mNumSlots;
+        std::uint32_t mPixelOffset;
+        std::uint64_t mSlotOffset;
+        std::uint64_t mSlotStride;
+        std::atomic<std::uint64_t> mLatest;     /* number of the newest complete frame, 0 before the first */
+    };
+
+    ////////////////////////////////////////
+    struct SharedFrameSlot
+    {
+        std::atomic<std::uint64_t> mSequence;
+        std::uint32_t mFormat;                  /* PixelFormat, 4 channels */
+        std::uint32_t mWidth;
+        std::uint32_t mHeight;
+        std::uint32_t mSamplesPerPixel;         /* accumulated so far, restarts whenever the view changes */
+        std::uint64_t mSizeInBytes;
+    };
+
+    ////////////////////////////////////////
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "the ring's sequence counters must be address-free");
+
+    ////////////////////////////////////////
+    /*
+     * Publishes finished frames into a POSIX shared-memory ring. Like a checkpoint, the device
+     * reads the resolved framebuffer straight into a slot without blocking, and the slot is only
+     * stamped once that read has completed. Reads complete in submission order, so the ring
+     * advances in order as well. A frame is skipped when every slot is still waiting for the device.
+     */
+    struct FramePublisher
+    {
+    private:
+        struct PendingFrame
+        {
+            std::uint32_t mSlot;
+            std::uint32_t mSamplesPerPixel;
+            std::vector<cl::Event> mEvents;
+        };
+
+        std::string mName;
+        int mFile;
+        std::uint8_t* mData;
+        std::size_t mSize;
+        std::size_t mFrameSize;
+
+        PixelFormat mFormat;
+        std::uint32_t mWidth;
+        std::uint32_t mHeight;
+        std::uint32_t mNumSlots;
+        std::uint64_t mNumFrames;
+        std::deque<PendingFrame> mPending;
+
+        SharedFrameRing& GetRing() const;
+        SharedFrameSlot& GetSlot(std::uint32_t slot) const;
+
+    public:
+        FramePublisher(const char* name, std::uint32_t width, std::uint32_t height, PixelFormat format, std::uint32_t numSlots);
+        ~FramePublisher();
+
+        FramePublisher(const FramePublisher&) = delete;
+        FramePublisher& operator=(const FramePublisher&) = delete;
+        FramePublisher(FramePublisher&&) = delete;
+        FramePublisher& operator=(FramePublisher&&) = delete;
+
+        void* BeginWrite(std::uint32_t samplesPerPixel);
+        void EndWrite(const std::vector<cl::Event>& events);
+        std::uint32_t Poll(bool wait = false);
+
+        bool IsOpen() const { return mData != nullptr; }
+        std::uint64_t GetNumFrames() const { return mNumFrames; }
+    };
+}
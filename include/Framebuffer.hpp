@@ -19,12 +19,53 @@
 #include <glm/vec4.hpp>
 #include <glm/gtc/epsilon.hpp>
 
+#include <cassert>
 #include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
 #include <string>
 #include <vector>
 
 namespace CursedRay
 {
+    ////////////////////////////////////////
+    enum class PixelFormat : std::uint32_t
+    {
+        RGBA8 = 0,
+        RGBA16F = 1,
+        RGBA32F = 2
+    };
+
+    ////////////////////////////////////////
+    enum class PixelLayout : std::uint32_t
+    {
+        AoS = 0,    /* RGBARGBA... */
+        SoA = 1     /* RRR...GGG...BBB...AAA... */
+    };
+
+    ////////////////////////////////////////
+    template <PixelFormat Format> struct PixelTraits;
+
+    ////////////////////////////////////////
+    template <> struct PixelTraits<PixelFormat::RGBA8> { using Channel = std::uint8_t; };
+    template <> struct PixelTraits<PixelFormat::RGBA16F> { using Channel = std::uint16_t; /* IEEE 754 binary16 bits */ };
+    template <> struct PixelTraits<PixelFormat::RGBA32F> { using Channel = float; };
+
+    ////////////////////////////////////////
+    constexpr std::uint32_t GetBytesPerChannel(PixelFormat format)
+    {
+        switch (format) {
+            case PixelFormat::RGBA8:
+                return 1;
+            case PixelFormat::RGBA16F:
+                return 2;
+            case PixelFormat::RGBA32F:
+                return 4;
+        }
+        return 0;
+    }
+
     ////////////////////////////////////////
     struct FramebufferOptions
     {
@@ -45,33 +86,157 @@ namespace CursedRay
     };
 
     ////////////////////////////////////////
+    /* scalar conversions of a single channel, the bulk conversions below are vectorized */
+    std::uint8_t LinearToSRGB8(float value);
+    float SRGB8ToLinear(std::uint8_t value);
+    std::uint16_t FloatToHalf(float value);
+    float HalfToFloat(std::uint16_t value);
+
+    ////////////////////////////////////////
+    /* bulk conversions, counts are in pixels of four channels */
+    void ConvertFloatToSRGB8(const float* source, std::uint8_t* destination, std::size_t numPixels, bool toneMap);
+    void ConvertSRGB8ToFloat(const std::uint8_t* source, float* destination, std::size_t numPixels);
+    void ConvertFloatToHalf(const float* source, std::uint16_t* destination, std::size_t numPixels);
+    void ConvertHalfToFloat(const std::uint16_t* source, float* destination, std::size_t numPixels);
+    void ConvertInterleavedToPlanar(const float* source, float* destination, std::size_t numPixels);
+    void ConvertPlanarToInterleaved(const float* source, float* destination, std::size_t numPixels);
+
+    ////////////////////////////////////////
+    template <PixelFormat Format, PixelLayout Layout = PixelLayout::AoS>
     struct Framebuffer
     {
+        using Channel = typename PixelTraits<Format>::Channel;
+
     private: 
-        std::vector<std::uint8_t> mData;
+        std::vector<Channel> mData;
         std::uint32_t mWidth;
         std::uint32_t mHeight;
 
+        static Channel EncodeChannel(float value)
+        {
+            if constexpr (Format == PixelFormat::RGBA8) {
+                return static_cast<std::uint8_t>(std::clamp(value, 0.0f, 1.0f) * 255.0f);
+            }
+            else if constexpr (Format == PixelFormat::RGBA16F) {
+                return FloatToHalf(value);
+            }
+            else {
+                return value;
+            }
+        }
+
     public:
-        explicit Framebuffer(const FramebufferOptions& options);
+        explicit Framebuffer(const FramebufferOptions& options)
+            : mData(static_cast<std::size_t>(options.GetWidth()) * options.GetHeight() * 4),
+              mWidth{options.GetWidth()}, mHeight{options.GetHeight()}
+        {
+            glm::vec4 clearColor{ options.GetClearColor() };
+            const Channel channels[4]{ EncodeChannel(clearColor.r),
+                                       EncodeChannel(clearColor.g),
+                                       EncodeChannel(clearColor.b),
+                                       EncodeChannel(clearColor.a) };
+            if (mData.empty()) {
+                return;
+            }
+
+            if constexpr (Layout == PixelLayout::SoA) {
+                for (std::size_t channel{}; channel < 4; ++channel) {
+                    std::fill_n(GetPlane(static_cast<std::uint32_t>(channel)), GetNumPixels(), channels[channel]);
+                }
+            }
+            else {
+                // seed one pixel, then keep doubling the filled prefix with memcpy
+                std::memcpy(mData.data(), channels, sizeof(channels));
+                std::size_t filled{ 4 };
+                while (filled < mData.size()) {
+                    std::size_t count{ std::min(filled, mData.size() - filled) };
+                    std::memcpy(mData.data() + filled, mData.data(), count * sizeof(Channel));
+                    filled += count;
+                }
+            }
+        }
+
+        static constexpr PixelFormat GetFormat() { return Format; }
+        static constexpr PixelLayout GetLayout() { return Layout; }
 
         std::uint32_t GetWidth() const { return mWidth; }
         std::uint32_t GetHeight() const { return mHeight; }
-        std::uint32_t GetSizeInBytes() const { return mWidth * mHeight * GetNumChannels(); }
+        std::size_t GetNumPixels() const { return static_cast<std::size_t>(mWidth) * mHeight; }
+        std::size_t GetSizeInBytes() const { return GetNumPixels() * GetNumChannels() * GetBytesPerChannel(Format); }
         std::uint32_t GetNumChannels() const { return 4; }
 
         std::int32_t GetWidthSigned() const { return static_cast<std::int32_t>(mWidth); }
         std::int32_t GetHeightSigned() const { return static_cast<std::int32_t>(mHeight); }
         std::int32_t GetNumChannelsSigned() const { return static_cast<std::int32_t>(GetNumChannels()); }
 
-        const std::uint8_t* GetData() const { return mData.data(); }
-        void Clear() { mData.clear(); }
-        void PushPixel(std::uint8_t pixel) { mData.push_back(pixel); }
+        Channel* GetData() { return mData.data(); }
+        const Channel* GetData() const { return mData.data(); }
+
+        Channel* GetPlane(std::uint32_t channel)
+        {
+            static_assert(Layout == PixelLayout::SoA, "planes only exist in the SoA layout");
+            return mData.data() + channel * GetNumPixels();
+        }
+        const Channel* GetPlane(std::uint32_t channel) const
+        {
+            static_assert(Layout == PixelLayout::SoA, "planes only exist in the SoA layout");
+            return mData.data() + channel * GetNumPixels();
+        }
 
-        std::vector<std::uint8_t>::iterator begin() { return mData.begin(); }
-        std::vector<std::uint8_t>::const_iterator cbegin() const { return mData.cbegin(); }
+        typename std::vector<Channel>::iterator begin() { return mData.begin(); }
+        typename std::vector<Channel>::const_iterator cbegin() const { return mData.cbegin(); }
 
-        std::vector<std::uint8_t>::iterator end() { return mData.end(); }
-        std::vector<std::uint8_t>::const_iterator cend() const { return mData.cend(); }
+        typename std::vector<Channel>::iterator end() { return mData.end(); }
+        typename std::vector<Channel>::const_iterator cend() const { return mData.cend(); }
     };
+
+    ////////////////////////////////////////
+    using DisplayFramebuffer = Framebuffer<PixelFormat::RGBA8>;
+    using HalfFramebuffer = Framebuffer<PixelFormat::RGBA16F>;
+    using HDRFramebuffer = Framebuffer<PixelFormat::RGBA32F>;
+
+    ////////////////////////////////////////
+    template <PixelFormat SourceFormat, PixelLayout SourceLayout, PixelFormat DestinationFormat, PixelLayout DestinationLayout>
+    void ConvertFramebuffer(const Framebuffer<SourceFormat, SourceLayout>& source,
+                            Framebuffer<DestinationFormat, DestinationLayout>& destination)
+    {
+        assert(source.GetNumPixels() == destination.GetNumPixels() && "framebuffers must have the same dimensions");
+        std::size_t numPixels{ source.GetNumPixels() };
+
+        if constexpr (SourceFormat == PixelFormat::RGBA32F && DestinationFormat == PixelFormat::RGBA32F) {
+            static_assert(SourceLayout != DestinationLayout, "use a plain copy between identical framebuffers");
+            if constexpr (SourceLayout == PixelLayout::AoS) {
+                ConvertInterleavedToPlanar(source.GetData(), destination.GetData(), numPixels);
+            }
+            else {
+                ConvertPlanarToInterleaved(source.GetData(), destination.GetData(), numPixels);
+            }
+        }
+        else if constexpr (SourceFormat == PixelFormat::RGBA32F && DestinationFormat == PixelFormat::RGBA16F) {
+            static_assert(SourceLayout == DestinationLayout, "half conversions keep the layout");
+            ConvertFloatToHalf(source.GetData(), destination.GetData(), numPixels);
+        }
+        else if constexpr (SourceFormat == PixelFormat::RGBA16F && DestinationFormat == PixelFormat::RGBA32F) {
+            static_assert(SourceLayout == DestinationLayout, "half conversions keep the layout");
+            ConvertHalfToFloat(source.GetData(), destination.GetData(), numPixels);
+        }
+        else if constexpr (SourceFormat == PixelFormat::RGBA32F && DestinationFormat == PixelFormat::RGBA8) {
+            static_assert(SourceLayout == PixelLayout::AoS && DestinationLayout == PixelLayout::AoS,
+                          "sRGB8 conversions operate on interleaved pixels");
+            ConvertFloatToSRGB8(source.GetData(), destination.GetData(), numPixels, false);
+        }
+        else if constexpr (SourceFormat == PixelFormat::RGBA8 && DestinationFormat == PixelFormat::RGBA32F) {
+            static_assert(SourceLayout == PixelLayout::AoS && DestinationLayout == PixelLayout::AoS,
+                          "sRGB8 conversions operate on interleaved pixels");
+            ConvertSRGB8ToFloat(source.GetData(), destination.GetData(), numPixels);
+        }
+        else {
+            static_assert(SourceFormat == PixelFormat::RGBA32F || DestinationFormat == PixelFormat::RGBA32F,
+                          "conversions go through RGBA32F");
+        }
+    }
+
+    ////////////////////////////////////////
+    void ToneMapFramebuffer(const HDRFramebuffer& source, DisplayFramebuffer& destination);
+    bool SaveFramebufferPFM(const char* url, const HDRFramebuffer& framebuffer);
 }
@@ -17,11 +17,23 @@
 #pragma once
 
 #include "HWDeviceOptions.hpp"
+#include "Autotuner.hpp"
+#include "Framebuffer.hpp"
+#include "DeviceArena.hpp"
+#include "CommandGraph.hpp"
+#include "FrameGraph.hpp"
+#include "SceneBvh.hpp"
+#include "LightTree.hpp"
+#include "EnvironmentMap.hpp"
 
 #define CL_HPP_ENABLE_EXCEPTIONS
 #define CL_HPP_TARGET_OPENCL_VERSION 300
 #include <CL/opencl.hpp>
 
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
 #include <vector>
 #include <glm/vec4.hpp>
 #include <glm/gtc/epsilon.hpp>
@@ -29,7 +41,56 @@
 namespace CursedRay
 {
     ////////////////////////////////////////
-    struct Framebuffer;
+    struct Camera;
+    struct Scene;
+
+    ////////////////////////////////////////
+    /* host copies of changed scene ranges, kept alive until their non-blocking writes have completed */
+    struct SceneUpload
+    {
+        struct Range
+        {
+            cl::Buffer mBuffer;
+            std::size_t mOffset;
+            std::size_t mSize;
+            std::size_t mStagingOffset;
+        };
+
+        std::vector<std::byte> mData;
+        std::vector<Range> mRanges;
+        std::vector<cl::Event> mEvents;
+    };
+
+    ////////////////////////////////////////
+    /* device discovery and kernel builds, none of which depend on the render size, so that they can
+       run on a background thread while the terminal is still being probed */
+    struct HWDeviceContext
+    {
+        cl::Context mCtx;
+        std::vector<cl::Device> mDevices;
+        std::string mBuildOptions;
+
+        /* sources are kept for the autotuner cache keys */
+        std::string mClearColorSource;
+        std::string mPathTraceSource;
+        std::string mDenoiseSource;
+        std::string mTonemapSource;
+        std::string mReprojectSource;
+
+        cl::Program mClearColorProgram;
+        cl::Program mPathTraceProgram;
+        cl::Program mPathTracePersistentProgram;
+        cl::Program mDenoiseProgram;
+        cl::Program mTonemapProgram;
+        cl::Program mReprojectProgram;
+
+        /* loaded alongside the kernel builds, the host copy can be released once a device has uploaded it */
+        EnvironmentMap mEnvironment;
+
+        std::chrono::steady_clock::duration mSetupTime;
+
+        explicit HWDeviceContext(const HWDeviceOptions& options);
+    };
 
     ////////////////////////////////////////
     struct HWDevice
@@ -37,15 +98,97 @@ namespace CursedRay
     private:
         cl::Context mCtx;
         cl::CommandQueue mCmdQueue;
+        FrameGraph mFrameGraph;
         std::vector<cl::Device> mDevices;
 
+        /* every device buffer below is a sub-buffer handed out by the arena */
+        DeviceArena mArena;
+
         cl::Program mClearColorProgram;
+        cl::Program mPathTraceProgram;
+        cl::Program mPathTracePersistentProgram;
+        cl::Program mDenoiseProgram;
+        cl::Program mTonemapProgram;
+        cl::Program mReprojectProgram;
 
-        cl::Buffer mHWFramebuffer;
-        Framebuffer& mFramebuffer;
+        cl::Kernel mClearColorKernel;
+        cl::Kernel mPathTraceKernel;
+        cl::Kernel mReprojectKernel;
+        std::array<cl::Kernel, MAX_DENOISE_ITERATIONS> mDenoiseKernels;
+        std::array<cl::Kernel, 2> mTonemapKernels;
+
+        /* double buffered so that frame N can be read back while frame N + 1 resolves */
+        std::array<cl::Buffer, 2> mHWFramebuffers;
+        cl::Buffer mHWAccumulation;
+        cl::Buffer mHWAlbedo;
+        cl::Buffer mHWNormal;
+        cl::Buffer mHWDepth;
+        std::array<cl::Buffer, 2> mHWDenoiseTargets;
+
+        cl::Buffer mHWHistory;
+        cl::Buffer mHWPreviousNormal;
+        cl::Buffer mHWPreviousDepth;
+
+        cl::Buffer mHWLaneStats;
+        cl::Buffer mHWWorkCounter;
+
+        cl::Buffer mHWSpheres;
+        cl::Buffer mHWBvhNodes;
+        SceneBvh mBvh;
+        std::uint32_t mNumSpheres;
+
+        cl::Buffer mHWLightNodes;
+        cl::Buffer mHWLights;
+        LightTree mLightTree;
+        std::uint32_t mNumLights;
+
+        cl::Buffer mHWEnvironment;
+        cl::Buffer mHWEnvironmentAlias;
+        std::uint32_t mEnvironmentWidth;
+        std::uint32_t mEnvironmentHeight;
+
+        /* one slot per frame that can still be reading the scene buffers, plus the one being filled */
+        std::array<SceneUpload, DEFAULT_FRAMES_IN_FLIGHT + 1> mSceneUploads;
+        std::uint32_t mNumSceneUploads;
+
+        cl::Buffer mHWSobolDirections;
+        cl::Buffer mHWBlueNoise;
+        std::uint32_t mFrameIndex;
+        std::uint32_t mSampleIndex;
+
+        /* size traced, reprojected and denoised, the resolve upscales it to the framebuffer */
+        std::uint32_t mRenderWidth;
+        std::uint32_t mRenderHeight;
+
+        /* local sizes picked by the autotuner, the persistent integrator sizes its own launch */
+        TileSize mClearColorTile;
+        TileSize mPathTraceTile;
+        TileSize mReprojectTile;
+        TileSize mDenoiseTile;
+        TileSize mTonemapTile;
+
+        /* denoise + tonemap, recorded once per history parity (see PushHistory) and framebuffer slot */
+        std::array<CommandGraph, 4> mResolveGraphs;
+        std::uint32_t mHistoryParity;
+        std::uint32_t mResolvedFrames;
+        std::uint32_t mPresentedFrames;
+        bool mIsResolveGraphNative;
+        glm::vec4 mClearColor;
+
+        HWDeviceOptions mOptions;
+        DisplayFramebuffer& mFramebuffer;
+
+        /* host staging for the float formats, empty when the device quantizes to RGBA8 */
+        HalfFramebuffer mHalfFramebuffer;
+        HDRFramebuffer mHDRFramebuffer;
+
+        void CreateKernels();
+        void BindFrameBuffers();
+        void RecordResolveGraph(CommandGraph& graph, std::uint32_t slot);
 
     public:
-        HWDevice(Framebuffer& framebuffer, const HWDeviceOptions&);
+        HWDevice(DisplayFramebuffer& framebuffer, const Scene& scene, const HWDeviceOptions& options);
+        HWDevice(DisplayFramebuffer& framebuffer, const Scene& scene, const HWDeviceOptions& options, const HWDeviceContext& context);
 
         HWDevice(const HWDevice&) = delete;
         HWDevice& operator=(const HWDevice&) = delete;
@@ -55,10 +198,46 @@ namespace CursedRay
 
         std::vector<cl::Event> EnqueueClearColor(const glm::vec4& clearColor,
                                                  const std::vector<cl::Event>& events = {});
+        std::vector<cl::Event> EnqueuePathTrace(const Camera& camera,
+                                                const glm::vec4& clearColor,
+                                                const std::vector<cl::Event>& events = {});
+        std::vector<cl::Event> EnqueueReprojection(const Camera& camera,
+                                                   const Camera& previousCamera,
+                                                   const std::vector<cl::Event>& events = {});
+        std::vector<cl::Event> EnqueueResolve(const std::vector<cl::Event>& events = {});
+        std::vector<cl::Event> EnqueueSceneUpdate(const Scene& scene, const std::vector<cl::Event>& events = {});
+        void ResetAccumulation();
+        bool SetRenderSize(std::uint32_t width, std::uint32_t height, std::uint32_t samplesPerPixel);
+        void SetViewport(std::uint32_t x, std::uint32_t y, std::uint32_t imageWidth, std::uint32_t imageHeight);
+        std::uint32_t GetRenderWidth() const { return mRenderWidth; }
+        std::uint32_t GetRenderHeight() const { return mRenderHeight; }
+        std::uint32_t GetSamplesPerFrame() const { return mOptions.mSamplesPerPixel; }
+        bool IsRenderScaled() const { return mRenderWidth != mFramebuffer.GetWidth() || mRenderHeight != mFramebuffer.GetHeight(); }
+        void SeekSamples(std::uint32_t sampleIndex);
+        void SetSamplerState(std::uint32_t sampleIndex, std::uint32_t frameIndex);
+        void ReadAccumulation(std::vector<glm::vec4>& accumulation);
+        std::vector<cl::Event> EnqueueReadAccumulation(glm::vec4* accumulation);
+        std::vector<cl::Event> EnqueueReadFramebuffer(void* pixels);
+        void WriteAccumulation(const glm::vec4* accumulation);
+        std::uint32_t GetSampleIndex() const { return mSampleIndex; }
+        std::uint32_t GetFrameIndex() const { return mFrameIndex; }
+        std::uint32_t GetEnvironmentWidth() const { return mEnvironmentWidth; }
+        std::uint32_t GetEnvironmentHeight() const { return mEnvironmentHeight; }
+        void PushHistory();
+        double ReadLaneUtilization();
+        const DeviceArena& GetArena() const { return mArena; }
+        bool IsResolveGraphNative() const { return mIsResolveGraphNative; }
+
         double Profile(const cl::Event& event) const;
+        double Profile(const std::vector<cl::Event>& events) const;
         void LogProfile(const cl::Event& event) const;
         void LogProfile(const std::vector<cl::Event>& events) const;
 
-        void Finish();
+        bool Finish(std::uint32_t framesInFlight = 0);
+
+        const HDRFramebuffer& GetHDRFramebuffer() const { return mHDRFramebuffer; }
+
+        /* device and host bytes allocated per framebuffer pixel, for sizing framebuffers to a memory budget */
+        static std::size_t GetBytesPerPixel(const HWDeviceOptions& options);
     };
 };
@@ -16,15 +16,61 @@
 
 #pragma once
 
+#include "Constants.hpp"
+#include "Framebuffer.hpp"
+#include "Sampler.hpp"
+
 #define CL_HPP_ENABLE_EXCEPTIONS
 #define CL_HPP_TARGET_OPENCL_VERSION 300
 #include <CL/opencl.hpp>
 
+#include <cstdint>
+#include <string>
+
 namespace CursedRay
 {
+    ////////////////////////////////////////
+    enum class IntegratorType : std::uint32_t
+    {
+        PerPixel = 0,
+        Persistent = 1
+    };
+
     ////////////////////////////////////////
     struct HWDeviceOptions
     {
         uint mDeviceType{ CL_DEVICE_TYPE_DEFAULT };
+
+        /* --device: a platform and device index as listed by --list-devices, or a benchmark of every
+           device of mDeviceType when mAutoDevice is set, otherwise the first device of mDeviceType */
+        int mPlatformIndex{ -1 };
+        int mDeviceIndex{ -1 };
+        bool mAutoDevice{ false };
+
+        /* ignore cached work-group sizes and device choices and search again */
+        bool mRetune{ false };
+        std::string mTuningCacheFile{ DEFAULT_TUNING_CACHE_FILE };
+        std::string mDeviceCacheFile{ DEFAULT_DEVICE_CACHE_FILE };
+
+        /* path tracer */
+        uint mSamplesPerPixel{ DEFAULT_SAMPLES_PER_PIXEL };
+        uint mMaxDepth{ DEFAULT_MAX_DEPTH };
+        uint mRouletteDepth{ DEFAULT_ROULETTE_DEPTH };
+        IntegratorType mIntegrator{ IntegratorType::PerPixel };
+        SamplerType mSampler{ SamplerType::Sobol };
+        bool mNextEventEstimation{ DEFAULT_NEXT_EVENT_ESTIMATION };
+
+        /* equirectangular PFM lighting the scene in place of the clear color, empty for none */
+        std::string mEnvironmentFile;
+
+        /* denoiser */
+        uint mDenoiseIterations{ DEFAULT_DENOISE_ITERATIONS };
+
+        /* RGBA8 tonemaps on the device, the float formats resolve linear radiance for the host */
+        PixelFormat mFramebufferFormat{ PixelFormat::RGBA8 };
+
+        /* temporal reprojection */
+        bool mReprojection{ DEFAULT_REPROJECTION };
+        uint mMaxHistorySamples{ DEFAULT_MAX_HISTORY_SAMPLES };
     };
 }
@@ -0,0 +1,79 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "Framebuffer.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    enum class ImageFormat : std::uint32_t
+    {
+        PNG = 0,
+        QOI = 1,
+        EXR = 2
+    };
+
+    ////////////////////////////////////////
+    bool GetImageFormat(const std::string& url, ImageFormat& format);
+    bool SaveFramebufferPNG(const char* url, const DisplayFramebuffer& framebuffer);
+    bool SaveFramebufferQOI(const char* url, const DisplayFramebuffer& framebuffer);
+    bool SaveFramebufferEXR(const char* url, const HDRFramebuffer& framebuffer);
+
+    ////////////////////////////////////////
+    /*
+     * A fixed set of threads draining a bounded job queue. Submit only waits once mMaxPending
+     * jobs are queued, so the thread that feeds the device keeps going while earlier frames are
+     * compressed and written, yet frames never pile up in memory faster than they are encoded.
+     * The destructor finishes every queued job before joining.
+     */
+    struct EncoderPool
+    {
+    private:
+        std::vector<std::thread> mThreads;
+        std::deque<std::function<void()>> mJobs;
+        std::mutex mMutex;
+        std::condition_variable mCondition;
+        std::condition_variable mSpaceCondition;
+        std::size_t mMaxPending;
+        bool mIsStopping;
+
+        void Run();
+
+    public:
+        EncoderPool(std::size_t numThreads, std::size_t maxPending);
+        ~EncoderPool();
+
+        EncoderPool(const EncoderPool&) = delete;
+        EncoderPool& operator=(const EncoderPool&) = delete;
+        EncoderPool(EncoderPool&&) = delete;
+        EncoderPool& operator=(EncoderPool&&) = delete;
+
+        void Submit(std::function<void()> job);
+        std::size_t GetNumPending();
+    };
+}
@@ -0,0 +1,83 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <glm/vec4.hpp>
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    struct Scene;
+    struct Sphere;
+
+    ////////////////////////////////////////
+    constexpr std::uint32_t LIGHT_NODE_LEAF         { 0xffffffffu };
+
+    ////////////////////////////////////////
+    struct LightNode
+    {
+        glm::vec4 mBoundsMin;       /* w holds the power emitted below the node */
+        glm::vec4 mBoundsMax;
+        std::uint32_t mLeftOrLight; /* left child of an interior node, light index of a leaf */
+        std::uint32_t mRight;       /* right child of an interior node, LIGHT_NODE_LEAF for a leaf */
+        std::uint32_t mPadding[2];
+    };
+
+    ////////////////////////////////////////
+    struct Light
+    {
+        std::uint32_t mSphereIndex;
+        std::uint32_t mBitTrail;    /* bit i set means the path from the root goes right at depth i */
+        std::uint32_t mDepth;
+        std::uint32_t mPadding;
+    };
+
+    ////////////////////////////////////////
+    static_assert(sizeof(LightNode) == 48, "LightNode must match the layout in kernels/lights.h");
+    static_assert(sizeof(Light) == 16, "Light must match the layout in kernels/lights.h");
+
+    ////////////////////////////////////////
+    struct LightTree
+    {
+    private:
+        std::vector<LightNode> mNodes;
+        std::vector<Light> mLights;
+
+        std::uint32_t Build(std::vector<std::uint32_t>& lightIndices,
+                            std::size_t begin,
+                            std::size_t end,
+                            std::uint32_t bitTrail,
+                            std::uint32_t depth,
+                            const std::vector<Sphere>& spheres);
+
+    public:
+        explicit LightTree(const Scene& scene);
+
+        void Refit(const Scene& scene);
+
+        const std::vector<LightNode>& GetNodes() const { return mNodes; }
+        const std::vector<Light>& GetLights() const { return mLights; }
+
+        std::uint32_t GetNumLights() const { return static_cast<std::uint32_t>(mLights.size()); }
+        std::size_t GetNodesSizeInBytes() const { return mNodes.size() * sizeof(LightNode); }
+        std::size_t GetLightsSizeInBytes() const { return mLights.size() * sizeof(Light); }
+    };
+}
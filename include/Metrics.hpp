@@ -0,0 +1,51 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    enum class Metric : std::uint32_t
+    {
+        FrameTime = 0,          /* host time between frames read back from the device */
+        PathTraceTime,          /* device time of each stage of a frame */
+        ReprojectTime,
+        ResolveTime,            /* denoise and tonemap */
+        ReadbackTime,           /* host time of the blocking read and format conversions */
+        BlitTime,               /* presentation thread time of the notcurses blit and render */
+        RaysPerSecond,          /* camera rays per second of path tracing */
+        SamplesPerPixel,        /* accumulated so far */
+        DeviceMemory,           /* in use by the device arena */
+        PresentedFrames,        /* shown on the terminal so far */
+        DroppedFrames,          /* superseded before the terminal could show them */
+        Count
+    };
+
+    ////////////////////////////////////////
+    /*
+     * Process-wide registry that any part of the renderer publishes into. Every metric has a fixed
+     * slot holding an exponential moving average of its samples, or just the last value for gauges.
+     * Publishing is a few relaxed atomic operations, without locks or lookups, so it is cheap enough
+     * to do every frame from any thread. Readers such as the HUD never block a writer.
+     */
+    void PublishMetric(Metric metric, double value);
+    double GetMetric(Metric metric);
+    const char* GetMetricName(Metric metric);
+    const char* GetMetricUnit(Metric metric);
+}
@@ -18,9 +18,13 @@
 
 #include "Constants.hpp"
 #include "HWDeviceOptions.hpp"
+#include "Scene.hpp"
+#include "Framebuffer.hpp"
 
 #include <glm/vec4.hpp>
 
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
 #include <notcurses/notcurses.h>
 #include <string>
@@ -32,9 +36,6 @@
 
 namespace CursedRay
 {
-    ////////////////////////////////////////
-    struct Framebuffer;
-
     ////////////////////////////////////////
     struct NCDeviceOptions
     {
@@ -48,9 +49,41 @@ namespace CursedRay
         /* logging */
         std::string mLogFileName{ DEFAULT_LOGFILE_NAME };
         bool mDumpLogs{ DEFAULT_DUMP_LOGS };
+        bool mShowHud{ false };
 
         /* framebuffer options */
         glm::vec4 mClearColor{ DEFAULT_CLEAR_COLOR };
+        std::string mHDROutputFile;
+        std::uint32_t mTargetFps{};
+
+        /* scene options */
+        SceneType mSceneType{ SceneType::Default };
+        bool mAnimate{ false };
+
+        /* sequence rendering */
+        std::uint32_t mSequenceFrames{};
+        std::uint32_t mSequenceSamples{ DEFAULT_SEQUENCE_SAMPLES };
+        std::string mOutputPattern{ DEFAULT_SEQUENCE_OUTPUT };
+        std::uint32_t mResolutionWidth{ DEFAULT_SEQUENCE_WIDTH };
+        std::uint32_t mResolutionHeight{ DEFAULT_SEQUENCE_HEIGHT };
+
+        /* tiled rendering */
+        std::string mTiledOutputFile;
+        std::size_t mMaxMemory{ DEFAULT_MAX_MEMORY };
+
+        /* checkpointing */
+        std::string mCheckpointFile;
+        std::uint32_t mCheckpointInterval{ DEFAULT_CHECKPOINT_INTERVAL };
+        bool mResume{ false };
+
+        /* shared-memory frame ring */
+        std::string mPublishName;
+
+        /* render farm */
+        bool mIsFarmCoordinator{ false };
+        std::uint32_t mFarmWorkers{};
+        std::string mFarmAddress{ DEFAULT_FARM_ADDRESS };
+        std::string mWorkerAddress;
 
         /* hardware device options */
         HWDeviceOptions mHWOptions;
@@ -59,6 +92,10 @@ namespace CursedRay
         const char* GetLogLevelName() const;
         const char* GetClearColorValues() const;
         const char* GetDeviceTypeName() const;
+        const char* GetSamplerName() const;
+        const char* GetSceneName() const;
+        const char* GetIntegratorName() const;
+        const char* GetFramebufferFormatName() const;
 
         [[noreturn]] void PrintHelp(char** argv) const;
 
@@ -71,9 +108,33 @@ namespace CursedRay
 
         ncloglevel_e LogLevel() const { return mLogLevel; }
         bool DumpLogs() const { return mDumpLogs; }
+        bool ShowHud() const { return mShowHud; }
 
         glm::vec4 ClearColor() const { return mClearColor; }
+        const std::string& GetHDROutputFile() const { return mHDROutputFile; }
+        std::uint32_t GetTargetFps() const { return mTargetFps; }
+        SceneType GetSceneType() const { return mSceneType; }
+        bool Animate() const { return mAnimate; }
         HWDeviceOptions GetHWDeviceOptions() const { return mHWOptions; }
+
+        std::uint32_t GetSequenceFrames() const { return mSequenceFrames; }
+        std::uint32_t GetSequenceSamples() const { return mSequenceSamples; }
+        const std::string& GetOutputPattern() const { return mOutputPattern; }
+        std::uint32_t GetResolutionWidth() const { return mResolutionWidth; }
+        std::uint32_t GetResolutionHeight() const { return mResolutionHeight; }
+
+        const std::string& GetTiledOutputFile() const { return mTiledOutputFile; }
+        std::size_t GetMaxMemory() const { return mMaxMemory; }
+
+        const std::string& GetCheckpointFile() const { return mCheckpointFile; }
+        std::uint32_t GetCheckpointInterval() const { return mCheckpointInterval; }
+        bool Resume() const { return mResume; }
+        const std::string& GetPublishName() const { return mPublishName; }
+
+        bool IsFarmCoordinator() const { return mIsFarmCoordinator; }
+        std::uint32_t GetFarmWorkers() const { return mFarmWorkers; }
+        const std::string& GetFarmAddress() const { return mFarmAddress; }
+        const std::string& GetWorkerAddress() const { return mWorkerAddress; }
     };
 
     ////////////////////////////////////////
@@ -89,8 +150,17 @@ namespace CursedRay
         std::uint32_t mPixelsWidth, mPixelsHeight;
         std::uint32_t mCellWidth, mCellHeight;
 
+        /* performance overlay, a child plane above the blitted frame that is redrawn on its own; toggling
+           only flips the request, the plane is created or destroyed by the thread that draws */
+        ncplane* mHudPlane;
+        std::chrono::steady_clock::time_point mHudUpdate;
+        std::atomic<bool> mIsHudRequested;
+
         bool mDumpLogs;
 
+        bool SyncHudPlane();
+        bool DrawHud();
+
     public:
         explicit NCDevice(const NCDeviceOptions& options);
 
@@ -102,8 +172,11 @@ namespace CursedRay
         ~NCDevice();
 
         void Blit(const std::vector<std::uint8_t>& pixels, std::int32_t width, std::int32_t height);
-        void Blit(const Framebuffer& framebuffer);
+        void Blit(const DisplayFramebuffer& framebuffer);
         void Block() const;
+        void ToggleHud();
+        void UpdateHud();
+        std::uint32_t PollInput(ncinput& input) const;
 
         std::uint32_t GetWidth() const { return mWidth; }
         std::uint32_t GetHeight() const { return mHeight; }
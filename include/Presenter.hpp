@@ -0,0 +1,120 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "Framebuffer.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    struct NCDevice;
+
+    ////////////////////////////////////////
+    /*
+     * Single-producer single-consumer triple buffer. The writer owns the back slot and the reader
+     * the front slot, the third is parked in one atomic word together with a bit saying whether
+     * it holds a frame the reader has not taken yet. Publishing and acquiring are each a single
+     * exchange: neither side ever waits on the other, the reader always gets the newest frame and
+     * a frame replaced before it was read is reported as dropped.
+     */
+    template <typename T>
+    struct TripleBuffer
+    {
+    private:
+        static constexpr std::uint32_t INDEX_MASK{ 3 };
+        static constexpr std::uint32_t FRESH_BIT{ 4 };
+
+        std::array<T, 3> mSlots;
+        std::uint32_t mBack;
+        std::uint32_t mFront;
+        std::atomic<std::uint32_t> mMiddle;
+
+    public:
+        explicit TripleBuffer(const T& value)
+            : mSlots{ value, value, value }, mBack{ 0 }, mFront{ 1 }, mMiddle{ 2 }
+        {
+        }
+
+        T& GetBack() { return mSlots[mBack]; }
+        const T& GetFront() const { return mSlots[mFront]; }
+
+        /* hands the back slot to the reader, false if the frame it replaced was never read */
+        bool Publish()
+        {
+            std::uint32_t previous{ mMiddle.exchange(mBack | FRESH_BIT, std::memory_order_acq_rel) };
+            mBack = previous & INDEX_MASK;
+            return (previous & FRESH_BIT) == 0;
+        }
+
+        /* makes the newest published slot the front, false if nothing was published since the last call */
+        bool Acquire()
+        {
+            if ((mMiddle.load(std::memory_order_relaxed) & FRESH_BIT) == 0) {
+                return false;
+            }
+            mFront = mMiddle.exchange(mFront, std::memory_order_acq_rel) & INDEX_MASK;
+            return true;
+        }
+    };
+
+    ////////////////////////////////////////
+    /*
+     * Blits and renders frames to the terminal on a thread of its own, so a slow terminal write
+     * never holds up kernel submission. The render loop submits every frame it reads back and
+     * moves on; the presenter sleeps on an atomic counter until there is something to show and
+     * skips whatever frames were superseded while it was busy.
+     */
+    struct Presenter
+    {
+    private:
+        NCDevice& mDevice;
+        TripleBuffer<DisplayFramebuffer> mFrames;
+
+        /* bumped by every submit, wake and stop, the presenter waits for it to change */
+        std::atomic<std::uint32_t> mSignal;
+        std::atomic<bool> mIsStopping;
+        std::atomic<std::uint64_t> mNumPresented;
+        std::atomic<std::uint64_t> mNumDropped;
+        std::thread mThread;
+
+        void Run();
+        void Signal();
+
+    public:
+        Presenter(NCDevice& device, const DisplayFramebuffer& framebuffer);
+        ~Presenter();
+
+        Presenter(const Presenter&) = delete;
+        Presenter& operator=(const Presenter&) = delete;
+        Presenter(Presenter&&) = delete;
+        Presenter& operator=(Presenter&&) = delete;
+
+        /* swaps the frame into a free slot, framebuffer comes back holding that slot's stale pixels */
+        void Submit(DisplayFramebuffer& framebuffer);
+
+        /* lets the presenter refresh the HUD when no new frame is coming */
+        void Wake();
+
+        std::uint64_t GetNumPresented() const { return mNumPresented.load(std::memory_order_relaxed); }
+        std::uint64_t GetNumDropped() const { return mNumDropped.load(std::memory_order_relaxed); }
+    };
+}
@@ -0,0 +1,160 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "HWDeviceOptions.hpp"
+#include "Framebuffer.hpp"
+#include "Scene.hpp"
+
+#include <glm/vec4.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    struct Camera;
+
+    ////////////////////////////////////////
+    enum class FarmMessageType : std::uint32_t
+    {
+        Hello = 0,      /* worker -> coordinator, asks for the first job */
+        Job = 1,        /* coordinator -> worker, FarmJob */
+        Result = 2,     /* worker -> coordinator, FarmResult followed by the accumulation buffer */
+        Shutdown = 3    /* coordinator -> worker */
+    };
+
+    ////////////////////////////////////////
+    /* messages are sent in host byte order, every peer is expected to share it */
+    struct FarmJob
+    {
+        std::uint32_t mGeneration;      /* bumped whenever the camera moves, stale results are dropped */
+        std::uint32_t mWidth;
+        std::uint32_t mHeight;
+        std::uint32_t mSceneType;
+        std::uint32_t mFirstSample;
+        std::uint32_t mNumFrames;
+        float mCameraPosition[3];
+        float mFocalLength;
+        float mYaw;
+        float mPitch;
+        float mClearColor[4];
+        std::uint32_t mWorkerIndex;     /* dense per connected worker, keeps its caches apart from the others' */
+    };
+
+    ////////////////////////////////////////
+    struct FarmResult
+    {
+        std::uint32_t mGeneration;
+        std::uint32_t mFirstSample;
+        std::uint32_t mNumSamples;
+        std::uint32_t mNumPixels;
+    };
+
+    ////////////////////////////////////////
+    /* one framed stream socket, either end of the protocol; sends block, receives can be polled */
+    struct FarmConnection
+    {
+    private:
+        int mSocket;
+
+        /* a message that is still arriving through TryReceive */
+        std::vector<std::uint8_t> mPending;
+        std::size_t mReceived;
+        bool mIsPayload;
+        FarmMessageType mPendingType;
+
+    public:
+        FarmConnection();
+        explicit FarmConnection(int socket);
+        ~FarmConnection();
+
+        FarmConnection(const FarmConnection&) = delete;
+        FarmConnection& operator=(const FarmConnection&) = delete;
+        FarmConnection(FarmConnection&& other) noexcept;
+        FarmConnection& operator=(FarmConnection&& other) noexcept;
+
+        bool Send(FarmMessageType type, const void* header, std::size_t headerSize,
+                  const void* payload = nullptr, std::size_t payloadSize = 0);
+        bool Receive(FarmMessageType& type, std::vector<std::uint8_t>& message);
+        bool TryReceive(FarmMessageType& type, std::vector<std::uint8_t>& message, bool& isComplete);
+
+        int GetSocket() const { return mSocket; }
+        bool IsOpen() const { return mSocket >= 0; }
+    };
+
+    ////////////////////////////////////////
+    /*
+     * Hands out sample batches of the whole image to any number of workers and merges the
+     * float accumulation buffers they send back. Workers are local processes spawned (and
+     * pinned to NUMA nodes) by the coordinator, or any process started with --worker that
+     * can reach the listening address, 'unix:<path>' or 'tcp:<host>:<port>'. Each batch
+     * covers a disjoint range of sample indices, so the merged sum converges exactly like a
+     * single device rendering all of them. Workers are expected to run with the coordinator's
+     * sampling options, local ones inherit its command line.
+     */
+    struct FarmCoordinator
+    {
+    private:
+        struct Worker
+        {
+            FarmConnection mConnection;
+            std::uint32_t mSamplesDone;
+            std::uint32_t mIndex;
+        };
+
+        int mListenSocket;
+        std::string mSocketPath;        /* unix sockets only, unlinked on shutdown */
+        std::vector<Worker> mWorkers;
+        std::vector<pid_t> mProcesses;
+
+        FarmJob mJob;
+        std::uint32_t mSamplesPerFrame;
+        std::vector<glm::vec4> mAccumulation;
+        std::uint32_t mMergedSamples;
+
+        void Accept();
+        bool Dispatch(Worker& worker);
+        bool Merge(const std::vector<std::uint8_t>& message);
+
+    public:
+        FarmCoordinator(const char* address, std::uint32_t width, std::uint32_t height,
+                        SceneType sceneType, std::uint32_t samplesPerFrame);
+        ~FarmCoordinator();
+
+        FarmCoordinator(const FarmCoordinator&) = delete;
+        FarmCoordinator& operator=(const FarmCoordinator&) = delete;
+        FarmCoordinator(FarmCoordinator&&) = delete;
+        FarmCoordinator& operator=(FarmCoordinator&&) = delete;
+
+        void SpawnWorkers(std::uint32_t count, const char* address, int argc, char** argv);
+        void SetView(const Camera& camera, const glm::vec4& clearColor);
+        bool Poll(int timeout);
+        void Resolve(HDRFramebuffer& framebuffer) const;
+
+        bool IsListening() const { return mListenSocket >= 0; }
+        std::size_t GetNumWorkers() const { return mWorkers.size(); }
+        std::uint32_t GetMergedSamples() const { return mMergedSamples; }
+    };
+
+    ////////////////////////////////////////
+    bool RunFarmWorker(const char* address, const HWDeviceOptions& options);
+}
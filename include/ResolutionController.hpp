@@ -0,0 +1,68 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    /*
+     * Picks the internal render resolution and the samples traced per frame from measured
+     * device frame times. While the view changes it first trades samples, then resolution,
+     * against the target frame time, and only steps back up once the prediction for the next
+     * step still fits. Once the view has been still for a few frames it returns to full
+     * resolution and samples, since progressive refinement no longer competes with
+     * interactivity; the reduced setting is restored as soon as the view moves again.
+     */
+    struct ResolutionController
+    {
+    private:
+        std::uint32_t mDisplayWidth;
+        std::uint32_t mDisplayHeight;
+        std::uint32_t mMaxSamplesPerPixel;
+        double mTargetFrameTime;        /* milliseconds */
+        double mFrameTime;              /* smoothed, milliseconds */
+
+        /* setting used while the view moves, kept across still periods */
+        std::uint32_t mMovingLevel;
+        std::uint32_t mMovingSamplesPerPixel;
+
+        std::uint32_t mLevel;
+        std::uint32_t mSamplesPerPixel;
+        std::uint32_t mFramesSinceChange;
+        std::uint32_t mStillFrames;
+
+        static float GetScale(std::uint32_t level);
+        static std::uint32_t GetNumLevels();
+        double GetCost(std::uint32_t level, std::uint32_t samplesPerPixel) const;
+        void Apply(std::uint32_t level, std::uint32_t samplesPerPixel);
+
+    public:
+        ResolutionController(std::uint32_t displayWidth,
+                             std::uint32_t displayHeight,
+                             std::uint32_t samplesPerPixel,
+                             std::uint32_t targetFps);
+
+        void Update(double frameTime, bool isMoving);
+
+        std::uint32_t GetRenderWidth() const;
+        std::uint32_t GetRenderHeight() const;
+        std::uint32_t GetSamplesPerPixel() const { return mSamplesPerPixel; }
+        double GetFrameTime() const { return mFrameTime; }
+    };
+}
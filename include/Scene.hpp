@@ -0,0 +1,89 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    enum class SceneType : std::uint32_t
+    {
+        Default = 0,
+        Lamps = 1
+    };
+
+    ////////////////////////////////////////
+    struct Sphere
+    {
+        glm::vec4 mCenterRadius;
+        glm::vec4 mAlbedo;
+        glm::vec4 mEmission;    /* w holds the light index of an emitter, or -1 */
+    };
+
+    ////////////////////////////////////////
+    static_assert(sizeof(Sphere) == 3 * sizeof(glm::vec4), "Sphere must match the layout in kernels/scene.h");
+
+    ////////////////////////////////////////
+    struct BouncingSphere
+    {
+        std::uint32_t mIndex;
+        glm::vec3 mRestCenter;
+        float mPhase;
+    };
+
+    ////////////////////////////////////////
+    struct Scene
+    {
+    private:
+        std::vector<Sphere> mSpheres;
+        std::uint32_t mNumLights;
+
+        /* spheres changed since the last ClearDirtySpheres, in the order they were first touched */
+        std::vector<std::uint32_t> mDirtySpheres;
+        std::vector<bool> mIsDirty;
+        std::vector<BouncingSphere> mBouncingSpheres;
+
+        void CreateDefaultScene();
+        void CreateLampsScene();
+        void AddBouncingSphere(std::uint32_t index, float phase);
+
+    public:
+        explicit Scene(SceneType type = SceneType::Default);
+
+        void AddSphere(const glm::vec3& center,
+                       float radius,
+                       const glm::vec3& albedo,
+                       const glm::vec3& emission = glm::vec3(0.0f));
+
+        void TransformSphere(std::uint32_t index, const glm::vec3& center, float radius);
+        void Animate(float time);
+
+        const std::vector<std::uint32_t>& GetDirtySpheres() const { return mDirtySpheres; }
+        void ClearDirtySpheres();
+
+        const std::vector<Sphere>& GetSpheres() const { return mSpheres; }
+        std::uint32_t GetNumSpheres() const { return static_cast<std::uint32_t>(mSpheres.size()); }
+        std::uint32_t GetNumLights() const { return mNumLights; }
+        std::size_t GetSizeInBytes() const { return mSpheres.size() * sizeof(Sphere); }
+    };
+}
@@ -0,0 +1,87 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <glm/vec4.hpp>
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    struct Scene;
+    struct Sphere;
+
+    ////////////////////////////////////////
+    constexpr std::uint32_t BVH_NODE_LEAF           { 0xffffffffu };
+    constexpr std::uint32_t BVH_NODE_ROOT           { 0xffffffffu };
+
+    ////////////////////////////////////////
+    struct BvhNode
+    {
+        glm::vec4 mBoundsMin;
+        glm::vec4 mBoundsMax;
+        std::uint32_t mLeftOrSphere;    /* left child of an interior node, sphere index of a leaf */
+        std::uint32_t mRight;           /* right child of an interior node, BVH_NODE_LEAF for a leaf */
+        std::uint32_t mParent;          /* BVH_NODE_ROOT for the root, only the host refit walks it */
+        std::uint32_t mPadding;
+    };
+
+    ////////////////////////////////////////
+    static_assert(sizeof(BvhNode) == 48, "BvhNode must match the layout in kernels/scene.h");
+
+    ////////////////////////////////////////
+    /*
+     * Bounding volume hierarchy over the scene's spheres, one sphere per leaf and every node
+     * stored after its parent. Moving or resizing spheres refits only the ancestors of their
+     * leaves; the topology is kept until the interior nodes have, on average, grown too far
+     * past the surface area they were built with. The average is unweighted on purpose: a
+     * global SAH cost is dominated by huge spheres such as the floor and would never notice
+     * a small cluster of objects drifting apart.
+     */
+    struct SceneBvh
+    {
+    private:
+        std::vector<BvhNode> mNodes;
+        std::vector<std::uint32_t> mLeaves;     /* sphere index -> leaf node */
+        std::vector<double> mBuildAreas;        /* surface area of every node right after the build */
+        double mInflationSum;
+        std::size_t mNumInteriorNodes;
+
+        std::uint32_t Build(std::vector<std::uint32_t>& sphereIndices,
+                            std::size_t begin,
+                            std::size_t end,
+                            std::uint32_t parent,
+                            const std::vector<Sphere>& spheres);
+        void SetBounds(std::uint32_t nodeIndex, const glm::vec4& boundsMin, const glm::vec4& boundsMax);
+
+    public:
+        explicit SceneBvh(const Scene& scene);
+
+        void Refit(const Scene& scene,
+                   const std::vector<std::uint32_t>& dirtySpheres,
+                   std::vector<std::uint32_t>& refitNodes);
+
+        double GetInflation() const;
+        bool NeedsRebuild() const;
+
+        const std::vector<BvhNode>& GetNodes() const { return mNodes; }
+        std::size_t GetNodesSizeInBytes() const { return mNodes.size() * sizeof(BvhNode); }
+    };
+}
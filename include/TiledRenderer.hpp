@@ -0,0 +1,101 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "HWDeviceOptions.hpp"
+#include "Framebuffer.hpp"
+
+#include <glm/vec4.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    struct Camera;
+    struct HWDeviceContext;
+    struct Scene;
+
+    ////////////////////////////////////////
+    enum class TiledImageFormat : std::uint32_t
+    {
+        PPM = 0,
+        PFM = 1
+    };
+
+    ////////////////////////////////////////
+    /*
+     * Bucket grid of a tiled render. Every tile traces its core plus an apron as wide as the
+     * denoiser's footprint, so pixels near a tile edge are filtered with the same neighbours as
+     * in a single pass. The region, core plus apron, is all the device ever holds; border tiles
+     * shift their region inwards instead of shrinking it.
+     */
+    struct TileLayout
+    {
+        std::uint32_t mImageWidth;
+        std::uint32_t mImageHeight;
+        std::uint32_t mRegionWidth;
+        std::uint32_t mRegionHeight;
+        std::uint32_t mTileWidth;
+        std::uint32_t mTileHeight;
+        std::uint32_t mApron;
+        std::uint32_t mNumTilesX;
+        std::uint32_t mNumTilesY;
+    };
+
+    ////////////////////////////////////////
+    /*
+     * An output image that never exists in memory. Both formats store rows of RGB pixels at
+     * fixed offsets after a text header, so tiles are written straight to where they belong, in
+     * any order and from any thread. The file is sized up front and left sparse until written.
+     */
+    struct TiledImageFile
+    {
+    private:
+        int mFile;
+        TiledImageFormat mFormat;
+        std::uint32_t mWidth;
+        std::uint32_t mHeight;
+        std::size_t mHeaderSize;
+
+    public:
+        TiledImageFile(const char* url, TiledImageFormat format, std::uint32_t width, std::uint32_t height);
+        ~TiledImageFile();
+
+        TiledImageFile(const TiledImageFile&) = delete;
+        TiledImageFile& operator=(const TiledImageFile&) = delete;
+        TiledImageFile(TiledImageFile&&) = delete;
+        TiledImageFile& operator=(TiledImageFile&&) = delete;
+
+        bool IsOpen() const { return mFile >= 0; }
+        std::size_t GetBytesPerPixel() const;
+
+        /* numPixels packed RGB pixels starting at (x, y), safe to call concurrently */
+        bool WriteRow(std::uint32_t x, std::uint32_t y, const void* pixels, std::uint32_t numPixels);
+    };
+
+    ////////////////////////////////////////
+    bool GetTiledImageFormat(const std::string& url, TiledImageFormat& format);
+    PixelFormat GetTiledFramebufferFormat(TiledImageFormat format);
+    bool GetTileLayout(std::uint32_t width, std::uint32_t height, const HWDeviceOptions& options,
+                       std::size_t environmentSize, std::size_t maxMemory, TileLayout& layout);
+    bool RenderTiled(const char* url, const TileLayout& layout, const Scene& scene, const Camera& camera,
+                     const glm::vec4& clearColor, std::uint32_t numSamples, const HWDeviceOptions& options,
+                     HWDeviceContext& context);
+}
@@ -0,0 +1,60 @@
+// fixed trace workload timed on every candidate by --device auto, every device traces the same
+// rays against the same procedural spheres so that the timings compare
+
+#include "scene.h"
+
+#define CALIBRATE_GRID 8
+#define CALIBRATE_BOUNCES 4
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+float4 calibration_sphere(uint index)
+{
+    // a grid of touching spheres on the floor in front of the camera
+    float x = (float)(index % CALIBRATE_GRID) - 0.5f * (float)(CALIBRATE_GRID - 1);
+    float z = (float)(index / CALIBRATE_GRID) + 2.0f;
+    return (float4)(x, 0.0f, z, 0.5f);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+__kernel void calibrate(__global float* output, uint width, uint height)
+{
+    uint x = get_global_id(0);
+    uint y = get_global_id(1);
+    if (x >= width || y >= height) {
+        return;
+    }
+
+    float u = ((float)x + 0.5f) / (float)width * 2.0f - 1.0f;
+    float v = ((float)y + 0.5f) / (float)height * 2.0f - 1.0f;
+    float3 origin = (float3)(0.0f, 1.5f, -2.0f);
+    float3 direction = normalize((float3)(u, -v - 0.5f, 1.0f));
+
+    uint state = y * width + x;
+    float throughput = 1.0f;
+    for (uint bounce = 0; bounce < CALIBRATE_BOUNCES; ++bounce) {
+        // brute force over every sphere, the workload must not depend on a host-built tree
+        float closest = FAR_DEPTH;
+        uint hitIndex = 0;
+        for (uint i = 0; i < CALIBRATE_GRID * CALIBRATE_GRID; ++i) {
+            float t;
+            if (intersect_sphere(calibration_sphere(i), origin, direction, &t) && t < closest) {
+                closest = t;
+                hitIndex = i;
+            }
+        }
+        if (closest == FAR_DEPTH) {
+            break;
+        }
+
+        float4 sphere = calibration_sphere(hitIndex);
+        origin += direction * closest;
+        state = state * 747796405u + 2891336453u;
+        float u1 = (float)(state >> 16) * (1.0f / 65536.0f);
+        float u2 = (float)(state & 0xffffu) * (1.0f / 65536.0f);
+        direction = sample_cosine_hemisphere((origin - sphere.xyz) / sphere.w, u1, u2);
+        throughput *= 0.5f;
+    }
+
+    // written so that the compiler cannot drop the trace
+    output[y * width + x] = throughput;
+}
@@ -0,0 +1,79 @@
+// one pass of the edge-avoiding a-trous wavelet filter (Dammertz et al. 2010),
+// guided by the albedo, normal and depth buffers written by the path tracer
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+__kernel void denoise_atrous(__global const float4* input,
+                             __global float4* output,
+                             __global const float4* albedo,
+                             __global const float4* normal,
+                             __global const float* depth,
+                             uint width, uint height, int stepWidth,
+                             float sigmaColor, float sigmaAlbedo,
+                             float sigmaNormal, float sigmaDepth)
+{
+    int x = (int)get_global_id(0);
+    int y = (int)get_global_id(1);
+
+    if (x >= (int)width || y >= (int)height) {
+        return;
+    }
+
+    // B3 spline taps for offsets 0, 1 and 2
+    const float taps[3] = { 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+    int index = y * (int)width + x;
+    float4 centerSample = input[index];
+    float3 centerColor = centerSample.xyz / max(centerSample.w, 1.0f);
+    float3 centerAlbedo = albedo[index].xyz;
+    float3 centerNormal = normal[index].xyz;
+    float centerDepth = depth[index];
+    bool centerHasNormal = dot(centerNormal, centerNormal) > 0.5f;
+
+    float centerWeight = taps[0] * taps[0];
+    float3 colorSum = centerColor * centerWeight;
+    float weightSum = centerWeight;
+
+    for (int dy = -2; dy <= 2; ++dy) {
+        for (int dx = -2; dx <= 2; ++dx) {
+            if (dx == 0 && dy == 0) {
+                continue;
+            }
+
+            int sx = x + dx * stepWidth;
+            int sy = y + dy * stepWidth;
+            if (sx < 0 || sy < 0 || sx >= (int)width || sy >= (int)height) {
+                continue;
+            }
+
+            int sampleIndex = sy * (int)width + sx;
+            float4 currentSample = input[sampleIndex];
+            float3 currentColor = currentSample.xyz / max(currentSample.w, 1.0f);
+            float3 currentNormal = normal[sampleIndex].xyz;
+            bool currentHasNormal = dot(currentNormal, currentNormal) > 0.5f;
+
+            float3 colorDelta = centerColor - currentColor;
+            float colorWeight = exp(-dot(colorDelta, colorDelta) / (sigmaColor * sigmaColor));
+
+            float3 albedoDelta = centerAlbedo - albedo[sampleIndex].xyz;
+            float albedoWeight = exp(-dot(albedoDelta, albedoDelta) / (sigmaAlbedo * sigmaAlbedo));
+
+            float normalWeight = 1.0f;
+            if (centerHasNormal != currentHasNormal) {
+                normalWeight = 0.0f;
+            }
+            else if (centerHasNormal) {
+                normalWeight = pow(max(dot(centerNormal, currentNormal), 0.0f), sigmaNormal);
+            }
+
+            float offsetLength = sqrt((float)(dx * dx + dy * dy)) * (float)stepWidth;
+            float relativeDepthDelta = fabs(centerDepth - depth[sampleIndex]) / max(centerDepth, 1e-3f);
+            float depthWeight = exp(-relativeDepthDelta / (sigmaDepth * offsetLength + 1e-4f));
+
+            float weight = taps[abs(dx)] * taps[abs(dy)] * colorWeight * albedoWeight * normalWeight * depthWeight;
+            colorSum += currentColor * weight;
+            weightSum += weight;
+        }
+    }
+
+    output[index] = (float4)(colorSum / weightSum, 1.0f);
+}
@@ -0,0 +1,93 @@
+// equirectangular environment lookup and importance sampling through a two-level alias table,
+// the layout of EnvironmentAlias must match EnvironmentMap.hpp
+
+#ifndef CURSEDRAY_ENVIRONMENT_H
+#define CURSEDRAY_ENVIRONMENT_H
+
+#include "scene.h"
+
+#define ONE_MINUS_EPSILON 0x1.fffffep-1f
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+typedef struct
+{
+    float threshold;    // probability of keeping this entry rather than taking its alias
+    uint alias;
+    float pdf;          // probability of the texel within its row, or of the row itself
+} EnvironmentAlias;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+uint sample_alias(__global const EnvironmentAlias* table, uint count, float u, float* remapped)
+{
+    // one uniform picks the bucket and decides between its two outcomes, what is left of it
+    // is uniform again and places the sample within the chosen entry
+    float scaled = u * (float)count;
+    uint index = min((uint)scaled, count - 1);
+    float fraction = min(scaled - (float)index, ONE_MINUS_EPSILON);
+    EnvironmentAlias entry = table[index];
+    if (fraction < entry.threshold) {
+        *remapped = min(fraction / entry.threshold, ONE_MINUS_EPSILON);
+        return index;
+    }
+    *remapped = min((fraction - entry.threshold) / (1.0f - entry.threshold), ONE_MINUS_EPSILON);
+    return entry.alias;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+uint environment_texel(float3 direction, uint width, uint height, float* sinTheta)
+{
+    // +y is the zenith at the top row, -z the centre column
+    float u = 0.5f + atan2(direction.x, -direction.z) / (2.0f * PI);
+    float theta = acos(clamp(direction.y, -1.0f, 1.0f));
+    *sinTheta = sin(theta);
+
+    uint x = min((uint)(u * (float)width), width - 1);
+    uint y = min((uint)(theta / PI * (float)height), height - 1);
+    return y * width + x;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+float3 environment_radiance(__global const half* pixels, uint width, uint height, float3 direction)
+{
+    // vload_half is core, no cl_khr_fp16 needed to read half data
+    float sinTheta;
+    return vload_half3(environment_texel(direction, width, height, &sinTheta), pixels);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+float environment_pdf(__global const EnvironmentAlias* alias, uint width, uint height, float3 direction)
+{
+    // the table is constant per texel in (u, v), dividing by the Jacobian 2 pi^2 sin(theta) gives solid angle
+    float sinTheta;
+    uint texel = environment_texel(direction, width, height, &sinTheta);
+    if (sinTheta <= 0.0f) {
+        return 0.0f;
+    }
+    uint row = texel / width;
+    float pdf = alias[texel].pdf * alias[width * height + row].pdf;
+    return pdf * (float)(width * height) / (2.0f * PI * PI * sinTheta);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool sample_environment(__global const EnvironmentAlias* alias, uint width, uint height, float2 u,
+                        float3* direction, float* solidAnglePdf)
+{
+    float remappedV;
+    float remappedU;
+    uint row = sample_alias(alias + width * height, height, u.x, &remappedV);
+    uint column = sample_alias(alias + row * width, width, u.y, &remappedU);
+
+    float phi = (((float)column + remappedU) / (float)width - 0.5f) * 2.0f * PI;
+    float theta = ((float)row + remappedV) / (float)height * PI;
+    float sinTheta = sin(theta);
+    if (sinTheta <= 0.0f) {
+        return false;
+    }
+
+    *direction = (float3)(sinTheta * sin(phi), cos(theta), -sinTheta * cos(phi));
+    float pdf = alias[row * width + column].pdf * alias[width * height + row].pdf;
+    *solidAnglePdf = pdf * (float)(width * height) / (2.0f * PI * PI * sinTheta);
+    return *solidAnglePdf > 0.0f;
+}
+
+#endif
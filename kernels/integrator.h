@@ -0,0 +1,244 @@
+// path state and the bounce loop body shared by the per-pixel and the
+// persistent-threads integrators
+
+#ifndef CURSEDRAY_INTEGRATOR_H
+#define CURSEDRAY_INTEGRATOR_H
+
+#include "sampler.h"
+#include "scene.h"
+#include "lights.h"
+#include "environment.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+typedef struct
+{
+    __global const Sphere* spheres;
+    __global const BvhNode* bvhNodes;
+    __global const LightNode* lightNodes;
+    __global const Light* lights;
+    __constant uint* sobolDirections;
+    __constant uint* blueNoise;
+    __global const half* environment;
+    __global const EnvironmentAlias* environmentAlias;
+    uint environmentWidth;          // 0 without an environment map, misses then see the clear color
+    uint environmentHeight;
+    uint numLights;
+    uint nextEventEstimation;
+    uint maxDepth;
+    uint rouletteDepth;
+    uint samplerType;
+    float4 clearColor;
+} RenderContext;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+typedef struct
+{
+    float4 position;    // w holds the focal length
+    float4 forward;
+    float4 right;
+    float4 up;
+} CameraState;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+typedef struct
+{
+    SamplerState sampler;
+    float3 origin;
+    float3 direction;
+    float3 throughput;
+    float3 radiance;
+    float3 previousPosition;
+    float3 previousNormal;
+    float previousBsdfPdf;
+    uint bounce;
+
+    // first hit, feeds the denoiser's guide buffers
+    float3 firstAlbedo;
+    float3 firstNormal;
+    float firstDepth;
+} PathState;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void path_begin(PathState* path, const RenderContext* context, const CameraState* camera,
+                uint x, uint y, uint width, uint height, uint sampleIndex, uint frameIndex)
+{
+    sampler_init(&path->sampler, context->samplerType, x, y, width, sampleIndex, frameIndex);
+
+    float aspectRatio = (float)width / (float)height;
+    float2 jitter = sampler_next_2d(&path->sampler, context->sobolDirections, context->blueNoise);
+    float u = (((float)x + jitter.x) / (float)width * 2.0f - 1.0f) * aspectRatio;
+    float v = 1.0f - ((float)y + jitter.y) / (float)height * 2.0f;
+
+    path->origin = camera->position.xyz;
+    path->direction = normalize(camera->right.xyz * u + camera->up.xyz * v + camera->forward.xyz * camera->position.w);
+    path->throughput = (float3)(1.0f);
+    path->radiance = (float3)(0.0f);
+    path->previousPosition = path->origin;
+    path->previousNormal = (float3)(0.0f);
+    path->previousBsdfPdf = 0.0f;
+    path->bounce = 0;
+
+    path->firstAlbedo = context->clearColor.xyz;
+    path->firstNormal = (float3)(0.0f);
+    path->firstDepth = FAR_DEPTH;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool path_step(PathState* path, const RenderContext* context)
+{
+    // advance the path by one bounce, returns false once the path has terminated
+    bool hasEnvironment = context->environmentWidth > 0;
+    bool sampleLights = context->nextEventEstimation && (context->numLights > 0 || hasEnvironment);
+
+    // light sampling splits evenly between the environment and the emitters when there are both
+    float environmentSelection = hasEnvironment ? (context->numLights > 0 ? 0.5f : 1.0f) : 0.0f;
+
+    float t;
+    uint hitIndex;
+    if (!intersect_scene(context->spheres, context->bvhNodes, path->origin, path->direction, &t, &hitIndex)) {
+        if (!hasEnvironment) {
+            path->radiance += path->throughput * context->clearColor.xyz;
+            return false;
+        }
+
+        float3 background = environment_radiance(context->environment, context->environmentWidth,
+                                                 context->environmentHeight, path->direction);
+        float weight = 1.0f;
+        if (path->bounce == 0) {
+            path->firstAlbedo = min(background, (float3)(1.0f));
+        }
+        else if (sampleLights) {
+            float lightPdf = environmentSelection * environment_pdf(context->environmentAlias, context->environmentWidth,
+                                                                    context->environmentHeight, path->direction);
+            weight = power_heuristic(path->previousBsdfPdf, lightPdf);
+        }
+        path->radiance += path->throughput * background * weight;
+        return false;
+    }
+
+    Sphere sphere = context->spheres[hitIndex];
+    float3 position = path->origin + path->direction * t;
+    float3 n = (position - sphere.centerRadius.xyz) / sphere.centerRadius.w;
+    if (dot(n, path->direction) > 0.0f) {
+        n = -n;
+    }
+
+    if (path->bounce == 0) {
+        path->firstAlbedo = sphere.albedo.xyz;
+        path->firstNormal = n;
+        path->firstDepth = t;
+    }
+
+    // emitters found by BSDF sampling are weighted against the light sampling strategy
+    if (sphere.emission.w >= 0.0f) {
+        float weight = 1.0f;
+        if (path->bounce > 0 && sampleLights) {
+            float lightPdf = (1.0f - environmentSelection) *
+                             light_tree_pdf(context->lightNodes, context->lights, (uint)sphere.emission.w,
+                                            path->previousPosition, path->previousNormal) *
+                             sphere_light_pdf(sphere, path->previousPosition);
+            weight = power_heuristic(path->previousBsdfPdf, lightPdf);
+        }
+        path->radiance += path->throughput * sphere.emission.xyz * weight;
+    }
+
+    path->throughput *= sphere.albedo.xyz;
+    if (max(max(path->throughput.x, path->throughput.y), path->throughput.z) <= 0.0f) {
+        return false;
+    }
+
+    // x selects the environment or a light, y drives Russian roulette
+    float2 eventSample = sampler_next_2d(&path->sampler, context->sobolDirections, context->blueNoise);
+    float2 lightSample = sampler_next_2d(&path->sampler, context->sobolDirections, context->blueNoise);
+    float2 bounceSample = sampler_next_2d(&path->sampler, context->sobolDirections, context->blueNoise);
+
+    float3 offsetPosition = position + n * RAY_EPSILON;
+    if (sampleLights && eventSample.x < environmentSelection) {
+        float3 lightDirection;
+        float solidAnglePdf;
+        if (sample_environment(context->environmentAlias, context->environmentWidth, context->environmentHeight,
+                               lightSample, &lightDirection, &solidAnglePdf)) {
+            float cosine = dot(n, lightDirection);
+            float shadowDistance;
+            uint shadowIndex;
+            if (cosine > 0.0f &&
+                !intersect_scene(context->spheres, context->bvhNodes, offsetPosition, lightDirection, &shadowDistance, &shadowIndex)) {
+                float3 background = environment_radiance(context->environment, context->environmentWidth,
+                                                         context->environmentHeight, lightDirection);
+                float lightPdf = environmentSelection * solidAnglePdf;
+                float weight = power_heuristic(lightPdf, cosine / PI);
+                path->radiance += path->throughput * background * (cosine / PI) * weight / lightPdf;
+            }
+        }
+    }
+    else if (sampleLights) {
+        // rescale what is left of the selection sample so the light tree still sees a uniform number
+        float lightSelection = min((eventSample.x - environmentSelection) / (1.0f - environmentSelection), ONE_MINUS_EPSILON);
+        float selectionPdf;
+        int lightIndex = sample_light_tree(context->lightNodes, context->numLights, position, n, lightSelection, &selectionPdf);
+
+        float3 lightDirection;
+        float solidAnglePdf;
+        if (lightIndex >= 0) {
+            uint lightSphere = context->lights[lightIndex].sphereIndex;
+            Sphere emitter = context->spheres[lightSphere];
+            if (sample_sphere_light(emitter, position, lightSample, &lightDirection, &solidAnglePdf)) {
+                float cosine = dot(n, lightDirection);
+                float shadowDistance;
+                uint shadowIndex;
+                if (cosine > 0.0f &&
+                    intersect_scene(context->spheres, context->bvhNodes, offsetPosition, lightDirection, &shadowDistance, &shadowIndex) &&
+                    shadowIndex == lightSphere) {
+                    // the albedo is already folded into the throughput
+                    float lightPdf = (1.0f - environmentSelection) * selectionPdf * solidAnglePdf;
+                    float weight = power_heuristic(lightPdf, cosine / PI);
+                    path->radiance += path->throughput * emitter.emission.xyz * (cosine / PI) * weight / lightPdf;
+                }
+            }
+        }
+    }
+
+    ++path->bounce;
+    if (path->bounce >= context->maxDepth) {
+        return false;
+    }
+
+    if (path->bounce >= context->rouletteDepth) {
+        float survival = min(max(max(path->throughput.x, path->throughput.y), path->throughput.z), 0.95f);
+        if (eventSample.y >= survival) {
+            return false;
+        }
+        path->throughput /= survival;
+    }
+
+    path->previousPosition = position;
+    path->previousNormal = n;
+    path->origin = offsetPosition;
+    path->direction = sample_cosine_hemisphere(n, bounceSample.x, bounceSample.y);
+    path->previousBsdfPdf = max(dot(n, path->direction), 0.0f) / PI;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void report_lane_steps(__global uint* laneStats, __local uint* groupCounters, uint steps)
+{
+    // lanes of a work-group stay occupied until its longest-running lane is done,
+    // so useful steps over (group size * longest lane) estimates lane utilization
+    if (get_local_id(0) == 0 && get_local_id(1) == 0) {
+        groupCounters[0] = 0;
+        groupCounters[1] = 0;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    atomic_add(&groupCounters[0], steps);
+    atomic_max(&groupCounters[1], steps);
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if (get_local_id(0) == 0 && get_local_id(1) == 0) {
+        uint groupSize = (uint)(get_local_size(0) * get_local_size(1));
+        atomic_add(&laneStats[0], groupCounters[0]);
+        atomic_add(&laneStats[1], groupCounters[1] * groupSize);
+    }
+}
+
+#endif
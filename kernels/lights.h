@@ -0,0 +1,157 @@
+// light selection through the light BVH and solid angle sampling of spherical
+// emitters, the layouts of LightNode and Light must match LightTree.hpp
+
+#ifndef CURSEDRAY_LIGHTS_H
+#define CURSEDRAY_LIGHTS_H
+
+#include "scene.h"
+
+#define LIGHT_NODE_LEAF 0xffffffffu
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+typedef struct
+{
+    float4 boundsMin;   // w holds the power emitted below the node
+    float4 boundsMax;
+    uint leftOrLight;   // left child of an interior node, light index of a leaf
+    uint right;         // right child of an interior node, LIGHT_NODE_LEAF for a leaf
+    uint padding[2];
+} LightNode;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+typedef struct
+{
+    uint sphereIndex;
+    uint bitTrail;      // bit i set means the path from the root goes right at depth i
+    uint depth;
+    uint padding;
+} Light;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+float light_node_importance(__global const LightNode* node, float3 position, float3 normal)
+{
+    float power = node->boundsMin.w;
+    if (power <= 0.0f) {
+        return 0.0f;
+    }
+
+    float3 center = 0.5f * (node->boundsMin.xyz + node->boundsMax.xyz);
+    float radius = 0.5f * length(node->boundsMax.xyz - node->boundsMin.xyz);
+    float3 toCenter = center - position;
+    float distanceSquared = dot(toCenter, toCenter);
+    float distance = sqrt(distanceSquared);
+
+    // conservative bound of the receiver cosine over the node's bounding sphere
+    float cosine = 1.0f;
+    if (distance > radius) {
+        float theta = acos(clamp(dot(normal, toCenter) / distance, -1.0f, 1.0f));
+        float thetaBound = asin(radius / distance);
+        cosine = theta <= thetaBound ? 1.0f : max(0.0f, cos(theta - thetaBound));
+    }
+
+    return power * cosine / max(distanceSquared, 0.25f * radius * radius);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+int sample_light_tree(__global const LightNode* nodes, uint numLights,
+                      float3 position, float3 normal, float u, float* selectionPdf)
+{
+    if (numLights == 0) {
+        return -1;
+    }
+
+    uint nodeIndex = 0;
+    float probability = 1.0f;
+    for (;;) {
+        __global const LightNode* node = nodes + nodeIndex;
+        if (node->right == LIGHT_NODE_LEAF) {
+            *selectionPdf = probability;
+            return (int)node->leftOrLight;
+        }
+
+        float left = light_node_importance(nodes + node->leftOrLight, position, normal);
+        float right = light_node_importance(nodes + node->right, position, normal);
+        float total = left + right;
+        if (total <= 0.0f) {
+            return -1;
+        }
+
+        // descend and rescale the sample so it stays uniform for the next level
+        float leftProbability = left / total;
+        if (u < leftProbability) {
+            nodeIndex = node->leftOrLight;
+            probability *= leftProbability;
+            u = u / leftProbability;
+        }
+        else {
+            nodeIndex = node->right;
+            probability *= 1.0f - leftProbability;
+            u = (u - leftProbability) / (1.0f - leftProbability);
+        }
+        u = min(u, 0.99999994f);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+float light_tree_pdf(__global const LightNode* nodes, __global const Light* lights,
+                     uint lightIndex, float3 position, float3 normal)
+{
+    Light light = lights[lightIndex];
+    uint nodeIndex = 0;
+    float probability = 1.0f;
+
+    for (uint level = 0; level < light.depth; ++level) {
+        __global const LightNode* node = nodes + nodeIndex;
+        float left = light_node_importance(nodes + node->leftOrLight, position, normal);
+        float right = light_node_importance(nodes + node->right, position, normal);
+        float total = left + right;
+        if (total <= 0.0f) {
+            return 0.0f;
+        }
+
+        bool goRight = (light.bitTrail >> level) & 1u;
+        probability *= (goRight ? right : left) / total;
+        nodeIndex = goRight ? node->right : node->leftOrLight;
+    }
+    return probability;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+float sphere_light_pdf(Sphere sphere, float3 position)
+{
+    float3 toCenter = sphere.centerRadius.xyz - position;
+    float distanceSquared = dot(toCenter, toCenter);
+    float radiusSquared = sphere.centerRadius.w * sphere.centerRadius.w;
+    if (distanceSquared <= radiusSquared) {
+        return 0.0f;
+    }
+
+    // 1 - cos(thetaMax) written to stay accurate for small, distant emitters
+    float sinThetaMaxSquared = radiusSquared / distanceSquared;
+    float oneMinusCosThetaMax = sinThetaMaxSquared / (1.0f + sqrt(max(0.0f, 1.0f - sinThetaMaxSquared)));
+    return 1.0f / (2.0f * PI * oneMinusCosThetaMax);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool sample_sphere_light(Sphere sphere, float3 position, float2 u, float3* direction, float* solidAnglePdf)
+{
+    // uniform sampling of the cone the sphere subtends
+    float3 toCenter = sphere.centerRadius.xyz - position;
+    float distanceSquared = dot(toCenter, toCenter);
+    float radiusSquared = sphere.centerRadius.w * sphere.centerRadius.w;
+    if (distanceSquared <= radiusSquared) {
+        return false;
+    }
+
+    float sinThetaMaxSquared = radiusSquared / distanceSquared;
+    float oneMinusCosThetaMax = sinThetaMaxSquared / (1.0f + sqrt(max(0.0f, 1.0f - sinThetaMaxSquared)));
+    float cosTheta = 1.0f - u.x * oneMinusCosThetaMax;
+    float sinTheta = sqrt(max(0.0f, 1.0f - cosTheta * cosTheta));
+    float phi = 2.0f * PI * u.y;
+
+    *direction = to_world(toCenter / sqrt(distanceSquared), (float3)(sinTheta * cos(phi), sinTheta * sin(phi), cosTheta));
+    *solidAnglePdf = 1.0f / (2.0f * PI * oneMinusCosThetaMax);
+    return true;
+}
+
+#endif
@@ -0,0 +1,74 @@
+// trace one work-item per pixel through a scene of spheres with next-event estimation,
+// accumulate radiance and write the albedo, normal and depth buffers used by the denoiser
+// the viewport places the buffers in a larger image (origin, image size) so tiles trace image pixels
+
+#include "integrator.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+__kernel void path_trace(__global float4* accumulation,
+                         __global float4* albedo,
+                         __global float4* normal,
+                         __global float* depth,
+                         __global const Sphere* spheres, __global const BvhNode* bvhNodes,
+                         __global const LightNode* lightNodes,
+                         __global const Light* lights, uint numLights,
+                         uint nextEventEstimation,
+                         uint width, uint height,
+                         uint4 viewport,
+                         uint frameIndex, uint sampleIndex,
+                         uint samplesPerPixel, uint maxDepth, uint rouletteDepth,
+                         __constant uint* sobolDirections,
+                         __constant uint* blueNoise,
+                         uint samplerType,
+                         float4 cameraPosition, float4 cameraForward,
+                         float4 cameraRight, float4 cameraUp,
+                         float4 clearColor,
+                         __global const half* environment,
+                         __global const EnvironmentAlias* environmentAlias,
+                         uint environmentWidth, uint environmentHeight,
+                         __global uint* laneStats)
+{
+    __local uint groupCounters[2];
+
+    uint x = get_global_id(0);
+    uint y = get_global_id(1);
+    uint steps = 0;
+
+    // out-of-range work-items stay alive until the lane statistics barrier
+    if (x < width && y < height) {
+        RenderContext context = { spheres, bvhNodes, lightNodes, lights, sobolDirections, blueNoise,
+                                  environment, environmentAlias, environmentWidth, environmentHeight,
+                                  numLights, nextEventEstimation, maxDepth, rouletteDepth,
+                                  samplerType, clearColor };
+        CameraState camera = { cameraPosition, cameraForward, cameraRight, cameraUp };
+
+        float3 radianceSum = (float3)(0.0f);
+        float3 albedoSum = (float3)(0.0f);
+        float3 normalSum = (float3)(0.0f);
+        float depthSum = 0.0f;
+
+        for (uint s = 0; s < samplesPerPixel; ++s) {
+            PathState path;
+            path_begin(&path, &context, &camera, viewport.x + x, viewport.y + y, viewport.z, viewport.w, sampleIndex + s, frameIndex);
+            for (bool alive = true; alive; ++steps) {
+                alive = path_step(&path, &context);
+            }
+
+            radianceSum += path.radiance;
+            albedoSum += path.firstAlbedo;
+            normalSum += path.firstNormal;
+            depthSum += path.firstDepth;
+        }
+
+        uint index = y * width + x;
+        float inverseSamples = 1.0f / (float)samplesPerPixel;
+        float normalLength = length(normalSum);
+
+        accumulation[index] += (float4)(radianceSum, (float)samplesPerPixel);
+        albedo[index] = (float4)(albedoSum * inverseSamples, 1.0f);
+        normal[index] = (float4)(normalLength > 0.0f ? normalSum / normalLength : (float3)(0.0f), 0.0f);
+        depth[index] = depthSum * inverseSamples;
+    }
+
+    report_lane_steps(laneStats, groupCounters, steps);
+}
@@ -0,0 +1,95 @@
+// persistent-threads integrator: a fixed pool of work-items pulls (pixel, sample) pairs
+// from a global counter and regenerates terminated paths on the spot, so lanes stay busy
+// instead of idling behind the longest path of their group
+
+#include "integrator.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void atomic_add_float(volatile __global float* address, float value)
+{
+    volatile __global uint* word = (volatile __global uint*)address;
+    uint expected;
+    uint current = *word;
+    do {
+        expected = current;
+        current = atomic_cmpxchg(word, expected, as_uint(as_float(expected) + value));
+    } while (current != expected);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+__kernel void path_trace_persistent(__global float4* accumulation,
+                                    __global float4* albedo,
+                                    __global float4* normal,
+                                    __global float* depth,
+                                    __global const Sphere* spheres, __global const BvhNode* bvhNodes,
+                                    __global const LightNode* lightNodes,
+                                    __global const Light* lights, uint numLights,
+                                    uint nextEventEstimation,
+                                    uint width, uint height,
+                                    uint4 viewport,
+                                    uint frameIndex, uint sampleIndex,
+                                    uint samplesPerPixel, uint maxDepth, uint rouletteDepth,
+                                    __constant uint* sobolDirections,
+                                    __constant uint* blueNoise,
+                                    uint samplerType,
+                                    float4 cameraPosition, float4 cameraForward,
+                                    float4 cameraRight, float4 cameraUp,
+                                    float4 clearColor,
+                                    __global const half* environment,
+                                    __global const EnvironmentAlias* environmentAlias,
+                                    uint environmentWidth, uint environmentHeight,
+                                    __global uint* laneStats,
+                                    volatile __global uint* workCounter)
+{
+    __local uint groupCounters[2];
+
+    RenderContext context = { spheres, bvhNodes, lightNodes, lights, sobolDirections, blueNoise,
+                              environment, environmentAlias, environmentWidth, environmentHeight,
+                              numLights, nextEventEstimation, maxDepth, rouletteDepth,
+                              samplerType, clearColor };
+    CameraState camera = { cameraPosition, cameraForward, cameraRight, cameraUp };
+
+    uint numPixels = width * height;
+    uint totalWork = numPixels * samplesPerPixel;
+    uint steps = 0;
+
+    PathState path;
+    uint pixel = 0;
+    uint sample = 0;
+    bool alive = false;
+
+    for (;;) {
+        if (!alive) {
+            // consecutive work items are neighbouring pixels of the same sample, which keeps
+            // regenerated paths coherent and makes concurrent writes to one pixel rare
+            uint work = atomic_inc(workCounter);
+            if (work >= totalWork) {
+                break;
+            }
+            pixel = work % numPixels;
+            sample = work / numPixels;
+            path_begin(&path, &context, &camera, viewport.x + pixel % width, viewport.y + pixel / width,
+                       viewport.z, viewport.w, sampleIndex + sample, frameIndex);
+        }
+
+        alive = path_step(&path, &context);
+        ++steps;
+
+        if (!alive) {
+            volatile __global float* target = (volatile __global float*)(accumulation + pixel);
+            atomic_add_float(target + 0, path.radiance.x);
+            atomic_add_float(target + 1, path.radiance.y);
+            atomic_add_float(target + 2, path.radiance.z);
+            atomic_add_float(target + 3, 1.0f);
+
+            // the guide buffers come from the first sample of each pixel
+            if (sample == 0) {
+                albedo[pixel] = (float4)(path.firstAlbedo, 1.0f);
+                normal[pixel] = (float4)(path.firstNormal, 0.0f);
+                depth[pixel] = path.firstDepth;
+            }
+        }
+    }
+
+    report_lane_steps(laneStats, groupCounters, steps);
+}
@@ -0,0 +1,99 @@
+// reproject the previous frame's accumulated radiance into the current view,
+// rejecting disoccluded history by comparing depth and normal
+
+#define FAR_DEPTH 1e30f
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+__kernel void reproject(__global float4* accumulation,
+                        __global const float4* history,
+                        __global const float4* normal,
+                        __global const float* depth,
+                        __global const float4* previousNormal,
+                        __global const float* previousDepth,
+                        uint width, uint height,
+                        float4 cameraPosition, float4 cameraForward,
+                        float4 cameraRight, float4 cameraUp,
+                        float4 previousPosition, float4 previousForward,
+                        float4 previousRight, float4 previousUp,
+                        float maxHistorySamples, float depthThreshold, float normalThreshold)
+{
+    int x = (int)get_global_id(0);
+    int y = (int)get_global_id(1);
+
+    if (x >= (int)width || y >= (int)height) {
+        return;
+    }
+
+    int index = y * (int)width + x;
+    float aspectRatio = (float)width / (float)height;
+
+    // rebuild the primary ray through the pixel center, focal lengths travel in w
+    float u = (((float)x + 0.5f) / (float)width * 2.0f - 1.0f) * aspectRatio;
+    float v = 1.0f - ((float)y + 0.5f) / (float)height * 2.0f;
+    float3 direction = normalize(cameraRight.xyz * u + cameraUp.xyz * v + cameraForward.xyz * cameraPosition.w);
+
+    float currentDepth = depth[index];
+    float3 currentNormal = normal[index].xyz;
+    bool currentMiss = currentDepth >= FAR_DEPTH * 0.5f;
+
+    // background pixels are reprojected as directions, surfaces as world positions
+    float3 relative = currentMiss ? direction : cameraPosition.xyz + direction * currentDepth - previousPosition.xyz;
+    float z = dot(relative, previousForward.xyz);
+    if (z <= 1e-4f) {
+        return;
+    }
+
+    float previousU = dot(relative, previousRight.xyz) / z * previousPosition.w;
+    float previousV = dot(relative, previousUp.xyz) / z * previousPosition.w;
+    float px = (previousU / aspectRatio + 1.0f) * 0.5f * (float)width - 0.5f;
+    float py = (1.0f - previousV) * 0.5f * (float)height - 0.5f;
+
+    float fx = floor(px);
+    float fy = floor(py);
+    int x0 = (int)fx;
+    int y0 = (int)fy;
+    float tx = px - fx;
+    float ty = py - fy;
+    float expectedDepth = length(relative);
+
+    float4 historySum = (float4)(0.0f);
+    float weightSum = 0.0f;
+
+    for (int tap = 0; tap < 4; ++tap) {
+        int sx = x0 + (tap & 1);
+        int sy = y0 + (tap >> 1);
+        if (sx < 0 || sy < 0 || sx >= (int)width || sy >= (int)height) {
+            continue;
+        }
+
+        int sampleIndex = sy * (int)width + sx;
+        float tapDepth = previousDepth[sampleIndex];
+        bool tapMiss = tapDepth >= FAR_DEPTH * 0.5f;
+        if (tapMiss != currentMiss) {
+            continue;
+        }
+        if (!currentMiss) {
+            if (fabs(tapDepth - expectedDepth) > depthThreshold * expectedDepth) {
+                continue;
+            }
+            if (dot(previousNormal[sampleIndex].xyz, currentNormal) < normalThreshold) {
+                continue;
+            }
+        }
+
+        float weight = ((tap & 1) ? tx : 1.0f - tx) * ((tap >> 1) ? ty : 1.0f - ty);
+        historySum += history[sampleIndex] * weight;
+        weightSum += weight;
+    }
+
+    if (weightSum < 1e-3f) {
+        return;
+    }
+
+    // history keeps its radiance-to-count ratio while its weight is capped
+    float4 reprojected = historySum / weightSum;
+    if (reprojected.w > maxHistorySamples) {
+        reprojected *= maxHistorySamples / reprojected.w;
+    }
+    accumulation[index] += reprojected;
+}
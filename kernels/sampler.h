@@ -0,0 +1,132 @@
+// pseudo-random and low-discrepancy sample generation shared by the integrators,
+// SOBOL_DIMENSIONS, SOBOL_BITS and BLUE_NOISE_SIZE are defined by the host (see Sampler.hpp)
+
+#ifndef CURSEDRAY_SAMPLER_H
+#define CURSEDRAY_SAMPLER_H
+
+#define SAMPLER_RANDOM 0
+#define SAMPLER_SOBOL 1
+
+// dimensions are consumed in padded 4D sets, each set gets its own index shuffle (Burley 2020)
+#define SOBOL_SET_DIMENSIONS 4
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+typedef struct
+{
+    uint type;
+    uint index;
+    uint dimension;
+    uint seed;
+    uint rngState;
+    uint x;
+    uint y;
+} SamplerState;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+uint pcg_hash(uint input)
+{
+    uint state = input * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+float random_float(uint* state)
+{
+    *state = pcg_hash(*state);
+    return (float)(*state >> 8) * (1.0f / 16777216.0f);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+uint reverse_bits(uint x)
+{
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+    x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+uint laine_karras_permutation(uint x, uint seed)
+{
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+uint nested_uniform_scramble(uint x, uint seed)
+{
+    // hash-based Owen scrambling operates on the reversed bits
+    return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+uint sobol(uint index, uint dimension, __constant uint* sobolDirections)
+{
+    uint result = 0;
+    __constant uint* directions = sobolDirections + dimension * SOBOL_BITS;
+    for (uint bit = 0; index != 0; index >>= 1, ++bit) {
+        if (index & 1u) {
+            result ^= directions[bit];
+        }
+    }
+    return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+float blue_noise(__constant uint* blueNoise, uint x, uint y)
+{
+    uint texel = (y % BLUE_NOISE_SIZE) * BLUE_NOISE_SIZE + x % BLUE_NOISE_SIZE;
+    return ((float)blueNoise[texel] + 0.5f) * (1.0f / (float)(BLUE_NOISE_SIZE * BLUE_NOISE_SIZE));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void sampler_init(SamplerState* sampler, uint type, uint x, uint y, uint width,
+                  uint sampleIndex, uint frameIndex)
+{
+    uint pixel = y * width + x;
+    sampler->type = type;
+    sampler->index = sampleIndex;
+    sampler->dimension = 0;
+    sampler->seed = pcg_hash(pixel);
+    sampler->rngState = pcg_hash(pixel ^ pcg_hash(frameIndex ^ pcg_hash(sampleIndex)));
+    sampler->x = x;
+    sampler->y = y;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+float2 sampler_next_2d(SamplerState* sampler, __constant uint* sobolDirections, __constant uint* blueNoise)
+{
+    if (sampler->type == SAMPLER_RANDOM) {
+        float u = random_float(&sampler->rngState);
+        float v = random_float(&sampler->rngState);
+        return (float2)(u, v);
+    }
+
+    uint set = sampler->dimension / SOBOL_SET_DIMENSIONS;
+    uint component = sampler->dimension % SOBOL_SET_DIMENSIONS;
+    sampler->dimension += 2;
+
+    // per-pixel decorrelation: every pixel and every set shuffles and scrambles differently
+    uint setSeed = pcg_hash(sampler->seed ^ pcg_hash(set));
+    uint shuffledIndex = nested_uniform_scramble(sampler->index, setSeed);
+    uint bitsU = nested_uniform_scramble(sobol(shuffledIndex, component, sobolDirections), pcg_hash(setSeed + component));
+    uint bitsV = nested_uniform_scramble(sobol(shuffledIndex, component + 1, sobolDirections), pcg_hash(setSeed + component + 1));
+    float2 sample = (float2)((float)(bitsU >> 8), (float)(bitsV >> 8)) * (1.0f / 16777216.0f);
+
+    // the first set is dithered with blue noise so low sample counts spread their error spatially
+    if (set == 0) {
+        float2 shift = (float2)(blue_noise(blueNoise, sampler->x + component * 17u, sampler->y + component * 31u),
+                                blue_noise(blueNoise, sampler->x + component * 17u + 23u, sampler->y + component * 31u + 41u));
+        sample += shift;
+        sample -= floor(sample);
+    }
+    return sample;
+}
+
+#endif
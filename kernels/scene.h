@@ -0,0 +1,149 @@
+// scene description and ray queries shared by the integrators, the layouts of
+// Sphere and BvhNode must match Scene.hpp and SceneBvh.hpp
+
+#ifndef CURSEDRAY_SCENE_H
+#define CURSEDRAY_SCENE_H
+
+#define PI 3.14159265358979f
+#define RAY_EPSILON 1e-3f
+#define FAR_DEPTH 1e30f
+#define BVH_NODE_LEAF 0xffffffffu
+#define BVH_STACK_SIZE 32
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+typedef struct
+{
+    float4 centerRadius;
+    float4 albedo;
+    float4 emission;    // w holds the light index of an emitter, or -1
+} Sphere;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+typedef struct
+{
+    float4 boundsMin;
+    float4 boundsMax;
+    uint leftOrSphere;  // left child of an interior node, sphere index of a leaf
+    uint right;         // right child of an interior node, BVH_NODE_LEAF for a leaf
+    uint parent;        // only walked by the host refit
+    uint padding;
+} BvhNode;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+float intersect_bounds(__global const BvhNode* node, float3 origin, float3 inverseDirection, float closest)
+{
+    // slab test, returns the entry distance or FAR_DEPTH when the box is missed or lies beyond closest
+    float3 t0 = (node->boundsMin.xyz - origin) * inverseDirection;
+    float3 t1 = (node->boundsMax.xyz - origin) * inverseDirection;
+    float3 tNear = fmin(t0, t1);
+    float3 tFar = fmax(t0, t1);
+    float entry = fmax(fmax(tNear.x, tNear.y), fmax(tNear.z, 0.0f));
+    float exit = fmin(fmin(tFar.x, tFar.y), fmin(tFar.z, closest));
+    return entry <= exit ? entry : FAR_DEPTH;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool intersect_sphere(float4 centerRadius, float3 origin, float3 direction, float* hitDistance)
+{
+    float3 oc = origin - centerRadius.xyz;
+    float b = dot(oc, direction);
+    float c = dot(oc, oc) - centerRadius.w * centerRadius.w;
+    float discriminant = b * b - c;
+    if (discriminant < 0.0f) {
+        return false;
+    }
+
+    float root = sqrt(discriminant);
+    float t = -b - root;
+    if (t < RAY_EPSILON) {
+        t = -b + root;
+    }
+    *hitDistance = t;
+    return t > RAY_EPSILON;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool intersect_scene(__global const Sphere* spheres, __global const BvhNode* nodes,
+                     float3 origin, float3 direction,
+                     float* hitDistance, uint* hitIndex)
+{
+    bool hit = false;
+    float closest = FAR_DEPTH;
+    float3 inverseDirection = 1.0f / direction;
+
+    // descend into the nearer child first, the farther one waits on the stack; the host builds
+    // the tree with a median split, so its depth stays far below the stack size
+    uint stack[BVH_STACK_SIZE];
+    uint stackSize = 0;
+    uint nodeIndex = 0;
+    for (;;) {
+        __global const BvhNode* node = nodes + nodeIndex;
+        if (node->right == BVH_NODE_LEAF) {
+            float t;
+            if (intersect_sphere(spheres[node->leftOrSphere].centerRadius, origin, direction, &t) && t < closest) {
+                closest = t;
+                *hitIndex = node->leftOrSphere;
+                hit = true;
+            }
+        }
+        else {
+            uint first = node->leftOrSphere;
+            uint second = node->right;
+            float firstEntry = intersect_bounds(nodes + first, origin, inverseDirection, closest);
+            float secondEntry = intersect_bounds(nodes + second, origin, inverseDirection, closest);
+            if (secondEntry < firstEntry) {
+                uint swapIndex = first;
+                first = second;
+                second = swapIndex;
+                float swapEntry = firstEntry;
+                firstEntry = secondEntry;
+                secondEntry = swapEntry;
+            }
+            if (firstEntry < FAR_DEPTH) {
+                if (secondEntry < FAR_DEPTH && stackSize < BVH_STACK_SIZE) {
+                    stack[stackSize++] = second;
+                }
+                nodeIndex = first;
+                continue;
+            }
+        }
+
+        if (stackSize == 0) {
+            break;
+        }
+        nodeIndex = stack[--stackSize];
+    }
+
+    *hitDistance = closest;
+    return hit;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+float3 to_world(float3 n, float3 local)
+{
+    // branchless orthonormal basis (Duff et al. 2017)
+    float sign = copysign(1.0f, n.z);
+    float a = -1.0f / (sign + n.z);
+    float b = n.x * n.y * a;
+    float3 tangent = (float3)(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+    float3 bitangent = (float3)(b, sign + n.y * n.y * a, -n.y);
+    return normalize(tangent * local.x + bitangent * local.y + n * local.z);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+float3 sample_cosine_hemisphere(float3 n, float u1, float u2)
+{
+    float r = sqrt(u1);
+    float phi = 2.0f * PI * u2;
+    return to_world(n, (float3)(r * cos(phi), r * sin(phi), sqrt(max(0.0f, 1.0f - u1))));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+float power_heuristic(float pdf, float otherPdf)
+{
+    float a = pdf * pdf;
+    float b = otherPdf * otherPdf;
+    return a + b > 0.0f ? a / (a + b) : 0.0f;
+}
+
+#endif
@@ -0,0 +1,104 @@
+// map accumulated radiance to display-referred sRGB and quantize into the framebuffer, or resolve
+// it to linear half/float pixels when the host wants HDR data; renders at a reduced internal
+// resolution are upscaled to the framebuffer on the way
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+float3 aces_film(float3 x)
+{
+    // fitted ACES curve (Narkowicz 2015)
+    float3 numerator = x * (2.51f * x + 0.03f);
+    float3 denominator = x * (2.43f * x + 0.59f) + 0.14f;
+    return clamp(numerator / denominator, 0.0f, 1.0f);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+float linear_to_srgb(float c)
+{
+    return c <= 0.0031308f ? 12.92f * c : 1.055f * pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+float3 average_radiance(float4 radiance)
+{
+    return radiance.xyz / max(radiance.w, 1.0f);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+float3 resolve_radiance(__global const float4* input, uint x, uint y,
+                        uint width, uint height, uint renderWidth, uint renderHeight)
+{
+    if (renderWidth == width && renderHeight == height) {
+        return average_radiance(input[y * width + x]);
+    }
+
+    // bilinear, every tap is averaged first since the taps may hold different sample counts
+    float u = clamp(((float)x + 0.5f) * (float)renderWidth / (float)width - 0.5f, 0.0f, (float)(renderWidth - 1));
+    float v = clamp(((float)y + 0.5f) * (float)renderHeight / (float)height - 0.5f, 0.0f, (float)(renderHeight - 1));
+    uint x0 = (uint)u;
+    uint y0 = (uint)v;
+    uint x1 = min(x0 + 1, renderWidth - 1);
+    uint y1 = min(y0 + 1, renderHeight - 1);
+    float fx = u - (float)x0;
+    float fy = v - (float)y0;
+
+    float3 top = mix(average_radiance(input[y0 * renderWidth + x0]), average_radiance(input[y0 * renderWidth + x1]), fx);
+    float3 bottom = mix(average_radiance(input[y1 * renderWidth + x0]), average_radiance(input[y1 * renderWidth + x1]), fx);
+    return mix(top, bottom, fy);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+__kernel void tonemap(__global const float4* input,
+                      __global uchar4* framebuffer,
+                      uint width, uint height,
+                      uint renderWidth, uint renderHeight)
+{
+    uint x = get_global_id(0);
+    uint y = get_global_id(1);
+
+    if (x < width && y < height) {
+        uint index = y * width + x;
+
+        float3 color = aces_film(resolve_radiance(input, x, y, width, height, renderWidth, renderHeight));
+
+        uchar red = (uchar)(linear_to_srgb(color.x) * 255.0f + 0.5f);
+        uchar green = (uchar)(linear_to_srgb(color.y) * 255.0f + 0.5f);
+        uchar blue = (uchar)(linear_to_srgb(color.z) * 255.0f + 0.5f);
+
+        framebuffer[index] = (uchar4)(red, green, blue, 255);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+__kernel void resolve_float(__global const float4* input,
+                            __global float4* framebuffer,
+                            uint width, uint height,
+                            uint renderWidth, uint renderHeight)
+{
+    uint x = get_global_id(0);
+    uint y = get_global_id(1);
+
+    if (x < width && y < height) {
+        uint index = y * width + x;
+
+        float3 radiance = resolve_radiance(input, x, y, width, height, renderWidth, renderHeight);
+        framebuffer[index] = (float4)(radiance, 1.0f);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+__kernel void resolve_half(__global const float4* input,
+                           __global half* framebuffer,
+                           uint width, uint height,
+                           uint renderWidth, uint renderHeight)
+{
+    uint x = get_global_id(0);
+    uint y = get_global_id(1);
+
+    if (x < width && y < height) {
+        uint index = y * width + x;
+
+        // vstore_half is core, no cl_khr_fp16 needed to store half data
+        float3 radiance = resolve_radiance(input, x, y, width, height, renderWidth, renderHeight);
+        vstore_half4_rte((float4)(radiance, 1.0f), index, framebuffer);
+    }
+}
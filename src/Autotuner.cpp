@@ -0,0 +1,172 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "Autotuner.hpp"
+#include "Constants.hpp"
+#include "Log.hpp"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <ios>
+#include <limits>
+#include <vector>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    /* square tiles for cache locality, wide rows for coalescing, tall strips for the denoiser's vertical taps */
+    static constexpr std::array<TileSize, 10> TILE_CANDIDATES{ {
+        { 8, 8 }, { 16, 8 }, { 8, 16 }, { 16, 16 }, { 32, 8 },
+        { 32, 4 }, { 4, 32 }, { 64, 4 }, { 64, 1 }, { 128, 1 }
+    } };
+
+    ////////////////////////////////////////
+    cl::NDRange GetLocalRange(TileSize tile)
+    {
+        if (tile.mWidth == 0 || tile.mHeight == 0) {
+            return cl::NullRange;
+        }
+        return cl::NDRange(tile.mWidth, tile.mHeight);
+    }
+
+    ////////////////////////////////////////
+    cl::NDRange GetGlobalRange(TileSize tile, std::uint32_t width, std::uint32_t height)
+    {
+        // whole groups only, the kernels discard the work items that fall outside the image
+        if (tile.mWidth == 0 || tile.mHeight == 0) {
+            return cl::NDRange(width, height);
+        }
+        std::size_t alignedWidth{ (static_cast<std::size_t>(width) + tile.mWidth - 1) / tile.mWidth * tile.mWidth };
+        std::size_t alignedHeight{ (static_cast<std::size_t>(height) + tile.mHeight - 1) / tile.mHeight * tile.mHeight };
+        return cl::NDRange(alignedWidth, alignedHeight);
+    }
+
+    ////////////////////////////////////////
+    std::uint64_t Autotuner::Hash(std::string_view text, std::uint64_t seed)
+    {
+        // FNV-1a, stable across runs and compilers unlike std::hash
+        std::uint64_t hash{ seed };
+        for (char c : text) {
+            hash ^= static_cast<std::uint8_t>(c);
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    ////////////////////////////////////////
+    Autotuner::Autotuner(const cl::Device& device, const char* cacheFile, bool retune)
+        : mDevice{ device }, mCacheFile{ cacheFile }, mIsDirty{}
+    {
+        // a driver update can change which shape wins, so it is part of the device key
+        mDeviceHash = Hash(device.getInfo<CL_DEVICE_NAME>());
+        mDeviceHash = Hash(device.getInfo<CL_DEVICE_VENDOR>(), mDeviceHash);
+        mDeviceHash = Hash(device.getInfo<CL_DEVICE_VERSION>(), mDeviceHash);
+        mDeviceHash = Hash(device.getInfo<CL_DRIVER_VERSION>(), mDeviceHash);
+
+        if (std::ifstream fp{ mCacheFile }) {
+            Key key{};
+            TileSize tile{};
+            while (fp >> std::hex >> key.first >> key.second >> std::dec >> tile.mWidth >> tile.mHeight) {
+                // entries of other devices are kept so that saving does not drop them
+                if (retune && key.first == mDeviceHash) {
+                    mIsDirty = true;
+                    continue;
+                }
+                mEntries[key] = tile;
+            }
+        }
+    }
+
+    ////////////////////////////////////////
+    double Autotuner::Benchmark(const cl::CommandQueue& queue, const cl::Kernel& kernel,
+                                const cl::NDRange& globalRange, const cl::NDRange& localRange)
+    {
+        // the first launch is a warm-up, the fastest of the others counts
+        double bestTime{ std::numeric_limits<double>::max() };
+        for (std::uint32_t run{}; run <= DEFAULT_TUNING_RUNS; ++run) {
+            cl::Event event;
+            queue.enqueueNDRangeKernel(kernel, cl::NullRange, globalRange, localRange, nullptr, &event);
+            event.wait();
+            if (run > 0) {
+                cl_ulong hwBegin{ event.getProfilingInfo<CL_PROFILING_COMMAND_START>() };
+                cl_ulong hwEnd{ event.getProfilingInfo<CL_PROFILING_COMMAND_END>() };
+                bestTime = std::min(bestTime, static_cast<double>(hwEnd - hwBegin));
+            }
+        }
+        return bestTime;
+    }
+
+    ////////////////////////////////////////
+    TileSize Autotuner::Tune(const cl::CommandQueue& queue, const cl::Kernel& kernel, std::uint64_t kernelHash,
+                             const char* kernelName, std::uint32_t width, std::uint32_t height)
+    {
+        Key key{ mDeviceHash, Hash(kernelName, kernelHash) };
+        auto entry{ mEntries.find(key) };
+        if (entry != mEntries.end()) {
+            return entry->second;
+        }
+
+        std::size_t maxGroupSize{ kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(mDevice) };
+        std::vector<std::size_t> maxItemSizes{ mDevice.getInfo<CL_DEVICE_MAX_WORK_ITEM_SIZES>() };
+
+        TileSize bestTile{};
+        double driverTime{ Benchmark(queue, kernel, GetGlobalRange(bestTile, width, height), GetLocalRange(bestTile)) };
+        double bestTime{ driverTime };
+        for (TileSize tile : TILE_CANDIDATES) {
+            bool fitsGroup{ static_cast<std::size_t>(tile.mWidth) * tile.mHeight <= maxGroupSize };
+            bool fitsItems{ maxItemSizes.size() < 2 || (tile.mWidth <= maxItemSizes[0] && tile.mHeight <= maxItemSizes[1]) };
+            if (!fitsGroup || !fitsItems) {
+                continue;
+            }
+            try {
+                double time{ Benchmark(queue, kernel, GetGlobalRange(tile, width, height), GetLocalRange(tile)) };
+                if (time < bestTime) {
+                    bestTime = time;
+                    bestTile = tile;
+                }
+            }
+            catch (const cl::Error&) {
+                // register or local memory pressure can reject a shape the size queries allowed
+                continue;
+            }
+        }
+
+        mEntries[key] = bestTile;
+        mIsDirty = true;
+        Log("CursedRay: tuned %s to %ux%u, %f against %f milliseconds for the driver's choice",
+            kernelName, bestTile.mWidth, bestTile.mHeight, bestTime * 1e-6, driverTime * 1e-6);
+        return bestTile;
+    }
+
+    ////////////////////////////////////////
+    void Autotuner::Save()
+    {
+        if (!mIsDirty) {
+            return;
+        }
+        std::ofstream fp{ mCacheFile, std::ios::trunc };
+        if (!fp) {
+            Log("CursedRay: could not write the tuning cache %s", mCacheFile.c_str());
+            return;
+        }
+        for (const auto& [key, tile] : mEntries) {
+            fp << std::hex << key.first << ' ' << key.second << ' '
+               << std::dec << tile.mWidth << ' ' << tile.mHeight << '\n';
+        }
+        mIsDirty = false;
+    }
+}
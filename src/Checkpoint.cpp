@@ -0,0 +1,244 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "Checkpoint.hpp"
+#include "Autotuner.hpp"
+#include "Camera.hpp"
+#include "Log.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    constexpr std::uint32_t CHECKPOINT_MAGIC{ 0x50434352 };       /* "RCCP" */
+    constexpr std::uint32_t CHECKPOINT_VERSION{ 3 };
+    constexpr std::size_t CHECKPOINT_HEADER_STRIDE{ 256 };
+    constexpr std::uint32_t CHECKPOINT_NUM_SLOTS{ 2 };
+
+    ////////////////////////////////////////
+    static_assert(sizeof(CheckpointHeader) <= CHECKPOINT_HEADER_STRIDE, "CheckpointHeader must fit in its stride");
+
+    ////////////////////////////////////////
+    CheckpointHeader MakeCheckpointHeader(const HWDeviceOptions& options, SceneType sceneType, const Camera& camera,
+                                          const glm::vec4& clearColor,
+                                          std::uint32_t environmentWidth, std::uint32_t environmentHeight,
+                                          std::uint32_t width, std::uint32_t height,
+                                          std::uint32_t sampleIndex, std::uint32_t frameIndex)
+    {
+        CheckpointHeader header{};
+        header.mMagic = CHECKPOINT_MAGIC;
+        header.mVersion = CHECKPOINT_VERSION;
+        header.mWidth = width;
+        header.mHeight = height;
+        header.mSampleIndex = sampleIndex;
+        header.mFrameIndex = frameIndex;
+        header.mSamplesPerPixel = options.mSamplesPerPixel;
+        header.mMaxDepth = options.mMaxDepth;
+        header.mRouletteDepth = options.mRouletteDepth;
+        header.mNextEventEstimation = options.mNextEventEstimation;
+        header.mSampler = static_cast<std::uint32_t>(options.mSampler);
+        header.mIntegrator = static_cast<std::uint32_t>(options.mIntegrator);
+        header.mSceneType = static_cast<std::uint32_t>(sceneType);
+        header.mCameraPosition[0] = camera.GetPosition().x;
+        header.mCameraPosition[1] = camera.GetPosition().y;
+        header.mCameraPosition[2] = camera.GetPosition().z;
+        header.mFocalLength = camera.GetFocalLength();
+        header.mYaw = camera.GetYaw();
+        header.mPitch = camera.GetPitch();
+        header.mClearColor[0] = clearColor.r;
+        header.mClearColor[1] = clearColor.g;
+        header.mClearColor[2] = clearColor.b;
+        header.mClearColor[3] = clearColor.a;
+        header.mEnvironmentHash = options.mEnvironmentFile.empty() ? 0 : Autotuner::Hash(options.mEnvironmentFile);
+        header.mEnvironmentWidth = environmentWidth;
+        header.mEnvironmentHeight = environmentHeight;
+        return header;
+    }
+
+    ////////////////////////////////////////
+    bool IsCheckpointCompatible(const CheckpointHeader& checkpoint, const CheckpointHeader& expected)
+    {
+        // the camera and sampler position are restored from the checkpoint, everything else has to match
+        return checkpoint.mWidth == expected.mWidth &&
+               checkpoint.mHeight == expected.mHeight &&
+               checkpoint.mSamplesPerPixel == expected.mSamplesPerPixel &&
+               checkpoint.mMaxDepth == expected.mMaxDepth &&
+               checkpoint.mRouletteDepth == expected.mRouletteDepth &&
+               checkpoint.mNextEventEstimation == expected.mNextEventEstimation &&
+               checkpoint.mSampler == expected.mSampler &&
+               checkpoint.mIntegrator == expected.mIntegrator &&
+               checkpoint.mSceneType == expected.mSceneType &&
+               std::memcmp(checkpoint.mClearColor, expected.mClearColor, sizeof(checkpoint.mClearColor)) == 0 &&
+               checkpoint.mEnvironmentHash == expected.mEnvironmentHash &&
+               checkpoint.mEnvironmentWidth == expected.mEnvironmentWidth &&
+               checkpoint.mEnvironmentHeight == expected.mEnvironmentHeight;
+    }
+
+    ////////////////////////////////////////
+    Checkpoint::Checkpoint(const char* url, std::uint32_t width, std::uint32_t height)
+        : mFile{ -1 }, mData{}, mSize{}, mNumPixels{ static_cast<std::size_t>(width) * height },
+          mSequence{}, mPendingSlot{}, mPendingHeader{}, mIsPending{}
+    {
+        mSize = CHECKPOINT_NUM_SLOTS * GetSlotOffset(1);
+        mFile = ::open(url, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (mFile < 0) {
+            Log("CursedRay: could not open checkpoint %s: %s", url, std::strerror(errno));
+            return;
+        }
+
+        // a file of another size belongs to another resolution, its slots will not validate
+        struct stat fileInfo{};
+        bool isSized{ ::fstat(mFile, &fileInfo) == 0 && static_cast<std::size_t>(fileInfo.st_size) == mSize };
+        if (!isSized && ::ftruncate(mFile, static_cast<off_t>(mSize)) != 0) {
+            Log("CursedRay: could not resize checkpoint %s: %s", url, std::strerror(errno));
+            return;
+        }
+
+        void* data{ ::mmap(nullptr, mSize, PROT_READ | PROT_WRITE, MAP_SHARED, mFile, 0) };
+        if (data == MAP_FAILED) {
+            Log("CursedRay: could not map checkpoint %s: %s", url, std::strerror(errno));
+            return;
+        }
+        mData = static_cast<std::uint8_t*>(data);
+
+        // continue the sequence so new checkpoints always win over the ones already on disk
+        if (const CheckpointHeader* latest{ FindLatest() }) {
+            mSequence = latest->mSequence;
+            mPendingSlot = latest == &GetHeader(0) ? 1 : 0;
+        }
+    }
+
+    ////////////////////////////////////////
+    Checkpoint::~Checkpoint()
+    {
+        Poll(true);
+        if (mData != nullptr) {
+            ::msync(mData, mSize, MS_SYNC);
+            ::munmap(mData, mSize);
+        }
+        if (mFile >= 0) {
+            ::close(mFile);
+        }
+    }
+
+    ////////////////////////////////////////
+    std::size_t Checkpoint::GetSlotOffset(std::uint32_t slot) const
+    {
+        return slot * (CHECKPOINT_HEADER_STRIDE + mNumPixels * sizeof(glm::vec4));
+    }
+
+    ////////////////////////////////////////
+    CheckpointHeader& Checkpoint::GetHeader(std::uint32_t slot) const
+    {
+        return *reinterpret_cast<CheckpointHeader*>(mData + GetSlotOffset(slot));
+    }
+
+    ////////////////////////////////////////
+    const CheckpointHeader* Checkpoint::FindLatest() const
+    {
+        if (mData == nullptr) {
+            return nullptr;
+        }
+
+        const CheckpointHeader* latest{};
+        for (std::uint32_t slot{}; slot < CHECKPOINT_NUM_SLOTS; ++slot) {
+            const CheckpointHeader& header{ GetHeader(slot) };
+            bool isValid{ header.mMagic == CHECKPOINT_MAGIC && header.mVersion == CHECKPOINT_VERSION &&
+                          header.mSequence > 0 && static_cast<std::size_t>(header.mWidth) * header.mHeight == mNumPixels };
+            if (isValid && (latest == nullptr || header.mSequence > latest->mSequence)) {
+                latest = &header;
+            }
+        }
+        return latest;
+    }
+
+    ////////////////////////////////////////
+    const glm::vec4* Checkpoint::GetPixels(const CheckpointHeader& header) const
+    {
+        return reinterpret_cast<const glm::vec4*>(reinterpret_cast<const std::uint8_t*>(&header) + CHECKPOINT_HEADER_STRIDE);
+    }
+
+    ////////////////////////////////////////
+    glm::vec4* Checkpoint::BeginWrite(const CheckpointHeader& header)
+    {
+        // one write at a time, a slow readback simply delays the next checkpoint
+        if (mData == nullptr || mIsPending) {
+            return nullptr;
+        }
+
+        CheckpointHeader& slotHeader{ GetHeader(mPendingSlot) };
+        slotHeader.mSequence = 0;
+        mPendingHeader = header;
+        mIsPending = true;
+        return reinterpret_cast<glm::vec4*>(mData + GetSlotOffset(mPendingSlot) + CHECKPOINT_HEADER_STRIDE);
+    }
+
+    ////////////////////////////////////////
+    void Checkpoint::EndWrite(const std::vector<cl::Event>& events)
+    {
+        mPendingEvents = events;
+    }
+
+    ////////////////////////////////////////
+    bool Checkpoint::Poll(bool wait)
+    {
+        if (!mIsPending) {
+            return false;
+        }
+
+        try {
+            if (wait) {
+                cl::Event::waitForEvents(mPendingEvents);
+            }
+            for (const cl::Event& event : mPendingEvents) {
+                cl_int status{ event.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>() };
+                if (status < 0) {
+                    // a failed readback leaves the slot unstamped, the other one still holds the previous checkpoint
+                    Log("CursedRay: checkpoint readback failed with status %d", status);
+                    mPendingEvents.clear();
+                    mIsPending = false;
+                    return false;
+                }
+                if (status != CL_COMPLETE) {
+                    return false;
+                }
+            }
+        }
+        catch (const cl::Error& err) {
+            Log("CursedRay: OpenCL Error: %s", err.what());
+            mPendingEvents.clear();
+            mIsPending = false;
+            return false;
+        }
+
+        // the pixels are in place, stamping the header is what makes the slot count
+        mPendingHeader.mSequence = ++mSequence;
+        std::memcpy(&GetHeader(mPendingSlot), &mPendingHeader, sizeof(mPendingHeader));
+        ::msync(mData, mSize, MS_ASYNC);
+
+        mPendingSlot = (mPendingSlot + 1) % CHECKPOINT_NUM_SLOTS;
+        mPendingEvents.clear();
+        mIsPending = false;
+        return true;
+    }
+}
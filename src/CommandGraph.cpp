@@ -0,0 +1,221 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "CommandGraph.hpp"
+#include "Log.hpp"
+
+#include <sstream>
+#include <string>
+#include <utility>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    static bool HasExtension(const cl::Device& device, const char* name)
+    {
+        std::istringstream extensions{ device.getInfo<CL_DEVICE_EXTENSIONS>() };
+        for (std::string extension; extensions >> extension;) {
+            if (extension == name) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    ////////////////////////////////////////
+    template <typename Function>
+    static Function GetExtensionFunction(cl_platform_id platform, const char* name)
+    {
+        return reinterpret_cast<Function>(clGetExtensionFunctionAddressForPlatform(platform, name));
+    }
+
+    ////////////////////////////////////////
+    CommandGraph::CommandGraph()
+        : mDispatch{}, mCommandBuffer{}, mLastSyncPoint{}, mIsFinalized{}
+    {
+    }
+
+    ////////////////////////////////////////
+    CommandGraph::CommandGraph(const cl::CommandQueue& queue, const cl::Device& device)
+        : mCmdQueue{ queue }, mDispatch{}, mCommandBuffer{}, mLastSyncPoint{}, mIsFinalized{}
+    {
+        if (!HasExtension(device, "cl_khr_command_buffer")) {
+            return;
+        }
+
+        cl_platform_id platform{ device.getInfo<CL_DEVICE_PLATFORM>() };
+        mDispatch.mCreate = GetExtensionFunction<clCreateCommandBufferKHR_fn>(platform, "clCreateCommandBufferKHR");
+        mDispatch.mFinalize = GetExtensionFunction<clFinalizeCommandBufferKHR_fn>(platform, "clFinalizeCommandBufferKHR");
+        mDispatch.mRelease = GetExtensionFunction<clReleaseCommandBufferKHR_fn>(platform, "clReleaseCommandBufferKHR");
+        mDispatch.mEnqueue = GetExtensionFunction<clEnqueueCommandBufferKHR_fn>(platform, "clEnqueueCommandBufferKHR");
+        mDispatch.mNDRangeKernel = GetExtensionFunction<clCommandNDRangeKernelKHR_fn>(platform, "clCommandNDRangeKernelKHR");
+        mDispatch.mCopyBuffer = GetExtensionFunction<clCommandCopyBufferKHR_fn>(platform, "clCommandCopyBufferKHR");
+        if (!mDispatch.mCreate || !mDispatch.mFinalize || !mDispatch.mRelease ||
+            !mDispatch.mEnqueue || !mDispatch.mNDRangeKernel || !mDispatch.mCopyBuffer) {
+            return;
+        }
+
+        // creation fails when the queue has properties the device can't record with, e.g. profiling
+        cl_command_queue rawQueue{ mCmdQueue() };
+        cl_int status{ CL_SUCCESS };
+        cl_command_buffer_khr commandBuffer{ mDispatch.mCreate(1, &rawQueue, nullptr, &status) };
+        if (status == CL_SUCCESS) {
+            mCommandBuffer = commandBuffer;
+        }
+        else {
+            Log("CursedRay: cl_khr_command_buffer is unusable on this queue (%d), replaying from the host", status);
+        }
+    }
+
+    ////////////////////////////////////////
+    CommandGraph::~CommandGraph()
+    {
+        Release();
+    }
+
+    ////////////////////////////////////////
+    CommandGraph::CommandGraph(CommandGraph&& other) noexcept
+        : mCmdQueue{ std::move(other.mCmdQueue) }, mCommands{ std::move(other.mCommands) },
+          mDispatch{ other.mDispatch }, mCommandBuffer{ std::exchange(other.mCommandBuffer, nullptr) },
+          mLastSyncPoint{ other.mLastSyncPoint }, mIsFinalized{ other.mIsFinalized }
+    {
+    }
+
+    ////////////////////////////////////////
+    CommandGraph& CommandGraph::operator=(CommandGraph&& other) noexcept
+    {
+        if (this != &other) {
+            Release();
+            mCmdQueue = std::move(other.mCmdQueue);
+            mCommands = std::move(other.mCommands);
+            mDispatch = other.mDispatch;
+            mCommandBuffer = std::exchange(other.mCommandBuffer, nullptr);
+            mLastSyncPoint = other.mLastSyncPoint;
+            mIsFinalized = other.mIsFinalized;
+        }
+        return *this;
+    }
+
+    ////////////////////////////////////////
+    void CommandGraph::Release()
+    {
+        if (mCommandBuffer) {
+            mDispatch.mRelease(mCommandBuffer);
+            mCommandBuffer = nullptr;
+        }
+    }
+
+    ////////////////////////////////////////
+    void CommandGraph::RecordKernel(const cl::Kernel& kernel, const cl::NDRange& global, const cl::NDRange& local)
+    {
+        mCommands.push_back({ kernel, global, local, {}, {}, 0 });
+        if (!mCommandBuffer) {
+            return;
+        }
+
+        // commands in a command buffer are only ordered through sync points, chain them in recording order
+        bool isFirst{ mCommands.size() == 1 };
+        cl_sync_point_khr syncPoint{};
+        cl_int status{ mDispatch.mNDRangeKernel(mCommandBuffer, nullptr, nullptr, kernel(),
+                                                static_cast<cl_uint>(global.dimensions()), nullptr, global.get(),
+                                                local.dimensions() > 0 ? local.get() : nullptr,
+                                                isFirst ? 0 : 1, isFirst ? nullptr : &mLastSyncPoint,
+                                                &syncPoint, nullptr) };
+        if (status != CL_SUCCESS) {
+            Log("CursedRay: failed to record a kernel into the command buffer (%d), replaying from the host", status);
+            Release();
+            return;
+        }
+        mLastSyncPoint = syncPoint;
+    }
+
+    ////////////////////////////////////////
+    void CommandGraph::RecordCopy(const cl::Buffer& source, const cl::Buffer& destination, std::size_t size)
+    {
+        mCommands.push_back({ {}, cl::NullRange, cl::NullRange, source, destination, size });
+        if (!mCommandBuffer) {
+            return;
+        }
+
+        bool isFirst{ mCommands.size() == 1 };
+        cl_sync_point_khr syncPoint{};
+        cl_int status{ mDispatch.mCopyBuffer(mCommandBuffer, nullptr,
+#if defined(CL_KHR_COMMAND_BUFFER_EXTENSION_VERSION) && CL_KHR_COMMAND_BUFFER_EXTENSION_VERSION >= CL_MAKE_VERSION(0, 9, 5)
+                                             nullptr,
+#endif
+                                             source(), destination(), 0, 0, size,
+                                             isFirst ? 0 : 1, isFirst ? nullptr : &mLastSyncPoint,
+                                             &syncPoint, nullptr) };
+        if (status != CL_SUCCESS) {
+            Log("CursedRay: failed to record a copy into the command buffer (%d), replaying from the host", status);
+            Release();
+            return;
+        }
+        mLastSyncPoint = syncPoint;
+    }
+
+    ////////////////////////////////////////
+    void CommandGraph::Finalize()
+    {
+        if (mCommandBuffer) {
+            cl_int status{ mDispatch.mFinalize(mCommandBuffer) };
+            if (status != CL_SUCCESS) {
+                Log("CursedRay: failed to finalize the command buffer (%d), replaying from the host", status);
+                Release();
+            }
+        }
+        mIsFinalized = true;
+    }
+
+    ////////////////////////////////////////
+    std::vector<cl::Event> CommandGraph::Enqueue(const std::vector<cl::Event>& events)
+    {
+        if (mCommandBuffer) {
+            std::vector<cl_event> waitList;
+            for (const cl::Event& event : events) {
+                waitList.push_back(event());
+            }
+
+            cl_event rawEvent{};
+            cl_int status{ mDispatch.mEnqueue(0, nullptr, mCommandBuffer,
+                                              static_cast<cl_uint>(waitList.size()),
+                                              waitList.empty() ? nullptr : waitList.data(),
+                                              &rawEvent) };
+            if (status == CL_SUCCESS) {
+                return { cl::Event(rawEvent) };
+            }
+            // a buffer the queue rejected once is not tried again, the graph replays from the host from now on
+            Log("CursedRay: failed to enqueue the command buffer (%d), replaying from the host", status);
+            Release();
+        }
+
+        // host replay: the kernels already hold their arguments, only the launches are issued again
+        std::vector<cl::Event> commandEvents;
+        std::vector<cl::Event> waitList{ events };
+        for (const Command& command : mCommands) {
+            cl::Event event;
+            if (command.mKernel()) {
+                mCmdQueue.enqueueNDRangeKernel(command.mKernel, cl::NullRange, command.mGlobal, command.mLocal, &waitList, &event);
+            }
+            else {
+                mCmdQueue.enqueueCopyBuffer(command.mSource, command.mDestination, 0, 0, command.mSize, &waitList, &event);
+            }
+            waitList = { event };
+            commandEvents.push_back(event);
+        }
+        return commandEvents;
+    }
+}
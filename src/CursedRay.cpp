@@ -17,33 +17,550 @@
 #include "NCDevice.hpp"
 #include "HWDevice.hpp"
 #include "Framebuffer.hpp"
+#include "Camera.hpp"
+#include "Scene.hpp"
+#include "RenderFarm.hpp"
+#include "Checkpoint.hpp"
+#include "ImageEncoder.hpp"
+#include "ResolutionController.hpp"
+#include "FramePublisher.hpp"
+#include "Metrics.hpp"
+#include "Presenter.hpp"
+#include "TiledRenderer.hpp"
 #include "Log.hpp"
 
 #include <glm/common.hpp>
+#include <notcurses/nckeys.h>
 
 #include <random>
 #include <cstdio>
 #include <algorithm>
 #include <cstdlib>
 #include <cmath>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <numbers>
+#include <utility>
+#include <vector>
+
+////////////////////////////////////////
+static bool HandleInput(CursedRay::NCDevice& ncDevice, CursedRay::Camera& camera)
+{
+    constexpr float move{ CursedRay::DEFAULT_CAMERA_MOVE_SPEED };
+    constexpr float turn{ CursedRay::DEFAULT_CAMERA_TURN_SPEED };
+
+    ncinput input;
+    for (std::uint32_t key{ ncDevice.PollInput(input) }; key != 0; key = ncDevice.PollInput(input)) {
+        if (input.evtype == NCTYPE_RELEASE) {
+            continue;
+        }
+        switch (key) {
+            case NCKEY_ESC:
+                return false;
+            case 'w':
+                camera.Translate(glm::vec3(0.0f, 0.0f, move));
+                break;
+            case 's':
+                camera.Translate(glm::vec3(0.0f, 0.0f, -move));
+                break;
+            case 'a':
+                camera.Translate(glm::vec3(-move, 0.0f, 0.0f));
+                break;
+            case 'd':
+                camera.Translate(glm::vec3(move, 0.0f, 0.0f));
+                break;
+            case 'q':
+                camera.Translate(glm::vec3(0.0f, -move, 0.0f));
+                break;
+            case 'e':
+                camera.Translate(glm::vec3(0.0f, move, 0.0f));
+                break;
+            case NCKEY_LEFT:
+                camera.Rotate(turn, 0.0f);
+                break;
+            case NCKEY_RIGHT:
+                camera.Rotate(-turn, 0.0f);
+                break;
+            case NCKEY_UP:
+                camera.Rotate(0.0f, turn);
+                break;
+            case NCKEY_DOWN:
+                camera.Rotate(0.0f, -turn);
+                break;
+            case 'h':
+                ncDevice.ToggleHud();
+                break;
+            default:
+                break;
+        }
+    }
+    return true;
+}
+
+////////////////////////////////////////
+static bool WriteCheckpoint(CursedRay::Checkpoint& checkpoint,
+                            CursedRay::HWDevice& hwDevice,
+                            const CursedRay::NCDeviceOptions& ncDeviceOptions,
+                            const CursedRay::DisplayFramebuffer& framebuffer,
+                            const CursedRay::Camera& camera)
+{
+    // sampler state is taken at submission, it matches the accumulation the read will see
+    CursedRay::CheckpointHeader header{ CursedRay::MakeCheckpointHeader(ncDeviceOptions.GetHWDeviceOptions(),
+                                                                        ncDeviceOptions.GetSceneType(),
+                                                                        camera,
+                                                                        ncDeviceOptions.ClearColor(),
+                                                                        hwDevice.GetEnvironmentWidth(),
+                                                                        hwDevice.GetEnvironmentHeight(),
+                                                                        framebuffer.GetWidth(),
+                                                                        framebuffer.GetHeight(),
+                                                                        hwDevice.GetSampleIndex(),
+                                                                        hwDevice.GetFrameIndex()) };
+    glm::vec4* pixels{ checkpoint.BeginWrite(header) };
+    if (pixels == nullptr) {
+        return false;
+    }
+    checkpoint.EndWrite(hwDevice.EnqueueReadAccumulation(pixels));
+    return true;
+}
+
+////////////////////////////////////////
+static void ResumeCheckpoint(const CursedRay::Checkpoint& checkpoint,
+                             CursedRay::HWDevice& hwDevice,
+                             const CursedRay::NCDeviceOptions& ncDeviceOptions,
+                             const CursedRay::DisplayFramebuffer& framebuffer,
+                             CursedRay::Camera& camera)
+{
+    CursedRay::CheckpointHeader expected{ CursedRay::MakeCheckpointHeader(ncDeviceOptions.GetHWDeviceOptions(),
+                                                                          ncDeviceOptions.GetSceneType(),
+                                                                          camera,
+                                                                          ncDeviceOptions.ClearColor(),
+                                                                          hwDevice.GetEnvironmentWidth(),
+                                                                          hwDevice.GetEnvironmentHeight(),
+                                                                          framebuffer.GetWidth(),
+                                                                          framebuffer.GetHeight(),
+                                                                          0, 0) };
+    const CursedRay::CheckpointHeader* latest{ checkpoint.FindLatest() };
+    if (latest == nullptr || !CursedRay::IsCheckpointCompatible(*latest, expected)) {
+        CursedRay::Log("CursedRay: no checkpoint matching the current options and resolution, starting over");
+        return;
+    }
+
+    hwDevice.WriteAccumulation(checkpoint.GetPixels(*latest));
+    hwDevice.SetSamplerState(latest->mSampleIndex, latest->mFrameIndex);
+    camera = CursedRay::Camera(glm::vec3(latest->mCameraPosition[0], latest->mCameraPosition[1], latest->mCameraPosition[2]),
+                               latest->mFocalLength, latest->mYaw, latest->mPitch);
+    CursedRay::Log("CursedRay: resumed checkpoint %u at sample %u", latest->mSequence, latest->mSampleIndex);
+}
+
+////////////////////////////////////////
+/* a submitted frame's events, kept until it is presented so that its stages can be profiled */
+struct FrameRecord
+{
+    std::vector<cl::Event> mTraceEvents;
+    std::vector<cl::Event> mReprojectEvents;
+    std::vector<cl::Event> mResolveEvents;
+    std::uint64_t mNumRays;
+};
+
+////////////////////////////////////////
+static void PublishFrameMetrics(const CursedRay::HWDevice& hwDevice, const FrameRecord& record)
+{
+    double traceTime{ hwDevice.Profile(record.mTraceEvents) };
+    CursedRay::PublishMetric(CursedRay::Metric::PathTraceTime, traceTime * 1e-6);
+    if (!record.mReprojectEvents.empty()) {
+        CursedRay::PublishMetric(CursedRay::Metric::ReprojectTime, hwDevice.Profile(record.mReprojectEvents) * 1e-6);
+    }
+    CursedRay::PublishMetric(CursedRay::Metric::ResolveTime, hwDevice.Profile(record.mResolveEvents) * 1e-6);
+    if (traceTime > 0.0) {
+        // the trace time is in nanoseconds, rays per nanosecond times a thousand are millions per second
+        CursedRay::PublishMetric(CursedRay::Metric::RaysPerSecond, static_cast<double>(record.mNumRays) / traceTime * 1e3);
+    }
+}
+
+////////////////////////////////////////
+static void PublishFrame(CursedRay::FramePublisher& publisher, CursedRay::HWDevice& hwDevice)
+{
+    // stamps whatever earlier frames have landed, then hands the newest resolve to the device
+    publisher.Poll();
+    void* pixels{ publisher.BeginWrite(hwDevice.GetSampleIndex()) };
+    if (pixels != nullptr) {
+        publisher.EndWrite(hwDevice.EnqueueReadFramebuffer(pixels));
+    }
+}
+
+////////////////////////////////////////
+static std::unique_ptr<CursedRay::FramePublisher> CreatePublisher(const CursedRay::NCDeviceOptions& ncDeviceOptions,
+                                                                  const CursedRay::DisplayFramebuffer& framebuffer)
+{
+    if (ncDeviceOptions.GetPublishName().empty()) {
+        return {};
+    }
+    return std::make_unique<CursedRay::FramePublisher>(ncDeviceOptions.GetPublishName().c_str(),
+                                                       framebuffer.GetWidth(),
+                                                       framebuffer.GetHeight(),
+                                                       ncDeviceOptions.GetHWDeviceOptions().mFramebufferFormat,
+                                                       CursedRay::DEFAULT_PUBLISH_SLOTS);
+}
+
+////////////////////////////////////////
+static void RunFarm(const CursedRay::NCDeviceOptions& ncDeviceOptions,
+                    CursedRay::NCDevice& ncDevice,
+                    CursedRay::DisplayFramebuffer& framebuffer,
+                    int argc, char** argv)
+{
+    const char* address{ ncDeviceOptions.GetFarmAddress().c_str() };
+    CursedRay::FarmCoordinator coordinator(address,
+                                           framebuffer.GetWidth(),
+                                           framebuffer.GetHeight(),
+                                           ncDeviceOptions.GetSceneType(),
+                                           ncDeviceOptions.GetHWDeviceOptions().mSamplesPerPixel);
+    if (!coordinator.IsListening()) {
+        return;
+    }
+    coordinator.SpawnWorkers(ncDeviceOptions.GetFarmWorkers(), address, argc, argv);
+
+    // the coordinator needs no OpenCL device, merged radiance is tonemapped on the host
+    CursedRay::HDRFramebuffer hdrFramebuffer(CursedRay::FramebufferOptions(framebuffer.GetWidth(), framebuffer.GetHeight(), glm::vec4(0.0f)));
+    CursedRay::Camera camera(CursedRay::DEFAULT_CAMERA_POSITION, CursedRay::DEFAULT_CAMERA_FOCAL_LENGTH);
+    while (HandleInput(ncDevice, camera)) {
+        coordinator.SetView(camera, ncDeviceOptions.ClearColor());
+        if (coordinator.Poll(CursedRay::DEFAULT_FARM_POLL_TIMEOUT)) {
+            coordinator.Resolve(hdrFramebuffer);
+            CursedRay::ToneMapFramebuffer(hdrFramebuffer, framebuffer);
+            ncDevice.Blit(framebuffer);
+        }
+    }
+
+    CursedRay::Log("CursedRay: render farm merged %u samples per pixel from %zu workers",
+                   coordinator.GetMergedSamples(), coordinator.GetNumWorkers());
+    if (!ncDeviceOptions.GetHDROutputFile().empty()) {
+        coordinator.Resolve(hdrFramebuffer);
+        CursedRay::SaveFramebufferPFM(ncDeviceOptions.GetHDROutputFile().c_str(), hdrFramebuffer);
+    }
+}
+
+////////////////////////////////////////
+static std::string GetSequenceFileName(const std::string& pattern, std::uint32_t frame)
+{
+    // the last run of '#' becomes the zero-padded frame number, without one it goes before the extension
+    std::string number{ std::to_string(frame) };
+    std::size_t last{ pattern.find_last_of('#') };
+    if (last == std::string::npos) {
+        std::size_t extension{ pattern.rfind('.') };
+        return pattern.substr(0, extension) + '_' + number + pattern.substr(extension);
+    }
+    std::size_t first{ pattern.find_last_not_of('#', last) };
+    first = first == std::string::npos ? 0 : first + 1;
+    std::size_t width{ last - first + 1 };
+    if (number.size() < width) {
+        number.insert(0, width - number.size(), '0');
+    }
+    return pattern.substr(0, first) + number + pattern.substr(last + 1);
+}
+
+////////////////////////////////////////
+static CursedRay::Camera GetTurntableCamera(std::uint32_t frame, std::uint32_t numFrames)
+{
+    // orbit the scene center at the distance of the default camera, always facing it
+    glm::vec3 offset{ CursedRay::DEFAULT_CAMERA_POSITION - CursedRay::DEFAULT_TURNTABLE_CENTER };
+    float radius{ std::hypot(offset.x, offset.z) };
+    float yaw{ 2.0f * std::numbers::pi_v<float> * static_cast<float>(frame) / static_cast<float>(numFrames) };
+    glm::vec3 position(CursedRay::DEFAULT_TURNTABLE_CENTER.x + std::sin(yaw) * radius,
+                       CursedRay::DEFAULT_CAMERA_POSITION.y,
+                       CursedRay::DEFAULT_TURNTABLE_CENTER.z + std::cos(yaw) * radius);
+    return CursedRay::Camera(position, CursedRay::DEFAULT_CAMERA_FOCAL_LENGTH, yaw);
+}
+
+////////////////////////////////////////
+static void RunSequence(const CursedRay::NCDeviceOptions& ncDeviceOptions)
+{
+    const std::string& pattern{ ncDeviceOptions.GetOutputPattern() };
+    CursedRay::ImageFormat format{};
+    CursedRay::GetImageFormat(pattern, format);
+
+    CursedRay::FramebufferOptions framebufferOptions(ncDeviceOptions.GetResolutionWidth(),
+                                                     ncDeviceOptions.GetResolutionHeight(),
+                                                     ncDeviceOptions.ClearColor());
+    CursedRay::DisplayFramebuffer framebuffer(framebufferOptions);
+    CursedRay::Scene scene(ncDeviceOptions.GetSceneType());
+
+    // one device stays warm for the whole sequence, kernels and scene buffers are set up once
+    CursedRay::HWDeviceOptions hwDeviceOptions{ ncDeviceOptions.GetHWDeviceOptions() };
+    CursedRay::HWDevice hwDevice(framebuffer, scene, hwDeviceOptions);
+    std::unique_ptr<CursedRay::FramePublisher> publisher{ CreatePublisher(ncDeviceOptions, framebuffer) };
+
+    // encoding runs on its own threads so the main thread only waits on the device, or on encoders
+    // that fall behind: every queued frame holds a framebuffer copy, so the queue is bounded
+    std::size_t numEncoders{ std::clamp<std::size_t>(std::thread::hardware_concurrency() / 2, 1, CursedRay::DEFAULT_MAX_ENCODER_THREADS) };
+    CursedRay::EncoderPool encoders(numEncoders, numEncoders);
+    std::uint32_t numEncoded{};
+    auto encodeFrame = [&]() {
+        std::string url{ GetSequenceFileName(pattern, numEncoded++) };
+        switch (format) {
+            case CursedRay::ImageFormat::PNG:
+                encoders.Submit([url, image = framebuffer]() { CursedRay::SaveFramebufferPNG(url.c_str(), image); });
+                break;
+            case CursedRay::ImageFormat::QOI:
+                encoders.Submit([url, image = framebuffer]() { CursedRay::SaveFramebufferQOI(url.c_str(), image); });
+                break;
+            case CursedRay::ImageFormat::EXR:
+                encoders.Submit([url, image = hwDevice.GetHDRFramebuffer()]() { CursedRay::SaveFramebufferEXR(url.c_str(), image); });
+                break;
+        }
+    };
+
+    std::uint32_t numFrames{ ncDeviceOptions.GetSequenceFrames() };
+    std::uint32_t samplesPerPixel{ hwDeviceOptions.mSamplesPerPixel };
+    std::uint32_t numPasses{ (ncDeviceOptions.GetSequenceSamples() + samplesPerPixel - 1) / samplesPerPixel };
+    auto begin{ std::chrono::steady_clock::now() };
+    for (std::uint32_t frame{}; frame < numFrames; ++frame) {
+        // the camera goes out as kernel arguments, so frame N+1 is queued while frame N still traces
+        CursedRay::Camera camera{ GetTurntableCamera(frame, numFrames) };
+        if (ncDeviceOptions.Animate()) {
+            // one bounce period per turntable, so looping the sequence is seamless
+            scene.Animate(CursedRay::DEFAULT_SCENE_BOUNCE_PERIOD * static_cast<float>(frame) / static_cast<float>(numFrames));
+            hwDevice.EnqueueSceneUpdate(scene);
+            scene.ClearDirtySpheres();
+        }
+        hwDevice.ResetAccumulation();
+        std::vector<cl::Event> traceEvents;
+        for (std::uint32_t pass{}; pass < numPasses; ++pass) {
+            traceEvents = hwDevice.EnqueuePathTrace(camera, ncDeviceOptions.ClearColor());
+        }
+        hwDevice.EnqueueResolve(traceEvents);
+        if (publisher) {
+            PublishFrame(*publisher, hwDevice);
+        }
+
+        if (hwDevice.Finish(CursedRay::DEFAULT_FRAMES_IN_FLIGHT)) {
+            encodeFrame();
+        }
+    }
+    for (std::uint32_t inFlight{ std::min(CursedRay::DEFAULT_FRAMES_IN_FLIGHT, numFrames) }; inFlight-- > 0;) {
+        if (hwDevice.Finish(inFlight)) {
+            encodeFrame();
+        }
+    }
+
+    double renderTime{ std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() };
+    CursedRay::Log("CursedRay: rendered %u frames in %.2f seconds, %zu still encoding", numFrames, renderTime, encoders.GetNumPending());
+}
+
+////////////////////////////////////////
+static bool RunTiled(const CursedRay::NCDeviceOptions& ncDeviceOptions)
+{
+    // a still from the default camera, only one tile's worth of it is ever held in memory
+    CursedRay::HWDeviceOptions hwDeviceOptions{ ncDeviceOptions.GetHWDeviceOptions() };
+
+    // the environment map is loaded first, its size is taken off the budget before the tiles are sized
+    CursedRay::HWDeviceContext context(hwDeviceOptions);
+    std::size_t environmentSize{ context.mEnvironment.GetPixelsSizeInBytes() + context.mEnvironment.GetAliasSizeInBytes() };
+    CursedRay::TileLayout layout{};
+    if (!CursedRay::GetTileLayout(ncDeviceOptions.GetResolutionWidth(), ncDeviceOptions.GetResolutionHeight(),
+                                  hwDeviceOptions, environmentSize, ncDeviceOptions.GetMaxMemory(), layout)) {
+        return false;
+    }
+    CursedRay::Scene scene(ncDeviceOptions.GetSceneType());
+    CursedRay::Camera camera(CursedRay::DEFAULT_CAMERA_POSITION, CursedRay::DEFAULT_CAMERA_FOCAL_LENGTH);
+    return CursedRay::RenderTiled(ncDeviceOptions.GetTiledOutputFile().c_str(), layout, scene, camera,
+                                  ncDeviceOptions.ClearColor(), ncDeviceOptions.GetSequenceSamples(), hwDeviceOptions, context);
+}
 
 ////////////////////////////////////////
 int main(int argc, char** argv)
 {
+    const auto startupBegin{ std::chrono::steady_clock::now() };
     CursedRay::NCDeviceOptions ncDeviceOptions(argc, argv);
+    if (!ncDeviceOptions.GetWorkerAddress().empty()) {
+        // workers never touch the terminal
+        bool success{ CursedRay::RunFarmWorker(ncDeviceOptions.GetWorkerAddress().c_str(), ncDeviceOptions.GetHWDeviceOptions()) };
+        return success ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (!ncDeviceOptions.GetTiledOutputFile().empty()) {
+        // tiled stills are headless as well, and may be far larger than any terminal
+        return RunTiled(ncDeviceOptions) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (ncDeviceOptions.GetSequenceFrames() > 0) {
+        // sequences render headless at their own resolution
+        RunSequence(ncDeviceOptions);
+        return EXIT_SUCCESS;
+    }
+
+    // device discovery and kernel builds only need the options, they overlap the terminal probing below
+    CursedRay::HWDeviceOptions hwDeviceOptions{ ncDeviceOptions.GetHWDeviceOptions() };
+    std::future<CursedRay::HWDeviceContext> hwDeviceContext;
+    if (!ncDeviceOptions.IsFarmCoordinator()) {
+        hwDeviceContext = std::async(std::launch::async, [&hwDeviceOptions]() { return CursedRay::HWDeviceContext(hwDeviceOptions); });
+    }
+
+    auto terminalBegin{ std::chrono::steady_clock::now() };
     CursedRay::NCDevice ncDevice(ncDeviceOptions);
+    auto terminalTime{ std::chrono::steady_clock::now() - terminalBegin };
 
     CursedRay::FramebufferOptions framebufferOptions(ncDevice.GetRenderWidth(),
                                                      ncDevice.GetRenderHeight(),
                                                      ncDeviceOptions.ClearColor());
-    CursedRay::Framebuffer framebuffer(framebufferOptions);
+    CursedRay::DisplayFramebuffer framebuffer(framebufferOptions);
+    if (ncDeviceOptions.IsFarmCoordinator()) {
+        RunFarm(ncDeviceOptions, ncDevice, framebuffer, argc, argv);
+        return EXIT_SUCCESS;
+    }
 
-    CursedRay::HWDevice hwDevice(framebuffer, ncDeviceOptions.GetHWDeviceOptions());
-    auto events{ hwDevice.EnqueueClearColor(ncDeviceOptions.ClearColor()) };
-    hwDevice.Finish();
+    CursedRay::Scene scene(ncDeviceOptions.GetSceneType());
+    CursedRay::Camera camera(CursedRay::DEFAULT_CAMERA_POSITION, CursedRay::DEFAULT_CAMERA_FOCAL_LENGTH);
+
+    // buffers are created as soon as the render size is known, waiting only on whatever setup is left
+    auto contextWaitBegin{ std::chrono::steady_clock::now() };
+    CursedRay::HWDeviceContext context{ hwDeviceContext.get() };
+    auto contextWaitTime{ std::chrono::steady_clock::now() - contextWaitBegin };
+    auto deviceBegin{ std::chrono::steady_clock::now() };
+    CursedRay::HWDevice hwDevice(framebuffer, scene, hwDeviceOptions, context);
+    auto deviceTime{ std::chrono::steady_clock::now() - deviceBegin };
+
+    // the device holds its own copy of the environment map, large maps are not worth keeping twice
+    context.mEnvironment = CursedRay::EnvironmentMap{};
+
+    // the terminal is written on its own thread, a slow blit never holds up the next submission
+    CursedRay::Presenter presenter(ncDevice, framebuffer);
+
+    std::unique_ptr<CursedRay::Checkpoint> checkpoint;
+    if (!ncDeviceOptions.GetCheckpointFile().empty()) {
+        checkpoint = std::make_unique<CursedRay::Checkpoint>(ncDeviceOptions.GetCheckpointFile().c_str(),
+                                                             framebuffer.GetWidth(),
+                                                             framebuffer.GetHeight());
+        if (ncDeviceOptions.Resume()) {
+            ResumeCheckpoint(*checkpoint, hwDevice, ncDeviceOptions, framebuffer, camera);
+        }
+    }
+    std::unique_ptr<CursedRay::FramePublisher> publisher{ CreatePublisher(ncDeviceOptions, framebuffer) };
+    const std::chrono::seconds checkpointInterval{ ncDeviceOptions.GetCheckpointInterval() };
+    auto lastCheckpoint{ std::chrono::steady_clock::now() };
 
-    hwDevice.LogProfile(events);
+    std::unique_ptr<CursedRay::ResolutionController> resolution;
+    if (ncDeviceOptions.GetTargetFps() > 0) {
+        resolution = std::make_unique<CursedRay::ResolutionController>(framebuffer.GetWidth(),
+                                                                       framebuffer.GetHeight(),
+                                                                       hwDeviceOptions.mSamplesPerPixel,
+                                                                       ncDeviceOptions.GetTargetFps());
+    }
 
-    ncDevice.Blit(framebuffer);
-    ncDevice.Block();
+    CursedRay::Camera previousCamera{ camera };
+    const auto animationBegin{ std::chrono::steady_clock::now() };
+    std::chrono::steady_clock::duration submitTime{};
+    std::vector<cl::Event> firstFrameEvents;
+    std::vector<cl::Event> previousFrameEvents;
+    FrameRecord previousFrame{};
+    auto lastPresent{ std::chrono::steady_clock::now() };
+    for (std::uint32_t frame{}; HandleInput(ncDevice, camera); ++frame) {
+        bool cameraMoved{ camera != previousCamera };
+        bool sceneMoved{ ncDeviceOptions.Animate() };
+        bool resized{ resolution && hwDevice.SetRenderSize(resolution->GetRenderWidth(),
+                                                           resolution->GetRenderHeight(),
+                                                           resolution->GetSamplesPerPixel()) };
+        bool reproject{ cameraMoved && !sceneMoved && !resized && hwDeviceOptions.mReprojection };
+        if (sceneMoved) {
+            // moved geometry invalidates the accumulated samples and the reprojection history alike
+            scene.Animate(std::chrono::duration<float>(std::chrono::steady_clock::now() - animationBegin).count());
+            hwDevice.EnqueueSceneUpdate(scene);
+            scene.ClearDirtySpheres();
+            hwDevice.ResetAccumulation();
+        }
+        else if (reproject) {
+            hwDevice.PushHistory();
+        }
+        else if (cameraMoved) {
+            hwDevice.ResetAccumulation();
+        }
+
+        auto submitBegin{ std::chrono::steady_clock::now() };
+        FrameRecord currentFrame{};
+        currentFrame.mNumRays = std::uint64_t{ hwDevice.GetRenderWidth() } * hwDevice.GetRenderHeight() * hwDevice.GetSamplesPerFrame();
+        currentFrame.mTraceEvents = hwDevice.EnqueuePathTrace(camera, ncDeviceOptions.ClearColor());
+        if (reproject) {
+            currentFrame.mReprojectEvents = hwDevice.EnqueueReprojection(camera, previousCamera, currentFrame.mTraceEvents);
+        }
+        currentFrame.mResolveEvents = hwDevice.EnqueueResolve(reproject ? currentFrame.mReprojectEvents : currentFrame.mTraceEvents);
+        if (publisher) {
+            PublishFrame(*publisher, hwDevice);
+        }
+        submitTime += std::chrono::steady_clock::now() - submitBegin;
+
+        if (checkpoint) {
+            // a scaled render lays its pixels out differently, only full resolution frames are saved
+            checkpoint->Poll();
+            auto now{ std::chrono::steady_clock::now() };
+            if (!hwDevice.IsRenderScaled() && now - lastCheckpoint >= checkpointInterval && WriteCheckpoint(*checkpoint, hwDevice, ncDeviceOptions, framebuffer, camera)) {
+                lastCheckpoint = now;
+            }
+        }
+
+        // keep one frame in flight: the previous frame is read back while this one traces
+        bool presented{ hwDevice.Finish(CursedRay::DEFAULT_FRAMES_IN_FLIGHT) };
+
+        if (presented && !previousFrameEvents.empty()) {
+            // the frame presented now is the one enqueued last iteration, its events have completed
+            if (resolution) {
+                resolution->Update(hwDevice.Profile(previousFrameEvents) * 1e-6, cameraMoved || sceneMoved);
+            }
+            PublishFrameMetrics(hwDevice, previousFrame);
+        }
+        previousFrame = std::move(currentFrame);
+        previousFrameEvents = previousFrame.mTraceEvents;
+        previousFrameEvents.insert(previousFrameEvents.end(), previousFrame.mReprojectEvents.begin(), previousFrame.mReprojectEvents.end());
+        previousFrameEvents.insert(previousFrameEvents.end(), previousFrame.mResolveEvents.begin(), previousFrame.mResolveEvents.end());
+
+        if (frame == 0) {
+            firstFrameEvents = previousFrameEvents;
+        }
+        if (presented && !firstFrameEvents.empty()) {
+            using Milliseconds = std::chrono::duration<double, std::milli>;
+            hwDevice.LogProfile(firstFrameEvents);
+            CursedRay::Log("CursedRay: time to first frame was %.1f milliseconds (terminal %.1f, device setup %.1f of which %.1f waited on, buffers and tuning %.1f)",
+                           Milliseconds(std::chrono::steady_clock::now() - startupBegin).count(),
+                           Milliseconds(terminalTime).count(),
+                           Milliseconds(context.mSetupTime).count(),
+                           Milliseconds(contextWaitTime).count(),
+                           Milliseconds(deviceTime).count());
+            firstFrameEvents.clear();
+        }
+        if (frame % CursedRay::DEFAULT_METRICS_LOG_INTERVAL == 0) {
+            CursedRay::Log("CursedRay: lane utilization was %.1f%%", hwDevice.ReadLaneUtilization() * 100.0);
+
+            // host time spent issuing commands, not waiting for them
+            std::uint32_t numFrames{ frame == 0 ? 1 : CursedRay::DEFAULT_METRICS_LOG_INTERVAL };
+            CursedRay::Log("CursedRay: host submit took %.1f microseconds per frame (%s command graph)",
+                           std::chrono::duration<double, std::micro>(submitTime).count() / numFrames,
+                           hwDevice.IsResolveGraphNative() ? "native" : "emulated");
+            submitTime = {};
+        }
+
+        if (presented) {
+            auto now{ std::chrono::steady_clock::now() };
+            CursedRay::PublishMetric(CursedRay::Metric::FrameTime, std::chrono::duration<double, std::milli>(now - lastPresent).count());
+            CursedRay::PublishMetric(CursedRay::Metric::SamplesPerPixel, hwDevice.GetSampleIndex());
+            lastPresent = now;
+            presenter.Submit(framebuffer);
+        }
+        else {
+            presenter.Wake();
+        }
+        previousCamera = camera;
+    }
+
+    hwDevice.Finish();
+    CursedRay::Log("CursedRay: presented %llu frames, dropped %llu the terminal could not keep up with",
+                   static_cast<unsigned long long>(presenter.GetNumPresented()),
+                   static_cast<unsigned long long>(presenter.GetNumDropped()));
+    if (checkpoint && !hwDevice.IsRenderScaled()) {
+        // a clean exit leaves a checkpoint of the very last frame, traced from previousCamera
+        checkpoint->Poll(true);
+        WriteCheckpoint(*checkpoint, hwDevice, ncDeviceOptions, framebuffer, previousCamera);
+        checkpoint->Poll(true);
+    }
+    if (!ncDeviceOptions.GetHDROutputFile().empty()) {
+        CursedRay::SaveFramebufferPFM(ncDeviceOptions.GetHDROutputFile().c_str(), hwDevice.GetHDRFramebuffer());
+    }
 }
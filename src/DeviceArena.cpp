@@ -0,0 +1,81 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "DeviceArena.hpp"
+#include "Log.hpp"
+#include "Metrics.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    static std::size_t AlignUp(std::size_t value, std::size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    ////////////////////////////////////////
+    DeviceArena::DeviceArena()
+        : mAlignment{ 1 }, mBlockSize{}, mUsage{}, mReservedSize{}
+    {
+    }
+
+    ////////////////////////////////////////
+    DeviceArena::DeviceArena(const cl::Context& ctx, const cl::Device& device, std::size_t blockSize)
+        : mCtx{ ctx }, mUsage{}, mReservedSize{}
+    {
+        // sub-buffer origins must be aligned to CL_DEVICE_MEM_BASE_ADDR_ALIGN, which is given in bits
+        mAlignment = std::max<std::size_t>(device.getInfo<CL_DEVICE_MEM_BASE_ADDR_ALIGN>() / 8, 1);
+        std::size_t maxAllocationSize{ static_cast<std::size_t>(device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>()) };
+        mBlockSize = AlignUp(maxAllocationSize > 0 ? std::min(blockSize, maxAllocationSize) : blockSize, mAlignment);
+    }
+
+    ////////////////////////////////////////
+    cl::Buffer DeviceArena::Allocate(std::size_t size, cl_mem_flags flags)
+    {
+        // sizes are rounded up as well so that every offset handed out stays aligned
+        std::size_t alignedSize{ AlignUp(std::max<std::size_t>(size, 1), mAlignment) };
+
+        // first fit, the tail of an earlier block still takes small buffers after a large one opened a new block
+        auto block{ std::find_if(mBlocks.begin(), mBlocks.end(), [alignedSize](const Block& candidate) {
+            return candidate.mSize - candidate.mOffset >= alignedSize;
+        }) };
+        if (block == mBlocks.end()) {
+            // oversized requests get a dedicated block instead of failing
+            std::size_t newBlockSize{ std::max(mBlockSize, alignedSize) };
+            mBlocks.push_back({ cl::Buffer(mCtx, CL_MEM_READ_WRITE, newBlockSize), newBlockSize, 0 });
+            mReservedSize += newBlockSize;
+            block = std::prev(mBlocks.end());
+        }
+
+        cl_buffer_region region{ block->mOffset, size };
+        cl::Buffer buffer{ block->mBuffer.createSubBuffer(flags, CL_BUFFER_CREATE_TYPE_REGION, &region) };
+        block->mOffset += alignedSize;
+
+        mUsage += alignedSize;
+        PublishMetric(Metric::DeviceMemory, static_cast<double>(mUsage) / (1024.0 * 1024.0));
+        return buffer;
+    }
+
+    ////////////////////////////////////////
+    void DeviceArena::LogUsage() const
+    {
+        Log("CursedRay: device arena uses %zu KiB of %zu KiB reserved in %zu blocks",
+            mUsage / 1024, mReservedSize / 1024, mBlocks.size());
+    }
+}
@@ -0,0 +1,247 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "DeviceSelector.hpp"
+#include "Autotuner.hpp"
+#include "Constants.hpp"
+#include "IO.hpp"
+#include "Log.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <ios>
+#include <limits>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    static std::vector<cl::Platform> GetPlatforms()
+    {
+        std::vector<cl::Platform> platforms;
+        try {
+            cl::Platform::get(&platforms);
+        }
+        catch (const cl::Error&) {
+            // no installable client driver at all
+        }
+        return platforms;
+    }
+
+    ////////////////////////////////////////
+    static std::vector<cl::Device> GetDevices(const cl::Platform& platform, cl_device_type type)
+    {
+        std::vector<cl::Device> devices;
+        try {
+            platform.getDevices(type, &devices);
+        }
+        catch (const cl::Error&) {
+            // CL_DEVICE_NOT_FOUND for platforms without a device of this type
+        }
+        return devices;
+    }
+
+    ////////////////////////////////////////
+    static const char* GetDeviceTypeName(cl_device_type type)
+    {
+        if (type & CL_DEVICE_TYPE_GPU) {
+            return "gpu";
+        }
+        if (type & CL_DEVICE_TYPE_CPU) {
+            return "cpu";
+        }
+        if (type & CL_DEVICE_TYPE_ACCELERATOR) {
+            return "accelerator";
+        }
+        return "custom";
+    }
+
+    ////////////////////////////////////////
+    static bool MatchesType(const cl::Device& device, cl_device_type type)
+    {
+        // the default type has no meaning per device, every device is a candidate
+        return type == CL_DEVICE_TYPE_DEFAULT || (device.getInfo<CL_DEVICE_TYPE>() & type) != 0;
+    }
+
+    ////////////////////////////////////////
+    void ListDevices()
+    {
+        std::vector<cl::Platform> platforms{ GetPlatforms() };
+        if (platforms.empty()) {
+            std::printf("No OpenCL platforms found\n");
+            return;
+        }
+        for (std::size_t p{}; p < platforms.size(); ++p) {
+            std::printf("Platform %zu: %s (%s)\n", p,
+                        platforms[p].getInfo<CL_PLATFORM_NAME>().c_str(),
+                        platforms[p].getInfo<CL_PLATFORM_VERSION>().c_str());
+            std::vector<cl::Device> devices{ GetDevices(platforms[p], CL_DEVICE_TYPE_ALL) };
+            for (std::size_t d{}; d < devices.size(); ++d) {
+                const cl::Device& device{ devices[d] };
+                std::printf("\t%zu:%zu\t %s, %s, %u compute units, %llu MiB, driver %s\n", p, d,
+                            device.getInfo<CL_DEVICE_NAME>().c_str(),
+                            GetDeviceTypeName(device.getInfo<CL_DEVICE_TYPE>()),
+                            device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>(),
+                            static_cast<unsigned long long>(device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>() >> 20),
+                            device.getInfo<CL_DRIVER_VERSION>().c_str());
+            }
+        }
+    }
+
+    ////////////////////////////////////////
+    static double BenchmarkDevice(const cl::Device& device, const std::string& source)
+    {
+        cl::Context ctx(device);
+        cl::CommandQueue queue(ctx, device, CL_QUEUE_PROFILING_ENABLE);
+
+        std::string buildOptions{ "-I " };
+        buildOptions.append(KERNEL_INCLUDE_DIR);
+        cl::Program program(ctx, source);
+        program.build(buildOptions.c_str());
+
+        cl::Kernel kernel(program, KERNEL_CALIBRATE_NAME);
+        cl::Buffer output(ctx, CL_MEM_WRITE_ONLY, std::size_t{ DEFAULT_CALIBRATION_WIDTH } * DEFAULT_CALIBRATION_HEIGHT * sizeof(float));
+        kernel.setArg(0, output);
+        kernel.setArg(1, DEFAULT_CALIBRATION_WIDTH);
+        kernel.setArg(2, DEFAULT_CALIBRATION_HEIGHT);
+
+        return Autotuner::Benchmark(queue, kernel, cl::NDRange(DEFAULT_CALIBRATION_WIDTH, DEFAULT_CALIBRATION_HEIGHT), cl::NullRange);
+    }
+
+    ////////////////////////////////////////
+    static bool SelectFastestDevice(const HWDeviceOptions& options, cl::Device& device)
+    {
+        std::vector<cl::Platform> platforms{ GetPlatforms() };
+
+        // a new driver or device changes the key, so the benchmark runs again on its own
+        char hostName[256]{};
+        ::gethostname(hostName, sizeof(hostName) - 1);
+        std::uint64_t hostHash{ Autotuner::Hash(hostName) };
+        hostHash = Autotuner::Hash(std::to_string(options.mDeviceType), hostHash);
+
+        std::vector<std::pair<int, int>> candidates;
+        std::vector<cl::Device> candidateDevices;
+        for (std::size_t p{}; p < platforms.size(); ++p) {
+            std::vector<cl::Device> devices{ GetDevices(platforms[p], CL_DEVICE_TYPE_ALL) };
+            for (std::size_t d{}; d < devices.size(); ++d) {
+                if (!MatchesType(devices[d], options.mDeviceType)) {
+                    continue;
+                }
+                hostHash = Autotuner::Hash(devices[d].getInfo<CL_DEVICE_NAME>(), hostHash);
+                hostHash = Autotuner::Hash(devices[d].getInfo<CL_DRIVER_VERSION>(), hostHash);
+                candidates.emplace_back(static_cast<int>(p), static_cast<int>(d));
+                candidateDevices.push_back(devices[d]);
+            }
+        }
+        if (candidates.empty()) {
+            return false;
+        }
+
+        // entries of other hosts are kept so that saving does not drop them
+        std::map<std::uint64_t, std::pair<int, int>> entries;
+        if (std::ifstream fp{ options.mDeviceCacheFile }) {
+            std::uint64_t key{};
+            std::pair<int, int> choice{};
+            while (fp >> std::hex >> key >> std::dec >> choice.first >> choice.second) {
+                entries[key] = choice;
+            }
+        }
+        auto entry{ entries.find(hostHash) };
+        if (entry != entries.end() && !options.mRetune) {
+            for (std::size_t i{}; i < candidates.size(); ++i) {
+                if (candidates[i] == entry->second) {
+                    device = candidateDevices[i];
+                    return true;
+                }
+            }
+        }
+
+        std::string source{ ReadTextFile(KERNEL_CALIBRATE_PATH) };
+        double bestTime{ std::numeric_limits<double>::max() };
+        std::size_t bestCandidate{};
+        for (std::size_t i{}; i < candidates.size(); ++i) {
+            std::string deviceName{ candidateDevices[i].getInfo<CL_DEVICE_NAME>() };
+            try {
+                double time{ BenchmarkDevice(candidateDevices[i], source) };
+                Log("CursedRay: calibration trace on %d:%d %s took %f milliseconds",
+                    candidates[i].first, candidates[i].second, deviceName.c_str(), time * 1e-6);
+                if (time < bestTime) {
+                    bestTime = time;
+                    bestCandidate = i;
+                }
+            }
+            catch (const cl::Error& err) {
+                // a device whose compiler or runtime fails the calibration is no candidate either
+                Log("CursedRay: skipping %d:%d %s, OpenCL Error: %s",
+                    candidates[i].first, candidates[i].second, deviceName.c_str(), err.what());
+            }
+        }
+        if (bestTime == std::numeric_limits<double>::max()) {
+            return false;
+        }
+
+        device = candidateDevices[bestCandidate];
+        entries[hostHash] = candidates[bestCandidate];
+        std::ofstream fp{ options.mDeviceCacheFile, std::ios::trunc };
+        if (!fp) {
+            Log("CursedRay: could not write the device cache %s", options.mDeviceCacheFile.c_str());
+            return true;
+        }
+        for (const auto& [key, choice] : entries) {
+            fp << std::hex << key << ' ' << std::dec << choice.first << ' ' << choice.second << '\n';
+        }
+        return true;
+    }
+
+    ////////////////////////////////////////
+    bool SelectDevice(const HWDeviceOptions& options, cl::Device& device)
+    {
+        if (options.mAutoDevice) {
+            return SelectFastestDevice(options, device);
+        }
+
+        std::vector<cl::Platform> platforms{ GetPlatforms() };
+        if (options.mPlatformIndex >= 0) {
+            if (static_cast<std::size_t>(options.mPlatformIndex) >= platforms.size()) {
+                return false;
+            }
+            std::vector<cl::Device> devices{ GetDevices(platforms[static_cast<std::size_t>(options.mPlatformIndex)], CL_DEVICE_TYPE_ALL) };
+            if (static_cast<std::size_t>(options.mDeviceIndex) >= devices.size()) {
+                return false;
+            }
+            device = devices[static_cast<std::size_t>(options.mDeviceIndex)];
+            return true;
+        }
+
+        // the context is created from this very device, unlike a context of a type paired with the
+        // default device, which on hosts with several drivers need not even belong to it
+        for (const cl::Platform& platform : platforms) {
+            std::vector<cl::Device> devices{ GetDevices(platform, options.mDeviceType) };
+            if (!devices.empty()) {
+                device = devices.front();
+                return true;
+            }
+        }
+        return false;
+    }
+}
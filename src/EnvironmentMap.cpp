@@ -0,0 +1,233 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "EnvironmentMap.hpp"
+#include "Framebuffer.hpp"
+#include "Log.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <future>
+#include <numbers>
+#include <thread>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    // keeps texel and alias indices within the kernels' 32-bit arithmetic
+    static constexpr std::uint32_t MAX_ENVIRONMENT_SIZE{ 1u << 15 };
+
+    ////////////////////////////////////////
+    static constexpr float MAX_HALF{ 65504.0f };
+
+    ////////////////////////////////////////
+    static void BuildRowAlias(const float* weights,
+                              std::uint32_t count,
+                              EnvironmentAlias* table,
+                              std::vector<double>& scaled,
+                              std::vector<std::uint32_t>& small,
+                              std::vector<std::uint32_t>& large)
+    {
+        double sum{};
+        for (std::uint32_t i{}; i < count; ++i) {
+            sum += weights[i];
+        }
+
+        if (sum <= 0.0) {
+            for (std::uint32_t i{}; i < count; ++i) {
+                table[i] = EnvironmentAlias{ 1.0f, i, 1.0f / static_cast<float>(count) };
+            }
+            return;
+        }
+
+        // Vose: pair every underfull entry with an overfull one so each bucket holds at most two outcomes
+        small.clear();
+        large.clear();
+        for (std::uint32_t i{}; i < count; ++i) {
+            scaled[i] = static_cast<double>(weights[i]) * count / sum;
+            (scaled[i] < 1.0 ? small : large).push_back(i);
+            table[i].mPdf = static_cast<float>(weights[i] / sum);
+        }
+
+        while (!small.empty() && !large.empty()) {
+            std::uint32_t less{ small.back() };
+            std::uint32_t more{ large.back() };
+            small.pop_back();
+            table[less].mThreshold = static_cast<float>(scaled[less]);
+            table[less].mAlias = more;
+
+            scaled[more] -= 1.0 - scaled[less];
+            if (scaled[more] < 1.0) {
+                large.pop_back();
+                small.push_back(more);
+            }
+        }
+
+        // whatever is left is full up to rounding error
+        for (std::uint32_t i : small) {
+            table[i].mThreshold = 1.0f;
+            table[i].mAlias = i;
+        }
+        for (std::uint32_t i : large) {
+            table[i].mThreshold = 1.0f;
+            table[i].mAlias = i;
+        }
+    }
+
+    ////////////////////////////////////////
+    EnvironmentMap::EnvironmentMap()
+        : mWidth{}
+        , mHeight{}
+    {
+    }
+
+    ////////////////////////////////////////
+    EnvironmentMap::EnvironmentMap(const std::string& url)
+        : mWidth{}
+        , mHeight{}
+    {
+        if (url.empty()) {
+            return;
+        }
+
+        auto begin{ std::chrono::steady_clock::now() };
+        std::vector<float> radiance;
+        if (!Load(url.c_str(), radiance)) {
+            mWidth = mHeight = 0;
+            Log("CursedRay: falling back to the clear color");
+            return;
+        }
+
+        auto loaded{ std::chrono::steady_clock::now() };
+        std::uint32_t numThreads{ BuildAliasTable(radiance) };
+        auto end{ std::chrono::steady_clock::now() };
+        Log("CursedRay: loaded %ux%u environment map %s in %f milliseconds, built its alias table on %u threads in %f milliseconds",
+            mWidth, mHeight, url.c_str(),
+            std::chrono::duration<double, std::milli>(loaded - begin).count(),
+            numThreads, std::chrono::duration<double, std::milli>(end - loaded).count());
+    }
+
+    ////////////////////////////////////////
+    bool EnvironmentMap::Load(const char* url, std::vector<float>& radiance)
+    {
+        std::FILE* fp{ std::fopen(url, "rb") };
+        if (!fp) {
+            Log("CursedRay: Failed to open %s for reading", url);
+            return false;
+        }
+
+        // PF is RGB, Pf is grayscale, a negative scale marks little-endian data stored bottom to top
+        char type[3]{};
+        float scale{};
+        if (std::fscanf(fp, "%2s %u %u %f", type, &mWidth, &mHeight, &scale) != 4 || std::fgetc(fp) == EOF ||
+            type[0] != 'P' || (type[1] != 'F' && type[1] != 'f') ||
+            mWidth == 0 || mHeight == 0 || mWidth > MAX_ENVIRONMENT_SIZE || mHeight > MAX_ENVIRONMENT_SIZE) {
+            Log("CursedRay: %s is not a supported PFM image", url);
+            std::fclose(fp);
+            return false;
+        }
+
+        std::size_t numChannels{ type[1] == 'F' ? 3u : 1u };
+        std::size_t numPixels{ static_cast<std::size_t>(mWidth) * mHeight };
+        std::vector<float> file(numPixels * numChannels);
+        bool success{ std::fread(file.data(), sizeof(float), file.size(), fp) == file.size() };
+        std::fclose(fp);
+        if (!success) {
+            Log("CursedRay: Failed to read %s", url);
+            return false;
+        }
+
+        bool isLittleEndian{ scale < 0.0f };
+        bool isSwapped{ isLittleEndian != (std::endian::native == std::endian::little) };
+        radiance.resize(numPixels * 3);
+        for (std::uint32_t y{}; y < mHeight; ++y) {
+            const float* source{ file.data() + static_cast<std::size_t>(mHeight - 1 - y) * mWidth * numChannels };
+            float* destination{ radiance.data() + static_cast<std::size_t>(y) * mWidth * 3 };
+            for (std::size_t i{}; i < static_cast<std::size_t>(mWidth) * 3; ++i) {
+                float value{ source[numChannels == 3 ? i : i / 3] };
+                if (isSwapped) {
+                    std::uint32_t bits{ std::bit_cast<std::uint32_t>(value) };
+                    bits = (bits >> 24) | ((bits >> 8) & 0xff00) | ((bits << 8) & 0xff0000) | (bits << 24);
+                    value = std::bit_cast<float>(bits);
+                }
+                // half has no room for NaNs or anything brighter than its largest finite value
+                destination[i] = std::isfinite(value) ? std::clamp(value, 0.0f, MAX_HALF) : 0.0f;
+            }
+        }
+        return true;
+    }
+
+    ////////////////////////////////////////
+    std::uint32_t EnvironmentMap::BuildAliasTable(const std::vector<float>& radiance)
+    {
+        std::size_t numPixels{ static_cast<std::size_t>(mWidth) * mHeight };
+        mPixels.resize(numPixels * 3);
+        mAlias.resize(numPixels + mHeight);
+
+        // rows are claimed one at a time so threads stay busy despite the cheap poles and the expensive equator
+        std::vector<float> rowWeights(mHeight);
+        std::atomic<std::uint32_t> nextRow{};
+        auto buildRows{ [this, &radiance, &rowWeights, &nextRow]() {
+            std::vector<float> weights(mWidth);
+            std::vector<double> scaled(mWidth);
+            std::vector<std::uint32_t> small, large;
+            small.reserve(mWidth);
+            large.reserve(mWidth);
+
+            for (std::uint32_t y{ nextRow++ }; y < mHeight; y = nextRow++) {
+                std::size_t offset{ static_cast<std::size_t>(y) * mWidth };
+                const float* row{ radiance.data() + offset * 3 };
+                std::uint16_t* pixels{ mPixels.data() + offset * 3 };
+
+                // equirectangular texels shrink towards the poles, weigh them by the solid angle they cover
+                float sinTheta{ std::sin(std::numbers::pi_v<float> * (static_cast<float>(y) + 0.5f) / static_cast<float>(mHeight)) };
+                double rowWeight{};
+                for (std::uint32_t x{}; x < mWidth; ++x) {
+                    const float* texel{ row + static_cast<std::size_t>(x) * 3 };
+                    pixels[x * 3] = FloatToHalf(texel[0]);
+                    pixels[x * 3 + 1] = FloatToHalf(texel[1]);
+                    pixels[x * 3 + 2] = FloatToHalf(texel[2]);
+                    weights[x] = (0.2126f * texel[0] + 0.7152f * texel[1] + 0.0722f * texel[2]) * sinTheta;
+                    rowWeight += weights[x];
+                }
+
+                BuildRowAlias(weights.data(), mWidth, mAlias.data() + offset, scaled, small, large);
+                rowWeights[y] = static_cast<float>(rowWeight);
+            }
+        } };
+
+        std::uint32_t numThreads{ std::clamp<std::uint32_t>(std::thread::hardware_concurrency(), 1, mHeight) };
+        std::vector<std::future<void>> workers;
+        for (std::uint32_t i{ 1 }; i < numThreads; ++i) {
+            workers.push_back(std::async(std::launch::async, buildRows));
+        }
+        buildRows();
+        for (std::future<void>& worker : workers) {
+            worker.get();
+        }
+
+        std::vector<double> scaled(mHeight);
+        std::vector<std::uint32_t> small, large;
+        small.reserve(mHeight);
+        large.reserve(mHeight);
+        BuildRowAlias(rowWeights.data(), mHeight, mAlias.data() + numPixels, scaled, small, large);
+        return numThreads;
+    }
+}
@@ -0,0 +1,98 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "FrameGraph.hpp"
+#include "Constants.hpp"
+
+#include <algorithm>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    static void AppendUnique(std::vector<cl::Event>& waitList, const cl::Event& event)
+    {
+        if (event() == nullptr) {
+            return;
+        }
+        auto isSame{ [&event](const cl::Event& other) { return other() == event(); } };
+        if (std::find_if(waitList.begin(), waitList.end(), isSame) == waitList.end()) {
+            waitList.push_back(event);
+        }
+    }
+
+    ////////////////////////////////////////
+    FrameGraph::FrameGraph(const cl::CommandQueue& queue)
+        : mCmdQueue{ queue }
+    {
+    }
+
+    ////////////////////////////////////////
+    cl::Event FrameGraph::Join(const std::vector<cl::Event>& events) const
+    {
+        if (events.size() == 1) {
+            return events.front();
+        }
+
+        // a marker completes once everything it waits on has, standing in for the whole set
+        cl::Event marker;
+        mCmdQueue.enqueueMarkerWithWaitList(&events, &marker);
+        return marker;
+    }
+
+    ////////////////////////////////////////
+    std::vector<cl::Event> FrameGraph::AddPass(const std::vector<cl::Buffer>& reads,
+                                               const std::vector<cl::Buffer>& writes,
+                                               const PassFunction& pass,
+                                               const std::vector<cl::Event>& events)
+    {
+        std::vector<cl::Event> waitList;
+        for (const cl::Event& event : events) {
+            AppendUnique(waitList, event);
+        }
+        for (const cl::Buffer& buffer : reads) {
+            AppendUnique(waitList, mResources[buffer()].mLastWrite);
+        }
+        for (const cl::Buffer& buffer : writes) {
+            ResourceState& state{ mResources[buffer()] };
+            AppendUnique(waitList, state.mLastWrite);
+            for (const cl::Event& event : state.mReadsSinceWrite) {
+                AppendUnique(waitList, event);
+            }
+        }
+
+        std::vector<cl::Event> passEvents{ pass(waitList) };
+        if (passEvents.empty()) {
+            return passEvents;
+        }
+
+        cl::Event completion{ Join(passEvents) };
+        for (const cl::Buffer& buffer : reads) {
+            std::vector<cl::Event>& readers{ mResources[buffer()].mReadsSinceWrite };
+            readers.push_back(completion);
+
+            // buffers read every frame but rarely written would grow the list without bound
+            if (readers.size() > DEFAULT_FRAME_GRAPH_MAX_READERS) {
+                readers = { Join(readers) };
+            }
+        }
+        for (const cl::Buffer& buffer : writes) {
+            ResourceState& state{ mResources[buffer()] };
+            state.mLastWrite = completion;
+            state.mReadsSinceWrite.clear();
+        }
+        return passEvents;
+    }
+}
@@ -0,0 +1,193 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "FramePublisher.hpp"
+#include "Log.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    constexpr std::uint32_t FRAME_RING_MAGIC{ 0x52464352 };       /* "RCFR" */
+    constexpr std::uint32_t FRAME_RING_VERSION{ 1 };
+    constexpr std::size_t FRAME_RING_HEADER_STRIDE{ 256 };
+    constexpr std::size_t FRAME_RING_PAGE_SIZE{ 4096 };
+
+    ////////////////////////////////////////
+    static_assert(sizeof(SharedFrameRing) <= FRAME_RING_HEADER_STRIDE, "SharedFrameRing must fit in its stride");
+    static_assert(sizeof(SharedFrameSlot) <= FRAME_RING_HEADER_STRIDE, "SharedFrameSlot must fit in its stride");
+
+    ////////////////////////////////////////
+    FramePublisher::FramePublisher(const char* name, std::uint32_t width, std::uint32_t height, PixelFormat format, std::uint32_t numSlots)
+        : mName{ name }, mFile{ -1 }, mData{}, mSize{},
+          mFrameSize{ static_cast<std::size_t>(width) * height * 4 * GetBytesPerChannel(format) },
+          mFormat{ format }, mWidth{ width }, mHeight{ height }, mNumSlots{ numSlots }, mNumFrames{}
+    {
+        // shared-memory object names are a single path component with a leading slash
+        if (mName.empty() || mName.front() != '/') {
+            mName.insert(0, 1, '/');
+        }
+
+        // slots are page aligned so that the device can write each one without touching its neighbours
+        std::size_t slotStride{ (FRAME_RING_HEADER_STRIDE + mFrameSize + FRAME_RING_PAGE_SIZE - 1) / FRAME_RING_PAGE_SIZE * FRAME_RING_PAGE_SIZE };
+        mSize = FRAME_RING_PAGE_SIZE + mNumSlots * slotStride;
+
+        mFile = ::shm_open(mName.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (mFile < 0) {
+            Log("CursedRay: could not open shared memory %s: %s", mName.c_str(), std::strerror(errno));
+            return;
+        }
+        if (::ftruncate(mFile, static_cast<off_t>(mSize)) != 0) {
+            Log("CursedRay: could not resize shared memory %s: %s", mName.c_str(), std::strerror(errno));
+            return;
+        }
+
+        void* data{ ::mmap(nullptr, mSize, PROT_READ | PROT_WRITE, MAP_SHARED, mFile, 0) };
+        if (data == MAP_FAILED) {
+            Log("CursedRay: could not map shared memory %s: %s", mName.c_str(), std::strerror(errno));
+            return;
+        }
+        mData = static_cast<std::uint8_t*>(data);
+
+        // a ring left behind by an earlier run is reset, consumers see mLatest start over
+        std::memset(mData, 0, FRAME_RING_PAGE_SIZE);
+        SharedFrameRing& ring{ GetRing() };
+        ring.mNumSlots = mNumSlots;
+        ring.mPixelOffset = FRAME_RING_HEADER_STRIDE;
+        ring.mSlotOffset = FRAME_RING_PAGE_SIZE;
+        ring.mSlotStride = slotStride;
+        ring.mLatest.store(0, std::memory_order_relaxed);
+        for (std::uint32_t slot{}; slot < mNumSlots; ++slot) {
+            SharedFrameSlot& header{ GetSlot(slot) };
+            header.mSequence.store(0, std::memory_order_relaxed);
+            header.mFormat = static_cast<std::uint32_t>(mFormat);
+            header.mWidth = mWidth;
+            header.mHeight = mHeight;
+            header.mSamplesPerPixel = 0;
+            header.mSizeInBytes = mFrameSize;
+        }
+
+        // the magic goes in last, a consumer that sees it sees a complete layout
+        ring.mVersion = FRAME_RING_VERSION;
+        std::atomic_thread_fence(std::memory_order_release);
+        ring.mMagic = FRAME_RING_MAGIC;
+        Log("CursedRay: publishing frames to shared memory %s, %u slots of %zu bytes", mName.c_str(), mNumSlots, mFrameSize);
+    }
+
+    ////////////////////////////////////////
+    FramePublisher::~FramePublisher()
+    {
+        Poll(true);
+        if (mData != nullptr) {
+            ::munmap(mData, mSize);
+        }
+        if (mFile >= 0) {
+            // consumers that still have the ring mapped keep it until they unmap it
+            ::close(mFile);
+            ::shm_unlink(mName.c_str());
+        }
+    }
+
+    ////////////////////////////////////////
+    SharedFrameRing& FramePublisher::GetRing() const
+    {
+        return *reinterpret_cast<SharedFrameRing*>(mData);
+    }
+
+    ////////////////////////////////////////
+    SharedFrameSlot& FramePublisher::GetSlot(std::uint32_t slot) const
+    {
+        const SharedFrameRing& ring{ GetRing() };
+        return *reinterpret_cast<SharedFrameSlot*>(mData + ring.mSlotOffset + slot * ring.mSlotStride);
+    }
+
+    ////////////////////////////////////////
+    void* FramePublisher::BeginWrite(std::uint32_t samplesPerPixel)
+    {
+        if (mData == nullptr || mPending.size() >= mNumSlots) {
+            return nullptr;
+        }
+
+        std::uint32_t slot{ static_cast<std::uint32_t>((mNumFrames + mPending.size()) % mNumSlots) };
+        SharedFrameSlot& header{ GetSlot(slot) };
+        header.mSequence.store(header.mSequence.load(std::memory_order_relaxed) | 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        mPending.push_back(PendingFrame{ slot, samplesPerPixel, {} });
+        return reinterpret_cast<std::uint8_t*>(&header) + FRAME_RING_HEADER_STRIDE;
+    }
+
+    ////////////////////////////////////////
+    void FramePublisher::EndWrite(const std::vector<cl::Event>& events)
+    {
+        if (!mPending.empty()) {
+            mPending.back().mEvents = events;
+        }
+    }
+
+    ////////////////////////////////////////
+    std::uint32_t FramePublisher::Poll(bool wait)
+    {
+        std::uint32_t numPublished{};
+        while (!mPending.empty()) {
+            PendingFrame& frame{ mPending.front() };
+            bool isComplete{ true };
+            bool isFailed{};
+            try {
+                if (wait) {
+                    cl::Event::waitForEvents(frame.mEvents);
+                }
+                for (const cl::Event& event : frame.mEvents) {
+                    cl_int status{ event.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>() };
+                    isFailed = isFailed || status < 0;
+                    isComplete = isComplete && status == CL_COMPLETE;
+                }
+            }
+            catch (const cl::Error& err) {
+                Log("CursedRay: OpenCL Error: %s", err.what());
+                isFailed = true;
+            }
+
+            SharedFrameSlot& header{ GetSlot(frame.mSlot) };
+            if (isFailed) {
+                // the slot stays odd, consumers skip it until it is written again
+                Log("CursedRay: shared memory frame readback failed");
+                mPending.pop_front();
+                ++mNumFrames;
+                continue;
+            }
+            if (!isComplete) {
+                break;
+            }
+
+            // the pixels are in place, the even sequence is what makes the frame visible
+            ++mNumFrames;
+            header.mSamplesPerPixel = frame.mSamplesPerPixel;
+            header.mSequence.store(mNumFrames * 2, std::memory_order_release);
+            GetRing().mLatest.store(mNumFrames, std::memory_order_release);
+            mPending.pop_front();
+            ++numPublished;
+        }
+        return numPublished;
+    }
+}
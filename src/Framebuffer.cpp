@@ -15,30 +15,401 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "Framebuffer.hpp"
+#include "Log.hpp"
 
-#include <cstring>
-#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdio>
+
+#if defined(__AVX2__) || defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    ////////////////////////////////////////
+    /* floats below 2^-13 all map to sRGB 0, floats above this one all map to 255 */
+    constexpr std::uint32_t SRGB_MIN_BITS{ (127 - 13) << 23 };
+    constexpr std::uint32_t SRGB_ALMOST_ONE_BITS{ 0x3f7fffff };
+    constexpr std::size_t SRGB_TABLE_SIZE{ 104 };
+
+    ////////////////////////////////////////
+    float EncodeSRGB(float value)
+    {
+        return value <= 0.0031308f ? 12.92f * value : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+    }
+
+    ////////////////////////////////////////
+    float DecodeSRGB(float value)
+    {
+        return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+    }
+
+    ////////////////////////////////////////
+    float ToneMapACES(float value)
+    {
+        // fitted ACES curve (Narkowicz 2015), matches kernels/tonemap.cl
+        float numerator{ value * (2.51f * value + 0.03f) };
+        float denominator{ value * (2.43f * value + 0.59f) + 0.14f };
+        return std::clamp(numerator / denominator, 0.0f, 1.0f);
+    }
+
+    ////////////////////////////////////////
+    /*
+     * Piecewise linear float -> sRGB8 table in the style of stb_image_resize. Each entry covers
+     * the floats sharing an exponent and the top three mantissa bits, the next eight mantissa
+     * bits interpolate linearly. The upper 16 bits hold the bias (in units of 2^9), the lower
+     * 16 bits the slope, both in 16.16 fixed point. The fit is done at startup by least squares.
+     */
+    std::array<std::uint32_t, SRGB_TABLE_SIZE> BuildSRGBTable()
+    {
+        std::array<std::uint32_t, SRGB_TABLE_SIZE> table{};
+        for (std::size_t bucket{}; bucket < SRGB_TABLE_SIZE; ++bucket) {
+            double sumT{}, sumY{}, sumTT{}, sumTY{};
+            for (std::uint32_t t{}; t < 256; ++t) {
+                std::uint32_t bits{ SRGB_MIN_BITS + static_cast<std::uint32_t>(bucket << 20) + (t << 12) + (1u << 11) };
+                double y{ 255.0 * EncodeSRGB(std::bit_cast<float>(bits)) + 0.5 };
+                sumT += t;
+                sumY += y;
+                sumTT += static_cast<double>(t) * t;
+                sumTY += t * y;
+            }
+            double slope{ (256.0 * sumTY - sumT * sumY) / (256.0 * sumTT - sumT * sumT) };
+            double intercept{ (sumY - slope * sumT) / 256.0 };
+
+            std::uint32_t scale{ static_cast<std::uint32_t>(std::clamp(std::lround(slope * 65536.0), 0l, 0xffffl)) };
+            std::uint32_t bias{ static_cast<std::uint32_t>(std::clamp(std::lround(intercept * 128.0), 0l, 0xffffl)) };
+            table[bucket] = (bias << 16) | scale;
+        }
+        return table;
+    }
+
+    ////////////////////////////////////////
+    const std::array<std::uint32_t, SRGB_TABLE_SIZE> SRGB_TABLE{ BuildSRGBTable() };
+
+    ////////////////////////////////////////
+    std::array<float, 256> BuildLinearTable()
+    {
+        std::array<float, 256> table{};
+        for (std::size_t value{}; value < table.size(); ++value) {
+            table[value] = DecodeSRGB(static_cast<float>(value) / 255.0f);
+        }
+        return table;
+    }
+
+    ////////////////////////////////////////
+    const std::array<float, 256> LINEAR_TABLE{ BuildLinearTable() };
+
+    ////////////////////////////////////////
+    std::uint8_t QuantizeAlpha(float value)
+    {
+        return static_cast<std::uint8_t>(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+}
 
 namespace CursedRay
 {
     ////////////////////////////////////////
-    Framebuffer::Framebuffer(const FramebufferOptions& options)
-        : mWidth{options.GetWidth()}, mHeight{options.GetHeight()}
-    {
-        glm::vec4 clearColor{ options.GetClearColor() };
-        mData.reserve(mWidth * mHeight * GetNumChannels());
-        for (std::uint32_t row{}; row < mHeight; ++row) {
-            for (std::uint32_t col{}; col < mWidth; ++col) {
-                std::uint8_t redChannel{ static_cast<std::uint8_t>(clearColor.r * 255.0f) };
-                std::uint8_t greenChannel{ static_cast<std::uint8_t>(clearColor.g * 255.0f) };
-                std::uint8_t blueChannel{ static_cast<std::uint8_t>(clearColor.b * 255.0f) };
-                std::uint8_t alphaChannel{ static_cast<std::uint8_t>(clearColor.a * 255.0f) };
-
-                mData.push_back(redChannel);
-                mData.push_back(greenChannel);
-                mData.push_back(blueChannel);
-                mData.push_back(alphaChannel);
+    std::uint8_t LinearToSRGB8(float value)
+    {
+        // the comparison is written so that NaN clamps to zero
+        const float minValue{ std::bit_cast<float>(SRGB_MIN_BITS) };
+        const float almostOne{ std::bit_cast<float>(SRGB_ALMOST_ONE_BITS) };
+        if (!(value > minValue)) {
+            value = minValue;
+        }
+        if (value > almostOne) {
+            value = almostOne;
+        }
+
+        std::uint32_t bits{ std::bit_cast<std::uint32_t>(value) };
+        std::uint32_t entry{ SRGB_TABLE[(bits - SRGB_MIN_BITS) >> 20] };
+        std::uint32_t bias{ (entry >> 16) << 9 };
+        std::uint32_t scale{ entry & 0xffff };
+        std::uint32_t t{ (bits >> 12) & 0xff };
+        return static_cast<std::uint8_t>((bias + scale * t) >> 16);
+    }
+
+    ////////////////////////////////////////
+    float SRGB8ToLinear(std::uint8_t value)
+    {
+        return LINEAR_TABLE[value];
+    }
+
+    ////////////////////////////////////////
+    std::uint16_t FloatToHalf(float value)
+    {
+        std::uint32_t bits{ std::bit_cast<std::uint32_t>(value) };
+        std::uint32_t sign{ (bits >> 16) & 0x8000 };
+        std::uint32_t exponent{ (bits >> 23) & 0xff };
+        std::uint32_t mantissa{ bits & 0x7fffff };
+
+        if (exponent == 0xff) {
+            return static_cast<std::uint16_t>(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+        }
+
+        std::int32_t halfExponent{ static_cast<std::int32_t>(exponent) - 127 + 15 };
+        if (halfExponent >= 0x1f) {
+            return static_cast<std::uint16_t>(sign | 0x7c00);
+        }
+
+        // round to nearest even, the carry out of the mantissa correctly bumps the exponent
+        if (halfExponent <= 0) {
+            if (halfExponent < -10) {
+                return static_cast<std::uint16_t>(sign);
+            }
+            mantissa |= 0x800000;
+            std::uint32_t shift{ static_cast<std::uint32_t>(14 - halfExponent) };
+            std::uint32_t half{ mantissa >> shift };
+            std::uint32_t remainder{ mantissa & ((1u << shift) - 1) };
+            std::uint32_t halfway{ 1u << (shift - 1) };
+            if (remainder > halfway || (remainder == halfway && (half & 1))) {
+                ++half;
+            }
+            return static_cast<std::uint16_t>(sign | half);
+        }
+
+        std::uint32_t half{ (static_cast<std::uint32_t>(halfExponent) << 10) | (mantissa >> 13) };
+        std::uint32_t remainder{ mantissa & 0x1fff };
+        if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+            ++half;
+        }
+        return static_cast<std::uint16_t>(sign | half);
+    }
+
+    ////////////////////////////////////////
+    float HalfToFloat(std::uint16_t value)
+    {
+        std::uint32_t sign{ static_cast<std::uint32_t>(value & 0x8000) << 16 };
+        std::uint32_t exponent{ (value >> 10) & 0x1fu };
+        std::uint32_t mantissa{ value & 0x3ffu };
+
+        if (exponent == 0) {
+            float subnormal{ static_cast<float>(mantissa) * 5.9604645e-8f };
+            return sign ? -subnormal : subnormal;
+        }
+        if (exponent == 0x1f) {
+            return std::bit_cast<float>(sign | 0x7f800000 | (mantissa << 13));
+        }
+        return std::bit_cast<float>(sign | ((exponent + 112) << 23) | (mantissa << 13));
+    }
+
+    ////////////////////////////////////////
+    void ConvertFloatToSRGB8(const float* source, std::uint8_t* destination, std::size_t numPixels, bool toneMap)
+    {
+        std::size_t pixel{};
+#if defined(__AVX2__)
+        // two RGBA pixels per iteration, alpha lanes (3 and 7) are quantized linearly
+        const __m256 minValue{ _mm256_castsi256_ps(_mm256_set1_epi32(static_cast<int>(SRGB_MIN_BITS))) };
+        const __m256 almostOne{ _mm256_castsi256_ps(_mm256_set1_epi32(static_cast<int>(SRGB_ALMOST_ONE_BITS))) };
+        const __m256i minBits{ _mm256_set1_epi32(static_cast<int>(SRGB_MIN_BITS)) };
+        const __m256i lowMask{ _mm256_set1_epi32(0xffff) };
+        const __m256i byteMask{ _mm256_set1_epi32(0xff) };
+        const int* table{ reinterpret_cast<const int*>(SRGB_TABLE.data()) };
+
+        for (; pixel + 2 <= numPixels; pixel += 2) {
+            __m256 value{ _mm256_loadu_ps(source + pixel * 4) };
+            __m256 alpha{ _mm256_min_ps(_mm256_max_ps(value, _mm256_setzero_ps()), _mm256_set1_ps(1.0f)) };
+
+            if (toneMap) {
+                __m256 numerator{ _mm256_mul_ps(value, _mm256_add_ps(_mm256_mul_ps(value, _mm256_set1_ps(2.51f)),
+                                                                     _mm256_set1_ps(0.03f))) };
+                __m256 denominator{ _mm256_add_ps(_mm256_mul_ps(value, _mm256_add_ps(_mm256_mul_ps(value, _mm256_set1_ps(2.43f)),
+                                                                                     _mm256_set1_ps(0.59f))),
+                                                  _mm256_set1_ps(0.14f)) };
+                value = _mm256_div_ps(numerator, denominator);
+            }
+
+            // max(value, min) returns min for NaN lanes
+            value = _mm256_min_ps(_mm256_max_ps(value, minValue), almostOne);
+            __m256i bits{ _mm256_castps_si256(value) };
+            __m256i index{ _mm256_srli_epi32(_mm256_sub_epi32(bits, minBits), 20) };
+            __m256i entry{ _mm256_i32gather_epi32(table, index, 4) };
+            __m256i bias{ _mm256_slli_epi32(_mm256_srli_epi32(entry, 16), 9) };
+            __m256i scale{ _mm256_and_si256(entry, lowMask) };
+            __m256i t{ _mm256_and_si256(_mm256_srli_epi32(bits, 12), byteMask) };
+            __m256i color{ _mm256_srli_epi32(_mm256_add_epi32(bias, _mm256_mullo_epi32(scale, t)), 16) };
+
+            __m256i quantizedAlpha{ _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(alpha, _mm256_set1_ps(255.0f)),
+                                                                      _mm256_set1_ps(0.5f))) };
+            __m256i result{ _mm256_blend_epi32(color, quantizedAlpha, 0x88) };
+
+            __m128i words{ _mm_packus_epi32(_mm256_castsi256_si128(result), _mm256_extracti128_si256(result, 1)) };
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(destination + pixel * 4), _mm_packus_epi16(words, words));
+        }
+#endif
+        for (; pixel < numPixels; ++pixel) {
+            for (std::size_t channel{}; channel < 3; ++channel) {
+                float value{ source[pixel * 4 + channel] };
+                destination[pixel * 4 + channel] = LinearToSRGB8(toneMap ? ToneMapACES(value) : value);
+            }
+            destination[pixel * 4 + 3] = QuantizeAlpha(source[pixel * 4 + 3]);
+        }
+    }
+
+    ////////////////////////////////////////
+    void ConvertSRGB8ToFloat(const std::uint8_t* source, float* destination, std::size_t numPixels)
+    {
+        std::size_t pixel{};
+#if defined(__AVX2__)
+        for (; pixel + 2 <= numPixels; pixel += 2) {
+            __m256i value{ _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(source + pixel * 4))) };
+            __m256 color{ _mm256_i32gather_ps(LINEAR_TABLE.data(), value, 4) };
+            __m256 alpha{ _mm256_mul_ps(_mm256_cvtepi32_ps(value), _mm256_set1_ps(1.0f / 255.0f)) };
+            _mm256_storeu_ps(destination + pixel * 4, _mm256_blend_ps(color, alpha, 0x88));
+        }
+#endif
+        for (; pixel < numPixels; ++pixel) {
+            for (std::size_t channel{}; channel < 3; ++channel) {
+                destination[pixel * 4 + channel] = SRGB8ToLinear(source[pixel * 4 + channel]);
+            }
+            destination[pixel * 4 + 3] = static_cast<float>(source[pixel * 4 + 3]) * (1.0f / 255.0f);
+        }
+    }
+
+    ////////////////////////////////////////
+    void ConvertFloatToHalf(const float* source, std::uint16_t* destination, std::size_t numPixels)
+    {
+        std::size_t value{};
+        std::size_t numValues{ numPixels * 4 };
+#if defined(__F16C__)
+        for (; value + 8 <= numValues; value += 8) {
+            __m128i half{ _mm256_cvtps_ph(_mm256_loadu_ps(source + value), _MM_FROUND_TO_NEAREST_INT) };
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + value), half);
+        }
+#endif
+        for (; value < numValues; ++value) {
+            destination[value] = FloatToHalf(source[value]);
+        }
+    }
+
+    ////////////////////////////////////////
+    void ConvertHalfToFloat(const std::uint16_t* source, float* destination, std::size_t numPixels)
+    {
+        std::size_t value{};
+        std::size_t numValues{ numPixels * 4 };
+#if defined(__F16C__)
+        for (; value + 8 <= numValues; value += 8) {
+            __m128i half{ _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + value)) };
+            _mm256_storeu_ps(destination + value, _mm256_cvtph_ps(half));
+        }
+#endif
+        for (; value < numValues; ++value) {
+            destination[value] = HalfToFloat(source[value]);
+        }
+    }
+
+    ////////////////////////////////////////
+    void ConvertInterleavedToPlanar(const float* source, float* destination, std::size_t numPixels)
+    {
+        float* red{ destination };
+        float* green{ destination + numPixels };
+        float* blue{ destination + numPixels * 2 };
+        float* alpha{ destination + numPixels * 3 };
+
+        std::size_t pixel{};
+#if defined(__AVX2__)
+        // 4x8 transpose, the unpack/shuffle pairs leave pixels ordered 0 2 4 6 | 1 3 5 7
+        const __m256i order{ _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7) };
+        for (; pixel + 8 <= numPixels; pixel += 8) {
+            const float* pixels{ source + pixel * 4 };
+            __m256 row0{ _mm256_loadu_ps(pixels) };
+            __m256 row1{ _mm256_loadu_ps(pixels + 8) };
+            __m256 row2{ _mm256_loadu_ps(pixels + 16) };
+            __m256 row3{ _mm256_loadu_ps(pixels + 24) };
+
+            __m256 low01{ _mm256_unpacklo_ps(row0, row1) };
+            __m256 high01{ _mm256_unpackhi_ps(row0, row1) };
+            __m256 low23{ _mm256_unpacklo_ps(row2, row3) };
+            __m256 high23{ _mm256_unpackhi_ps(row2, row3) };
+
+            _mm256_storeu_ps(red + pixel, _mm256_permutevar8x32_ps(_mm256_shuffle_ps(low01, low23, 0x44), order));
+            _mm256_storeu_ps(green + pixel, _mm256_permutevar8x32_ps(_mm256_shuffle_ps(low01, low23, 0xee), order));
+            _mm256_storeu_ps(blue + pixel, _mm256_permutevar8x32_ps(_mm256_shuffle_ps(high01, high23, 0x44), order));
+            _mm256_storeu_ps(alpha + pixel, _mm256_permutevar8x32_ps(_mm256_shuffle_ps(high01, high23, 0xee), order));
+        }
+#endif
+        for (; pixel < numPixels; ++pixel) {
+            red[pixel] = source[pixel * 4];
+            green[pixel] = source[pixel * 4 + 1];
+            blue[pixel] = source[pixel * 4 + 2];
+            alpha[pixel] = source[pixel * 4 + 3];
+        }
+    }
+
+    ////////////////////////////////////////
+    void ConvertPlanarToInterleaved(const float* source, float* destination, std::size_t numPixels)
+    {
+        const float* red{ source };
+        const float* green{ source + numPixels };
+        const float* blue{ source + numPixels * 2 };
+        const float* alpha{ source + numPixels * 3 };
+
+        std::size_t pixel{};
+#if defined(__AVX2__)
+        // inverse of the transpose above: reorder to 0 2 4 6 | 1 3 5 7 first, then interleave
+        const __m256i order{ _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7) };
+        for (; pixel + 8 <= numPixels; pixel += 8) {
+            __m256 r{ _mm256_permutevar8x32_ps(_mm256_loadu_ps(red + pixel), order) };
+            __m256 g{ _mm256_permutevar8x32_ps(_mm256_loadu_ps(green + pixel), order) };
+            __m256 b{ _mm256_permutevar8x32_ps(_mm256_loadu_ps(blue + pixel), order) };
+            __m256 a{ _mm256_permutevar8x32_ps(_mm256_loadu_ps(alpha + pixel), order) };
+
+            __m256 lowRG{ _mm256_unpacklo_ps(r, g) };
+            __m256 highRG{ _mm256_unpackhi_ps(r, g) };
+            __m256 lowBA{ _mm256_unpacklo_ps(b, a) };
+            __m256 highBA{ _mm256_unpackhi_ps(b, a) };
+
+            float* pixels{ destination + pixel * 4 };
+            _mm256_storeu_ps(pixels, _mm256_shuffle_ps(lowRG, lowBA, 0x44));
+            _mm256_storeu_ps(pixels + 8, _mm256_shuffle_ps(lowRG, lowBA, 0xee));
+            _mm256_storeu_ps(pixels + 16, _mm256_shuffle_ps(highRG, highBA, 0x44));
+            _mm256_storeu_ps(pixels + 24, _mm256_shuffle_ps(highRG, highBA, 0xee));
+        }
+#endif
+        for (; pixel < numPixels; ++pixel) {
+            destination[pixel * 4] = red[pixel];
+            destination[pixel * 4 + 1] = green[pixel];
+            destination[pixel * 4 + 2] = blue[pixel];
+            destination[pixel * 4 + 3] = alpha[pixel];
+        }
+    }
+
+    ////////////////////////////////////////
+    void ToneMapFramebuffer(const HDRFramebuffer& source, DisplayFramebuffer& destination)
+    {
+        ConvertFloatToSRGB8(source.GetData(), destination.GetData(),
+                            std::min(source.GetNumPixels(), destination.GetNumPixels()), true);
+    }
+
+    ////////////////////////////////////////
+    bool SaveFramebufferPFM(const char* url, const HDRFramebuffer& framebuffer)
+    {
+        std::FILE* fp{ std::fopen(url, "wb") };
+        if (!fp) {
+            Log("CursedRay: Failed to open %s for writing", url);
+            return false;
+        }
+
+        // little-endian RGB floats, rows stored bottom to top
+        std::fprintf(fp, "PF\n%u %u\n-1.0\n", framebuffer.GetWidth(), framebuffer.GetHeight());
+        std::vector<float> row(static_cast<std::size_t>(framebuffer.GetWidth()) * 3);
+        bool success{ true };
+        for (std::uint32_t y{ framebuffer.GetHeight() }; y-- > 0 && success;) {
+            const float* pixels{ framebuffer.GetData() + static_cast<std::size_t>(y) * framebuffer.GetWidth() * 4 };
+            for (std::size_t x{}; x < framebuffer.GetWidth(); ++x) {
+                row[x * 3] = pixels[x * 4];
+                row[x * 3 + 1] = pixels[x * 4 + 1];
+                row[x * 3 + 2] = pixels[x * 4 + 2];
             }
+            success = std::fwrite(row.data(), sizeof(float), row.size(), fp) == row.size();
+        }
+        std::fclose(fp);
+
+        if (!success) {
+            Log("CursedRay: Failed to write %s", url);
         }
+        return success;
     }
 }
@@ -15,21 +15,37 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "HWDevice.hpp"
+#include "Autotuner.hpp"
+#include "DeviceSelector.hpp"
 #include "HWDeviceOptions.hpp"
 #include "IO.hpp"
 #include "Log.hpp"
 #include "Constants.hpp"
 #include "Framebuffer.hpp"
+#include "Camera.hpp"
+#include "Scene.hpp"
+#include "Sampler.hpp"
+#include "LightTree.hpp"
+#include "Metrics.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <future>
+#include <limits>
+#include <numeric>
+#include <string>
+#include <utility>
+
 namespace CursedRay
 {
     ////////////////////////////////////////
-    static void BuildProgram(const std::vector<cl::Device>& devices, cl::Program& program)
+    static void BuildProgram(const std::vector<cl::Device>& devices, cl::Program& program, const char* options = nullptr)
     {
         try {
-            program.build();
+            program.build(options);
         }
         catch (const cl::Error& err) {
             if (err.err() == CL_BUILD_PROGRAM_FAILURE) {
@@ -50,49 +66,542 @@ namespace CursedRay
     }
 
     ////////////////////////////////////////
-    HWDevice::HWDevice(Framebuffer& framebuffer, const HWDeviceOptions& options)
-        : mFramebuffer{ framebuffer }
+    static void SetCameraArgs(cl::Kernel& kernel, cl_uint index, const Camera& camera)
+    {
+        kernel.setArg(index, glm::vec4(camera.GetPosition(), camera.GetFocalLength()));
+        kernel.setArg(index + 1, glm::vec4(camera.GetForward(), 0.0f));
+        kernel.setArg(index + 2, glm::vec4(camera.GetRight(), 0.0f));
+        kernel.setArg(index + 3, glm::vec4(camera.GetUp(), 0.0f));
+    }
+
+    ////////////////////////////////////////
+    static const char* GetResolveKernelName(PixelFormat format)
+    {
+        switch (format) {
+            case PixelFormat::RGBA8:
+                return KERNEL_TONEMAP_NAME;
+            case PixelFormat::RGBA16F:
+                return KERNEL_RESOLVE_HALF_NAME;
+            case PixelFormat::RGBA32F:
+                return KERNEL_RESOLVE_FLOAT_NAME;
+        }
+        return KERNEL_TONEMAP_NAME;
+    }
+
+    ////////////////////////////////////////
+    static FramebufferOptions GetStagingOptions(const DisplayFramebuffer& framebuffer, bool isUsed)
+    {
+        return FramebufferOptions(isUsed ? framebuffer.GetWidth() : 0, isUsed ? framebuffer.GetHeight() : 0, glm::vec4(0.0f));
+    }
+
+    ////////////////////////////////////////
+    static void StageRanges(SceneUpload& upload,
+                            const cl::Buffer& buffer,
+                            std::vector<std::uint32_t> indices,
+                            std::size_t elementSize,
+                            const void* source)
+    {
+        // runs of consecutive elements become one write each
+        std::sort(indices.begin(), indices.end());
+        indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+        const std::byte* bytes{ static_cast<const std::byte*>(source) };
+        for (std::size_t first{}; first < indices.size();) {
+            std::size_t last{ first + 1 };
+            while (last < indices.size() && indices[last] == indices[last - 1] + 1) {
+                ++last;
+            }
+            std::size_t offset{ indices[first] * elementSize };
+            std::size_t size{ (last - first) * elementSize };
+            upload.mRanges.push_back(SceneUpload::Range{ buffer, offset, size, upload.mData.size() });
+            upload.mData.insert(upload.mData.end(), bytes + offset, bytes + offset + size);
+            first = last;
+        }
+    }
+
+    ////////////////////////////////////////
+    ////////////////////////////////////////
+    HWDeviceContext::HWDeviceContext(const HWDeviceOptions& options)
+        : mSetupTime{}
+    {
+        auto setupBegin{ std::chrono::steady_clock::now() };
+
+        // the environment map only needs the host, it loads and builds its alias table while the device is set up
+        std::future<EnvironmentMap> environment{ std::async(std::launch::async, [url = options.mEnvironmentFile]() {
+            return EnvironmentMap(url);
+        }) };
+
+        try {
+            cl::Device device;
+            if (!SelectDevice(options, device)) {
+                Log("CursedRay: no OpenCL device matches the requested type or index");
+                mSetupTime = std::chrono::steady_clock::now() - setupBegin;
+                return;
+            }
+            mCtx = cl::Context(device);
+            mDevices.push_back(device);
+            Log("CursedRay: rendering on %s", device.getInfo<CL_DEVICE_NAME>().c_str());
+
+            mBuildOptions = "-I ";
+            mBuildOptions.append(KERNEL_INCLUDE_DIR);
+            mBuildOptions.append(GetSamplerBuildOptions());
+
+            mClearColorSource = ReadTextFile(KERNEL_CLEAR_COLOR_PATH);
+            mPathTraceSource = ReadTextFile(KERNEL_PATH_TRACE_PATH);
+            mDenoiseSource = ReadTextFile(KERNEL_DENOISE_PATH);
+            mTonemapSource = ReadTextFile(KERNEL_TONEMAP_PATH);
+            mReprojectSource = ReadTextFile(KERNEL_REPROJECT_PATH);
+
+            mClearColorProgram = cl::Program(mCtx, mClearColorSource);
+            mPathTraceProgram = cl::Program(mCtx, mPathTraceSource);
+            mPathTracePersistentProgram = cl::Program(mCtx, ReadTextFile(KERNEL_PATH_TRACE_PERSISTENT_PATH));
+            mDenoiseProgram = cl::Program(mCtx, mDenoiseSource);
+            mTonemapProgram = cl::Program(mCtx, mTonemapSource);
+            mReprojectProgram = cl::Program(mCtx, mReprojectSource);
+
+            // programs are independent of each other, building them concurrently keeps every compiler thread busy
+            std::array<std::future<void>, 6> builds{
+                std::async(std::launch::async, [this]() { BuildProgram(mDevices, mClearColorProgram); }),
+                std::async(std::launch::async, [this]() { BuildProgram(mDevices, mPathTraceProgram, mBuildOptions.c_str()); }),
+                std::async(std::launch::async, [this]() { BuildProgram(mDevices, mPathTracePersistentProgram, mBuildOptions.c_str()); }),
+                std::async(std::launch::async, [this]() { BuildProgram(mDevices, mDenoiseProgram); }),
+                std::async(std::launch::async, [this]() { BuildProgram(mDevices, mTonemapProgram); }),
+                std::async(std::launch::async, [this]() { BuildProgram(mDevices, mReprojectProgram); })
+            };
+            for (std::future<void>& build : builds) {
+                build.get();
+            }
+        }
+        catch (const cl::Error& err) {
+            Log("CursedRay: OpenCL Error: %s", err.what());
+        }
+        mEnvironment = environment.get();
+        mSetupTime = std::chrono::steady_clock::now() - setupBegin;
+    }
+
+    ////////////////////////////////////////
+    HWDevice::HWDevice(DisplayFramebuffer& framebuffer, const Scene& scene, const HWDeviceOptions& options)
+        : HWDevice(framebuffer, scene, options, HWDeviceContext(options))
+    {
+    }
+
+    HWDevice::HWDevice(DisplayFramebuffer& framebuffer, const Scene& scene, const HWDeviceOptions& options, const HWDeviceContext& context)
+        : mCtx{ context.mCtx }, mDevices{ context.mDevices },
+          mClearColorProgram{ context.mClearColorProgram },
+          mPathTraceProgram{ context.mPathTraceProgram },
+          mPathTracePersistentProgram{ context.mPathTracePersistentProgram },
+          mDenoiseProgram{ context.mDenoiseProgram },
+          mTonemapProgram{ context.mTonemapProgram },
+          mReprojectProgram{ context.mReprojectProgram },
+          mBvh{ scene }, mNumSpheres{ scene.GetNumSpheres() },
+          mLightTree{ scene }, mNumLights{ scene.GetNumLights() },
+          mEnvironmentWidth{ context.mEnvironment.GetWidth() }, mEnvironmentHeight{ context.mEnvironment.GetHeight() },
+          mNumSceneUploads{},
+          mFrameIndex{}, mSampleIndex{},
+          mRenderWidth{ framebuffer.GetWidth() }, mRenderHeight{ framebuffer.GetHeight() },
+          mClearColorTile{}, mPathTraceTile{}, mReprojectTile{}, mDenoiseTile{}, mTonemapTile{},
+          mHistoryParity{},
+          mResolvedFrames{}, mPresentedFrames{}, mIsResolveGraphNative{},
+          mClearColor{ 0.0f },
+          mOptions{ options }, mFramebuffer{ framebuffer },
+          mHalfFramebuffer{ GetStagingOptions(framebuffer, options.mFramebufferFormat == PixelFormat::RGBA16F) },
+          mHDRFramebuffer{ GetStagingOptions(framebuffer, options.mFramebufferFormat != PixelFormat::RGBA8) }
     {
         try {
-            mCtx = cl::Context(options.mDeviceType);
-            mCmdQueue = cl::CommandQueue(mCtx, CL_QUEUE_PROFILING_ENABLE);
-            mDevices.push_back(cl::Device::getDefault());
+            if (mDevices.empty()) {
+                Log("CursedRay: no OpenCL device was set up");
+                return;
+            }
+
+            // out-of-order execution lets passes without a dependency between them overlap
+            cl_command_queue_properties queueProperties{ CL_QUEUE_PROFILING_ENABLE };
+            bool isOutOfOrder{ (mDevices.front().getInfo<CL_DEVICE_QUEUE_ON_HOST_PROPERTIES>() & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE) != 0 };
+            if (isOutOfOrder) {
+                queueProperties |= CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE;
+            }
+            mCmdQueue = cl::CommandQueue(mCtx, queueProperties);
+            mFrameGraph = FrameGraph(mCmdQueue);
+            Log("CursedRay: using an %s command queue", isOutOfOrder ? "out-of-order" : "in-order");
+
+            mArena = DeviceArena(mCtx, mDevices.front(), DEFAULT_ARENA_BLOCK_SIZE);
+
+            std::size_t numPixels{ static_cast<std::size_t>(mFramebuffer.GetWidth()) * mFramebuffer.GetHeight() };
+            std::size_t framebufferSize{ numPixels * mFramebuffer.GetNumChannels() * GetBytesPerChannel(mOptions.mFramebufferFormat) };
+            for (cl::Buffer& target : mHWFramebuffers) {
+                target = mArena.Allocate(framebufferSize, CL_MEM_WRITE_ONLY);
+                if (mOptions.mFramebufferFormat == PixelFormat::RGBA8) {
+                    mCmdQueue.enqueueWriteBuffer(target, CL_TRUE, 0, framebuffer.GetSizeInBytes(), framebuffer.GetData());
+                }
+            }
+
+            mHWAccumulation = mArena.Allocate(numPixels * sizeof(glm::vec4));
+            mHWAlbedo = mArena.Allocate(numPixels * sizeof(glm::vec4));
+            mHWNormal = mArena.Allocate(numPixels * sizeof(glm::vec4));
+            mHWDepth = mArena.Allocate(numPixels * sizeof(float));
+            for (cl::Buffer& target : mHWDenoiseTargets) {
+                target = mArena.Allocate(numPixels * sizeof(glm::vec4));
+            }
+            mHWHistory = mArena.Allocate(numPixels * sizeof(glm::vec4));
+            mHWPreviousNormal = mArena.Allocate(numPixels * sizeof(glm::vec4));
+            mHWPreviousDepth = mArena.Allocate(numPixels * sizeof(float));
+            mHWLaneStats = mArena.Allocate(2 * sizeof(std::uint32_t));
+            mHWWorkCounter = mArena.Allocate(sizeof(std::uint32_t));
+
+            mHWSpheres = mArena.Allocate(scene.GetSizeInBytes(), CL_MEM_READ_ONLY);
+            mCmdQueue.enqueueWriteBuffer(mHWSpheres, CL_TRUE, 0, scene.GetSizeInBytes(), scene.GetSpheres().data());
+            mHWBvhNodes = mArena.Allocate(mBvh.GetNodesSizeInBytes(), CL_MEM_READ_ONLY);
+            mCmdQueue.enqueueWriteBuffer(mHWBvhNodes, CL_TRUE, 0, mBvh.GetNodesSizeInBytes(), mBvh.GetNodes().data());
 
-            mClearColorProgram = cl::Program(mCtx, ReadTextFile(KERNEL_CLEAR_COLOR_PATH));
-            BuildProgram(mDevices, mClearColorProgram);
+            // zero-sized buffers are invalid, scenes without emitters still get one dummy entry
+            mHWLightNodes = mArena.Allocate(std::max<std::size_t>(mLightTree.GetNodesSizeInBytes(), sizeof(LightNode)), CL_MEM_READ_ONLY);
+            mHWLights = mArena.Allocate(std::max<std::size_t>(mLightTree.GetLightsSizeInBytes(), sizeof(Light)), CL_MEM_READ_ONLY);
+            if (mNumLights > 0) {
+                mCmdQueue.enqueueWriteBuffer(mHWLightNodes, CL_TRUE, 0, mLightTree.GetNodesSizeInBytes(), mLightTree.GetNodes().data());
+                mCmdQueue.enqueueWriteBuffer(mHWLights, CL_TRUE, 0, mLightTree.GetLightsSizeInBytes(), mLightTree.GetLights().data());
+            }
+
+            const EnvironmentMap& environment{ context.mEnvironment };
+            mHWEnvironment = mArena.Allocate(std::max<std::size_t>(environment.GetPixelsSizeInBytes(), sizeof(std::uint16_t)), CL_MEM_READ_ONLY);
+            mHWEnvironmentAlias = mArena.Allocate(std::max<std::size_t>(environment.GetAliasSizeInBytes(), sizeof(EnvironmentAlias)), CL_MEM_READ_ONLY);
+            if (!environment.IsEmpty()) {
+                mCmdQueue.enqueueWriteBuffer(mHWEnvironment, CL_TRUE, 0, environment.GetPixelsSizeInBytes(), environment.GetPixels().data());
+                mCmdQueue.enqueueWriteBuffer(mHWEnvironmentAlias, CL_TRUE, 0, environment.GetAliasSizeInBytes(), environment.GetAlias().data());
+            }
+
+            // sampler tables are uploaded once and bound as __constant for the lifetime of the device
+            std::vector<std::uint32_t> sobolDirections{ GenerateSobolDirections() };
+            std::vector<std::uint32_t> blueNoise{ GenerateBlueNoise(BLUE_NOISE_SIZE) };
+            mHWSobolDirections = mArena.Allocate(sobolDirections.size() * sizeof(std::uint32_t), CL_MEM_READ_ONLY);
+            mHWBlueNoise = mArena.Allocate(blueNoise.size() * sizeof(std::uint32_t), CL_MEM_READ_ONLY);
+            mCmdQueue.enqueueWriteBuffer(mHWSobolDirections, CL_TRUE, 0, sobolDirections.size() * sizeof(std::uint32_t), sobolDirections.data());
+            mCmdQueue.enqueueWriteBuffer(mHWBlueNoise, CL_TRUE, 0, blueNoise.size() * sizeof(std::uint32_t), blueNoise.data());
+
+            CreateKernels();
 
-            mHWFramebuffer = cl::Buffer(mCtx, CL_MEM_WRITE_ONLY, mFramebuffer.GetWidth() *
-                                                                                       mFramebuffer.GetHeight() *
-                                                                                       mFramebuffer.GetNumChannels());
-            cl::copy(mCmdQueue, framebuffer.cbegin(), framebuffer.cend(), mHWFramebuffer);
+            // every launch made while tuning writes into buffers that are reset or overwritten before they are read
+            Autotuner autotuner(mDevices.front(), mOptions.mTuningCacheFile.c_str(), mOptions.mRetune);
+            std::uint32_t width{ mFramebuffer.GetWidth() };
+            std::uint32_t height{ mFramebuffer.GetHeight() };
+            mClearColorTile = autotuner.Tune(mCmdQueue, mClearColorKernel, Autotuner::Hash(context.mClearColorSource),
+                                             KERNEL_CLEAR_COLOR_NAME, width, height);
+            if (mOptions.mIntegrator == IntegratorType::PerPixel) {
+                mPathTraceTile = autotuner.Tune(mCmdQueue, mPathTraceKernel, Autotuner::Hash(context.mPathTraceSource + context.mBuildOptions),
+                                                KERNEL_PATH_TRACE_NAME, width, height);
+            }
+            mReprojectTile = autotuner.Tune(mCmdQueue, mReprojectKernel, Autotuner::Hash(context.mReprojectSource),
+                                            KERNEL_REPROJECT_NAME, width, height);
+            if (mOptions.mDenoiseIterations > 0) {
+                mDenoiseTile = autotuner.Tune(mCmdQueue, mDenoiseKernels[0], Autotuner::Hash(context.mDenoiseSource),
+                                              KERNEL_DENOISE_NAME, width, height);
+            }
+            mTonemapTile = autotuner.Tune(mCmdQueue, mTonemapKernels[0], Autotuner::Hash(context.mTonemapSource),
+                                          GetResolveKernelName(mOptions.mFramebufferFormat), width, height);
+            autotuner.Save();
+
+            ResetAccumulation();
+            mArena.LogUsage();
         }
         catch (const cl::Error& err) {
             Log("CursedRay: OpenCL Error: %s", err.what());
         }
     }
 
+    ////////////////////////////////////////
+    void HWDevice::CreateKernels()
+    {
+        // kernel objects live as long as the device, only arguments that change per frame are set again
+        // per-frame arguments start out with neutral values so that every kernel can be launched right away
+        Camera camera(DEFAULT_CAMERA_POSITION, DEFAULT_CAMERA_FOCAL_LENGTH);
+
+        mClearColorKernel = cl::Kernel(mClearColorProgram, KERNEL_CLEAR_COLOR_NAME);
+        mClearColorKernel.setArg(0, mHWFramebuffers[0]);
+        mClearColorKernel.setArg(1, mFramebuffer.GetWidth());
+        mClearColorKernel.setArg(2, mFramebuffer.GetHeight());
+        mClearColorKernel.setArg(3, mClearColor.r);
+        mClearColorKernel.setArg(4, mClearColor.g);
+        mClearColorKernel.setArg(5, mClearColor.b);
+        mClearColorKernel.setArg(6, mClearColor.a);
+
+        bool persistent{ mOptions.mIntegrator == IntegratorType::Persistent };
+        mPathTraceKernel = cl::Kernel(persistent ? mPathTracePersistentProgram : mPathTraceProgram,
+                                      persistent ? KERNEL_PATH_TRACE_PERSISTENT_NAME : KERNEL_PATH_TRACE_NAME);
+        mPathTraceKernel.setArg(4, mHWSpheres);
+        mPathTraceKernel.setArg(5, mHWBvhNodes);
+        mPathTraceKernel.setArg(6, mHWLightNodes);
+        mPathTraceKernel.setArg(7, mHWLights);
+        mPathTraceKernel.setArg(8, mNumLights);
+        mPathTraceKernel.setArg(9, static_cast<std::uint32_t>(mOptions.mNextEventEstimation));
+        mPathTraceKernel.setArg(10, mRenderWidth);
+        mPathTraceKernel.setArg(11, mRenderHeight);
+        mPathTraceKernel.setArg(12, cl_uint4{ { 0, 0, mRenderWidth, mRenderHeight } });
+        mPathTraceKernel.setArg(13, std::uint32_t{});
+        mPathTraceKernel.setArg(14, std::uint32_t{});
+        mPathTraceKernel.setArg(15, mOptions.mSamplesPerPixel);
+        mPathTraceKernel.setArg(16, mOptions.mMaxDepth);
+        mPathTraceKernel.setArg(17, mOptions.mRouletteDepth);
+        mPathTraceKernel.setArg(18, mHWSobolDirections);
+        mPathTraceKernel.setArg(19, mHWBlueNoise);
+        mPathTraceKernel.setArg(20, static_cast<std::uint32_t>(mOptions.mSampler));
+        SetCameraArgs(mPathTraceKernel, 21, camera);
+        mPathTraceKernel.setArg(25, mClearColor);
+        mPathTraceKernel.setArg(26, mHWEnvironment);
+        mPathTraceKernel.setArg(27, mHWEnvironmentAlias);
+        mPathTraceKernel.setArg(28, mEnvironmentWidth);
+        mPathTraceKernel.setArg(29, mEnvironmentHeight);
+        mPathTraceKernel.setArg(30, mHWLaneStats);
+        if (persistent) {
+            mPathTraceKernel.setArg(31, mHWWorkCounter);
+        }
+
+        mReprojectKernel = cl::Kernel(mReprojectProgram, KERNEL_REPROJECT_NAME);
+        mReprojectKernel.setArg(6, mRenderWidth);
+        mReprojectKernel.setArg(7, mRenderHeight);
+        SetCameraArgs(mReprojectKernel, 8, camera);
+        SetCameraArgs(mReprojectKernel, 12, camera);
+        mReprojectKernel.setArg(16, static_cast<float>(mOptions.mMaxHistorySamples));
+        mReprojectKernel.setArg(17, DEFAULT_REPROJECTION_DEPTH_THRESHOLD);
+        mReprojectKernel.setArg(18, DEFAULT_REPROJECTION_NORMAL_THRESHOLD);
+
+        for (std::uint32_t pass{}; pass < mOptions.mDenoiseIterations; ++pass) {
+            // sharpen the color edge-stopping function as the filter footprint grows
+            float sigmaColor{ DEFAULT_DENOISE_SIGMA_COLOR / static_cast<float>(1 << pass) };
+
+            cl::Kernel& kernel{ mDenoiseKernels[pass] };
+            kernel = cl::Kernel(mDenoiseProgram, KERNEL_DENOISE_NAME);
+            if (pass > 0) {
+                kernel.setArg(0, mHWDenoiseTargets[(pass - 1) % 2]);
+            }
+            kernel.setArg(1, mHWDenoiseTargets[pass % 2]);
+            kernel.setArg(2, mHWAlbedo);
+            kernel.setArg(5, mRenderWidth);
+            kernel.setArg(6, mRenderHeight);
+            kernel.setArg(7, std::int32_t{ 1 << pass });
+            kernel.setArg(8, sigmaColor);
+            kernel.setArg(9, DEFAULT_DENOISE_SIGMA_ALBEDO);
+            kernel.setArg(10, DEFAULT_DENOISE_SIGMA_NORMAL);
+            kernel.setArg(11, DEFAULT_DENOISE_SIGMA_DEPTH);
+        }
+
+        const char* tonemapName{ GetResolveKernelName(mOptions.mFramebufferFormat) };
+        std::uint32_t iterations{ mOptions.mDenoiseIterations };
+        for (std::size_t slot{}; slot < mTonemapKernels.size(); ++slot) {
+            cl::Kernel& kernel{ mTonemapKernels[slot] };
+            kernel = cl::Kernel(mTonemapProgram, tonemapName);
+            if (iterations > 0) {
+                kernel.setArg(0, mHWDenoiseTargets[(iterations - 1) % 2]);
+            }
+            kernel.setArg(1, mHWFramebuffers[slot]);
+            kernel.setArg(2, mFramebuffer.GetWidth());
+            kernel.setArg(3, mFramebuffer.GetHeight());
+            kernel.setArg(4, mRenderWidth);
+            kernel.setArg(5, mRenderHeight);
+        }
+
+        BindFrameBuffers();
+    }
+
+    ////////////////////////////////////////
+    void HWDevice::BindFrameBuffers()
+    {
+        // the buffers PushHistory swaps, everything else was bound once in CreateKernels
+        mPathTraceKernel.setArg(0, mHWAccumulation);
+        mPathTraceKernel.setArg(1, mHWAlbedo);
+        mPathTraceKernel.setArg(2, mHWNormal);
+        mPathTraceKernel.setArg(3, mHWDepth);
+
+        mReprojectKernel.setArg(0, mHWAccumulation);
+        mReprojectKernel.setArg(1, mHWHistory);
+        mReprojectKernel.setArg(2, mHWNormal);
+        mReprojectKernel.setArg(3, mHWDepth);
+        mReprojectKernel.setArg(4, mHWPreviousNormal);
+        mReprojectKernel.setArg(5, mHWPreviousDepth);
+
+        for (std::uint32_t pass{}; pass < mOptions.mDenoiseIterations; ++pass) {
+            if (pass == 0) {
+                mDenoiseKernels[pass].setArg(0, mHWAccumulation);
+            }
+            mDenoiseKernels[pass].setArg(3, mHWNormal);
+            mDenoiseKernels[pass].setArg(4, mHWDepth);
+        }
+
+        if (mOptions.mDenoiseIterations == 0) {
+            for (cl::Kernel& kernel : mTonemapKernels) {
+                kernel.setArg(0, mHWAccumulation);
+            }
+        }
+    }
+
+    ////////////////////////////////////////
+    void HWDevice::RecordResolveGraph(CommandGraph& graph, std::uint32_t slot)
+    {
+        for (std::uint32_t pass{}; pass < mOptions.mDenoiseIterations; ++pass) {
+            graph.RecordKernel(mDenoiseKernels[pass], GetGlobalRange(mDenoiseTile, mRenderWidth, mRenderHeight), GetLocalRange(mDenoiseTile));
+        }
+        graph.RecordKernel(mTonemapKernels[slot],
+                           GetGlobalRange(mTonemapTile, mFramebuffer.GetWidth(), mFramebuffer.GetHeight()),
+                           GetLocalRange(mTonemapTile));
+        graph.Finalize();
+    }
+
     ////////////////////////////////////////
     std::vector<cl::Event> HWDevice::EnqueueClearColor(const glm::vec4& clearColor,
                                                        const std::vector<cl::Event>& events)
     {
         try {
-            cl::Kernel kernel(mClearColorProgram, KERNEL_CLEAR_COLOR_NAME);
-            kernel.setArg(0, mHWFramebuffer);
-            kernel.setArg(1, mFramebuffer.GetWidth());
-            kernel.setArg(2, mFramebuffer.GetHeight());
-            kernel.setArg(3, clearColor.r);
-            kernel.setArg(4, clearColor.g);
-            kernel.setArg(5, clearColor.b);
-            kernel.setArg(6, clearColor.a);
+            const cl::Buffer& target{ mHWFramebuffers[mResolvedFrames % 2] };
+            return mFrameGraph.AddPass({}, { target }, [&](const std::vector<cl::Event>& waitList) -> std::vector<cl::Event> {
+                // the float formats hold linear values, a plain fill with the encoded pattern is enough
+                cl::Event event;
+                std::size_t numPixels{ static_cast<std::size_t>(mFramebuffer.GetWidth()) * mFramebuffer.GetHeight() };
+                if (mOptions.mFramebufferFormat == PixelFormat::RGBA16F) {
+                    cl_ushort4 pattern{ { FloatToHalf(clearColor.r), FloatToHalf(clearColor.g),
+                                          FloatToHalf(clearColor.b), FloatToHalf(clearColor.a) } };
+                    mCmdQueue.enqueueFillBuffer(target, pattern, 0, numPixels * sizeof(pattern), &waitList, &event);
+                    return { event };
+                }
+                if (mOptions.mFramebufferFormat == PixelFormat::RGBA32F) {
+                    mCmdQueue.enqueueFillBuffer(target, clearColor, 0, numPixels * sizeof(clearColor), &waitList, &event);
+                    return { event };
+                }
+
+                if (clearColor != mClearColor) {
+                    mClearColor = clearColor;
+                    mClearColorKernel.setArg(3, clearColor.r);
+                    mClearColorKernel.setArg(4, clearColor.g);
+                    mClearColorKernel.setArg(5, clearColor.b);
+                    mClearColorKernel.setArg(6, clearColor.a);
+                }
+                mClearColorKernel.setArg(0, target);
+                mCmdQueue.enqueueNDRangeKernel(mClearColorKernel,
+                                               cl::NullRange,
+                                               GetGlobalRange(mClearColorTile, mFramebuffer.GetWidth(), mFramebuffer.GetHeight()),
+                                               GetLocalRange(mClearColorTile),
+                                               &waitList,
+                                               &event);
+                return { event };
+            }, events);
+        }
+        catch (const cl::Error& err) {
+            Log("CursedRay: OpenCL Error: %s", err.what());
+        }
+        return {};
+    }
+
+    ////////////////////////////////////////
+    std::vector<cl::Event> HWDevice::EnqueuePathTrace(const Camera& camera,
+                                                      const glm::vec4& clearColor,
+                                                      const std::vector<cl::Event>& events)
+    {
+        try {
+            mPathTraceKernel.setArg(13, mFrameIndex++);
+            mPathTraceKernel.setArg(14, mSampleIndex);
+            SetCameraArgs(mPathTraceKernel, 21, camera);
+            mPathTraceKernel.setArg(25, clearColor);
+            mSampleIndex += mOptions.mSamplesPerPixel;
+
+            bool persistent{ mOptions.mIntegrator == IntegratorType::Persistent };
+            std::vector<cl::Buffer> writes{ mHWAccumulation, mHWAlbedo, mHWNormal, mHWDepth, mHWLaneStats };
+            if (persistent) {
+                writes.push_back(mHWWorkCounter);
+            }
+
+            // the scene buffers change under EnqueueSceneUpdate, tracing has to wait for those writes
+            std::vector<cl::Buffer> reads{ mHWSpheres, mHWBvhNodes, mHWLightNodes };
+            return mFrameGraph.AddPass(reads, writes, [&](const std::vector<cl::Event>& waitList) -> std::vector<cl::Event> {
+                std::vector<cl::Event> traceWaitList{ waitList };
+                cl::Event fillEvent;
+                mCmdQueue.enqueueFillBuffer(mHWLaneStats, std::uint32_t{}, 0, 2 * sizeof(std::uint32_t), &waitList, &fillEvent);
+                traceWaitList.push_back(fillEvent);
+
+                cl::Event event;
+                if (persistent) {
+                    // enough resident groups to fill the device, each one loops until the counter runs dry
+                    mCmdQueue.enqueueFillBuffer(mHWWorkCounter, std::uint32_t{}, 0, sizeof(std::uint32_t), &waitList, &fillEvent);
+                    traceWaitList.push_back(fillEvent);
+
+                    std::size_t groupSize{ std::min<std::size_t>(DEFAULT_PERSISTENT_GROUP_SIZE,
+                                                                 mPathTraceKernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(mDevices.front())) };
+                    std::size_t computeUnits{ mDevices.front().getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>() };
+                    std::size_t numGroups{ std::max<std::size_t>(computeUnits, 1) * DEFAULT_PERSISTENT_GROUPS_PER_UNIT };
+                    mCmdQueue.enqueueNDRangeKernel(mPathTraceKernel,
+                                                   cl::NullRange,
+                                                   cl::NDRange(numGroups * groupSize),
+                                                   cl::NDRange(groupSize),
+                                                   &traceWaitList,
+                                                   &event);
+                }
+                else {
+                    mCmdQueue.enqueueNDRangeKernel(mPathTraceKernel,
+                                                   cl::NullRange,
+                                                   GetGlobalRange(mPathTraceTile, mRenderWidth, mRenderHeight),
+                                                   GetLocalRange(mPathTraceTile),
+                                                   &traceWaitList,
+                                                   &event);
+                }
+                return { event };
+            }, events);
+        }
+        catch (const cl::Error& err) {
+            Log("CursedRay: OpenCL Error: %s", err.what());
+        }
+        return {};
+    }
+
+    ////////////////////////////////////////
+    std::vector<cl::Event> HWDevice::EnqueueSceneUpdate(const Scene& scene, const std::vector<cl::Event>& events)
+    {
+        const std::vector<std::uint32_t>& dirtySpheres{ scene.GetDirtySpheres() };
+        if (dirtySpheres.empty()) {
+            return {};
+        }
+
+        try {
+            std::vector<std::uint32_t> refitNodes;
+            mBvh.Refit(scene, dirtySpheres, refitNodes);
+            if (mBvh.NeedsRebuild()) {
+                // same sphere count, same node count, the rebuilt tree overwrites the old one in place
+                Log("CursedRay: scene BVH nodes grew by %.2fx since the last build, rebuilding", mBvh.GetInflation());
+                mBvh = SceneBvh(scene);
+                refitNodes.resize(mBvh.GetNodes().size());
+                std::iota(refitNodes.begin(), refitNodes.end(), 0u);
+            }
+
+            const std::vector<Sphere>& spheres{ scene.GetSpheres() };
+            bool emittersMoved{ std::any_of(dirtySpheres.begin(), dirtySpheres.end(), [&](std::uint32_t index) {
+                return spheres[index].mEmission.w >= 0.0f;
+            }) };
+            if (emittersMoved) {
+                mLightTree.Refit(scene);
+            }
 
-            cl::Event event;
-            mCmdQueue.enqueueNDRangeKernel(kernel,
-                                           cl::NullRange,
-                                           cl::NDRange(mFramebuffer.GetWidth(), mFramebuffer.GetHeight()),
-                                           cl::NullRange,
-                                           &events,
-                                           &event);
-            return { event };
+            // the slot was last used DEFAULT_FRAMES_IN_FLIGHT updates ago, its writes have normally long completed
+            SceneUpload& upload{ mSceneUploads[mNumSceneUploads++ % mSceneUploads.size()] };
+            if (!upload.mEvents.empty()) {
+                cl::Event::waitForEvents(upload.mEvents);
+            }
+            upload.mData.clear();
+            upload.mRanges.clear();
+
+            std::vector<cl::Buffer> writes{ mHWSpheres, mHWBvhNodes };
+            StageRanges(upload, mHWSpheres, dirtySpheres, sizeof(Sphere), spheres.data());
+            StageRanges(upload, mHWBvhNodes, refitNodes, sizeof(BvhNode), mBvh.GetNodes().data());
+            if (emittersMoved) {
+                std::vector<std::uint32_t> lightNodes(mLightTree.GetNodes().size());
+                std::iota(lightNodes.begin(), lightNodes.end(), 0u);
+                StageRanges(upload, mHWLightNodes, lightNodes, sizeof(LightNode), mLightTree.GetNodes().data());
+                writes.push_back(mHWLightNodes);
+            }
+
+            upload.mEvents = mFrameGraph.AddPass({}, writes, [&](const std::vector<cl::Event>& waitList) -> std::vector<cl::Event> {
+                std::vector<cl::Event> writeEvents;
+                for (const SceneUpload::Range& range : upload.mRanges) {
+                    cl::Event event;
+                    mCmdQueue.enqueueWriteBuffer(range.mBuffer, CL_FALSE, range.mOffset, range.mSize,
+                                                 upload.mData.data() + range.mStagingOffset, &waitList, &event);
+                    writeEvents.push_back(event);
+                }
+                return writeEvents;
+            }, events);
+            return upload.mEvents;
         }
         catch (const cl::Error& err) {
             Log("CursedRay: OpenCL Error: %s", err.what());
@@ -100,6 +609,280 @@ namespace CursedRay
         return {};
     }
 
+    ////////////////////////////////////////
+    double HWDevice::ReadLaneUtilization()
+    {
+        try {
+            std::array<std::uint32_t, 2> laneStats{};
+            mFrameGraph.AddPass({ mHWLaneStats }, {}, [&](const std::vector<cl::Event>& waitList) -> std::vector<cl::Event> {
+                cl::Event event;
+                mCmdQueue.enqueueReadBuffer(mHWLaneStats, CL_TRUE, 0, sizeof(laneStats), laneStats.data(), &waitList, &event);
+                return { event };
+            });
+            return laneStats[1] > 0 ? static_cast<double>(laneStats[0]) / static_cast<double>(laneStats[1]) : 0.0;
+        }
+        catch (const cl::Error& err) {
+            Log("CursedRay: OpenCL Error: %s", err.what());
+        }
+        return 0.0;
+    }
+
+    ////////////////////////////////////////
+    std::vector<cl::Event> HWDevice::EnqueueReprojection(const Camera& camera,
+                                                         const Camera& previousCamera,
+                                                         const std::vector<cl::Event>& events)
+    {
+        try {
+            SetCameraArgs(mReprojectKernel, 8, camera);
+            SetCameraArgs(mReprojectKernel, 12, previousCamera);
+
+            std::vector<cl::Buffer> reads{ mHWHistory, mHWPreviousNormal, mHWPreviousDepth, mHWNormal, mHWDepth };
+            return mFrameGraph.AddPass(reads, { mHWAccumulation }, [&](const std::vector<cl::Event>& waitList) -> std::vector<cl::Event> {
+                cl::Event event;
+                mCmdQueue.enqueueNDRangeKernel(mReprojectKernel,
+                                               cl::NullRange,
+                                               GetGlobalRange(mReprojectTile, mRenderWidth, mRenderHeight),
+                                               GetLocalRange(mReprojectTile),
+                                               &waitList,
+                                               &event);
+                return { event };
+            }, events);
+        }
+        catch (const cl::Error& err) {
+            Log("CursedRay: OpenCL Error: %s", err.what());
+        }
+        return {};
+    }
+
+    ////////////////////////////////////////
+    std::vector<cl::Event> HWDevice::EnqueueResolve(const std::vector<cl::Event>& events)
+    {
+        try {
+            // denoise and tonemap only touch buffers that are fixed per history parity and framebuffer slot,
+            // so each combination is recorded once
+            std::uint32_t slot{ mResolvedFrames % 2 };
+            CommandGraph& graph{ mResolveGraphs[mHistoryParity * 2 + slot] };
+            if (!graph.IsFinalized()) {
+                graph = CommandGraph(mCmdQueue, mDevices.front());
+                RecordResolveGraph(graph, slot);
+                mIsResolveGraphNative = graph.IsNative();
+            }
+
+            std::vector<cl::Buffer> reads{ mHWAccumulation, mHWAlbedo, mHWNormal, mHWDepth };
+            std::vector<cl::Buffer> writes{ mHWDenoiseTargets[0], mHWDenoiseTargets[1], mHWFramebuffers[slot] };
+            std::vector<cl::Event> resolveEvents{ mFrameGraph.AddPass(reads, writes, [&graph](const std::vector<cl::Event>& waitList) {
+                return graph.Enqueue(waitList);
+            }, events) };
+            mIsResolveGraphNative = graph.IsNative();
+            ++mResolvedFrames;
+            return resolveEvents;
+        }
+        catch (const cl::Error& err) {
+            Log("CursedRay: OpenCL Error: %s", err.what());
+        }
+        return {};
+    }
+
+    ////////////////////////////////////////
+    void HWDevice::ResetAccumulation()
+    {
+        try {
+            std::size_t numPixels{ static_cast<std::size_t>(mFramebuffer.GetWidth()) * mFramebuffer.GetHeight() };
+            mFrameGraph.AddPass({}, { mHWAccumulation }, [&](const std::vector<cl::Event>& waitList) -> std::vector<cl::Event> {
+                cl::Event event;
+                mCmdQueue.enqueueFillBuffer(mHWAccumulation, 0.0f, 0, numPixels * sizeof(glm::vec4), &waitList, &event);
+                return { event };
+            });
+            mSampleIndex = 0;
+        }
+        catch (const cl::Error& err) {
+            Log("CursedRay: OpenCL Error: %s", err.what());
+        }
+    }
+
+    ////////////////////////////////////////
+    bool HWDevice::SetRenderSize(std::uint32_t width, std::uint32_t height, std::uint32_t samplesPerPixel)
+    {
+        // the buffers were sized for the framebuffer, any smaller size fits without reallocating
+        width = std::clamp<std::uint32_t>(width, 1, mFramebuffer.GetWidth());
+        height = std::clamp<std::uint32_t>(height, 1, mFramebuffer.GetHeight());
+        bool resized{ width != mRenderWidth || height != mRenderHeight };
+        try {
+            if (samplesPerPixel != mOptions.mSamplesPerPixel) {
+                // accumulation weighs every pixel by its own sample count, no restart needed
+                mOptions.mSamplesPerPixel = samplesPerPixel;
+                mPathTraceKernel.setArg(15, samplesPerPixel);
+            }
+            if (!resized) {
+                return false;
+            }
+
+            mRenderWidth = width;
+            mRenderHeight = height;
+            mPathTraceKernel.setArg(10, mRenderWidth);
+            mPathTraceKernel.setArg(11, mRenderHeight);
+            mPathTraceKernel.setArg(12, cl_uint4{ { 0, 0, mRenderWidth, mRenderHeight } });
+            mReprojectKernel.setArg(6, mRenderWidth);
+            mReprojectKernel.setArg(7, mRenderHeight);
+            for (std::uint32_t pass{}; pass < mOptions.mDenoiseIterations; ++pass) {
+                mDenoiseKernels[pass].setArg(5, mRenderWidth);
+                mDenoiseKernels[pass].setArg(6, mRenderHeight);
+            }
+            for (cl::Kernel& kernel : mTonemapKernels) {
+                kernel.setArg(4, mRenderWidth);
+                kernel.setArg(5, mRenderHeight);
+            }
+
+            // recorded arguments and ranges are stale now, the next resolve records them again
+            for (CommandGraph& graph : mResolveGraphs) {
+                graph = CommandGraph();
+            }
+            Log("CursedRay: rendering at %ux%u with %u samples per pixel", mRenderWidth, mRenderHeight, samplesPerPixel);
+        }
+        catch (const cl::Error& err) {
+            Log("CursedRay: OpenCL Error: %s", err.what());
+        }
+
+        // pixels are laid out by the render width, neither the accumulation nor the history carries over
+        ResetAccumulation();
+        return true;
+    }
+
+    ////////////////////////////////////////
+    void HWDevice::SetViewport(std::uint32_t x, std::uint32_t y, std::uint32_t imageWidth, std::uint32_t imageHeight)
+    {
+        // buffers stay indexed by the render size, only rays and sampler seeds follow the image
+        try {
+            mPathTraceKernel.setArg(12, cl_uint4{ { x, y, imageWidth, imageHeight } });
+        }
+        catch (const cl::Error& err) {
+            Log("CursedRay: OpenCL Error: %s", err.what());
+        }
+    }
+
+    ////////////////////////////////////////
+    std::size_t HWDevice::GetBytesPerPixel(const HWDeviceOptions& options)
+    {
+        // mirrors the per-pixel allocations of the constructor: two framebuffer slots, seven float4 buffers
+        // (accumulation, albedo, normal, two denoise targets, history, previous normal), two depth buffers
+        // and the host staging of the float formats
+        std::size_t framebufferSize{ 4 * std::size_t{ GetBytesPerChannel(options.mFramebufferFormat) } };
+        std::size_t deviceSize{ 2 * framebufferSize + 7 * sizeof(glm::vec4) + 2 * sizeof(float) };
+        std::size_t stagingSize{};
+        if (options.mFramebufferFormat == PixelFormat::RGBA16F) {
+            stagingSize += 4 * GetBytesPerChannel(PixelFormat::RGBA16F);
+        }
+        if (options.mFramebufferFormat != PixelFormat::RGBA8) {
+            stagingSize += 4 * GetBytesPerChannel(PixelFormat::RGBA32F);
+        }
+        return deviceSize + stagingSize;
+    }
+
+    ////////////////////////////////////////
+    void HWDevice::SeekSamples(std::uint32_t sampleIndex)
+    {
+        // the frame index seeds the random sampler, keep it unique per batch as well
+        mSampleIndex = sampleIndex;
+        mFrameIndex = sampleIndex / std::max<std::uint32_t>(mOptions.mSamplesPerPixel, 1);
+    }
+
+    ////////////////////////////////////////
+    void HWDevice::SetSamplerState(std::uint32_t sampleIndex, std::uint32_t frameIndex)
+    {
+        mSampleIndex = sampleIndex;
+        mFrameIndex = frameIndex;
+    }
+
+    ////////////////////////////////////////
+    void HWDevice::ReadAccumulation(std::vector<glm::vec4>& accumulation)
+    {
+        try {
+            accumulation.resize(static_cast<std::size_t>(mFramebuffer.GetWidth()) * mFramebuffer.GetHeight());
+            mFrameGraph.AddPass({ mHWAccumulation }, {}, [&](const std::vector<cl::Event>& waitList) -> std::vector<cl::Event> {
+                cl::Event event;
+                mCmdQueue.enqueueReadBuffer(mHWAccumulation, CL_TRUE, 0, accumulation.size() * sizeof(glm::vec4),
+                                            accumulation.data(), &waitList, &event);
+                return { event };
+            });
+        }
+        catch (const cl::Error& err) {
+            Log("CursedRay: OpenCL Error: %s", err.what());
+        }
+    }
+
+    ////////////////////////////////////////
+    std::vector<cl::Event> HWDevice::EnqueueReadAccumulation(glm::vec4* accumulation)
+    {
+        try {
+            // non-blocking, the next trace waits for the read through the frame graph instead of the host
+            std::size_t numPixels{ static_cast<std::size_t>(mFramebuffer.GetWidth()) * mFramebuffer.GetHeight() };
+            return mFrameGraph.AddPass({ mHWAccumulation }, {}, [&](const std::vector<cl::Event>& waitList) -> std::vector<cl::Event> {
+                cl::Event event;
+                mCmdQueue.enqueueReadBuffer(mHWAccumulation, CL_FALSE, 0, numPixels * sizeof(glm::vec4), accumulation, &waitList, &event);
+                return { event };
+            });
+        }
+        catch (const cl::Error& err) {
+            Log("CursedRay: OpenCL Error: %s", err.what());
+        }
+        return {};
+    }
+
+    ////////////////////////////////////////
+    std::vector<cl::Event> HWDevice::EnqueueReadFramebuffer(void* pixels)
+    {
+        try {
+            // the most recently resolved slot, in the device's framebuffer format; the frame graph keeps
+            // the resolve after next from overwriting the slot before this read is done
+            const cl::Buffer& source{ mHWFramebuffers[(mResolvedFrames + 1) % 2] };
+            std::size_t numPixels{ static_cast<std::size_t>(mFramebuffer.GetWidth()) * mFramebuffer.GetHeight() };
+            std::size_t size{ numPixels * mFramebuffer.GetNumChannels() * GetBytesPerChannel(mOptions.mFramebufferFormat) };
+            return mFrameGraph.AddPass({ source }, {}, [&](const std::vector<cl::Event>& waitList) -> std::vector<cl::Event> {
+                cl::Event event;
+                mCmdQueue.enqueueReadBuffer(source, CL_FALSE, 0, size, pixels, &waitList, &event);
+                return { event };
+            });
+        }
+        catch (const cl::Error& err) {
+            Log("CursedRay: OpenCL Error: %s", err.what());
+        }
+        return {};
+    }
+
+    ////////////////////////////////////////
+    void HWDevice::WriteAccumulation(const glm::vec4* accumulation)
+    {
+        try {
+            std::size_t numPixels{ static_cast<std::size_t>(mFramebuffer.GetWidth()) * mFramebuffer.GetHeight() };
+            mFrameGraph.AddPass({}, { mHWAccumulation }, [&](const std::vector<cl::Event>& waitList) -> std::vector<cl::Event> {
+                cl::Event event;
+                mCmdQueue.enqueueWriteBuffer(mHWAccumulation, CL_TRUE, 0, numPixels * sizeof(glm::vec4), accumulation, &waitList, &event);
+                return { event };
+            });
+        }
+        catch (const cl::Error& err) {
+            Log("CursedRay: OpenCL Error: %s", err.what());
+        }
+    }
+
+    ////////////////////////////////////////
+    void HWDevice::PushHistory()
+    {
+        // the current frame becomes the history the next trace reprojects from
+        std::swap(mHWAccumulation, mHWHistory);
+        std::swap(mHWNormal, mHWPreviousNormal);
+        std::swap(mHWDepth, mHWPreviousDepth);
+        mHistoryParity ^= 1;
+
+        try {
+            BindFrameBuffers();
+        }
+        catch (const cl::Error& err) {
+            Log("CursedRay: OpenCL Error: %s", err.what());
+        }
+        ResetAccumulation();
+    }
+
     ////////////////////////////////////////
     double HWDevice::Profile(const cl::Event& event) const
     {
@@ -108,6 +891,19 @@ namespace CursedRay
         return static_cast<double>(hwEnd - hwBegin);
     }
 
+    ////////////////////////////////////////
+    double HWDevice::Profile(const std::vector<cl::Event>& events) const
+    {
+        // from the first command starting to the last one ending, overlapping passes count once
+        ulong hwBegin{ std::numeric_limits<ulong>::max() };
+        ulong hwEnd{};
+        for (const cl::Event& event : events) {
+            hwBegin = std::min(hwBegin, static_cast<ulong>(event.getProfilingInfo<CL_PROFILING_COMMAND_START>()));
+            hwEnd = std::max(hwEnd, static_cast<ulong>(event.getProfilingInfo<CL_PROFILING_COMMAND_END>()));
+        }
+        return hwEnd > hwBegin ? static_cast<double>(hwEnd - hwBegin) : 0.0;
+    }
+
     ////////////////////////////////////////
     void HWDevice::LogProfile(const cl::Event& event) const
     {
@@ -129,14 +925,50 @@ namespace CursedRay
     }
 
     ////////////////////////////////////////
-    void HWDevice::Finish()
+    bool HWDevice::Finish(std::uint32_t framesInFlight)
     {
+        bool presented{};
         try {
-            mCmdQueue.finish();
-            cl::copy(mCmdQueue, mHWFramebuffer, mFramebuffer.begin(), mFramebuffer.end());
+            // present the oldest resolved frames until at most framesInFlight remain on the device
+            while (mResolvedFrames - mPresentedFrames > framesInFlight) {
+                auto readbackBegin{ std::chrono::steady_clock::now() };
+                const cl::Buffer& source{ mHWFramebuffers[mPresentedFrames % 2] };
+                mFrameGraph.AddPass({ source }, {}, [&](const std::vector<cl::Event>& waitList) -> std::vector<cl::Event> {
+                    cl::Event event;
+                    switch (mOptions.mFramebufferFormat) {
+                        case PixelFormat::RGBA8:
+                            mCmdQueue.enqueueReadBuffer(source, CL_TRUE, 0, mFramebuffer.GetSizeInBytes(), mFramebuffer.GetData(), &waitList, &event);
+                            break;
+                        case PixelFormat::RGBA16F:
+                            mCmdQueue.enqueueReadBuffer(source, CL_TRUE, 0, mHalfFramebuffer.GetSizeInBytes(), mHalfFramebuffer.GetData(), &waitList, &event);
+                            break;
+                        case PixelFormat::RGBA32F:
+                            mCmdQueue.enqueueReadBuffer(source, CL_TRUE, 0, mHDRFramebuffer.GetSizeInBytes(), mHDRFramebuffer.GetData(), &waitList, &event);
+                            break;
+                    }
+                    return { event };
+                });
+                ++mPresentedFrames;
+                presented = true;
+
+                // HDR data and the terminal preview come out of the same resolve
+                switch (mOptions.mFramebufferFormat) {
+                    case PixelFormat::RGBA8:
+                        break;
+                    case PixelFormat::RGBA16F:
+                        ConvertFramebuffer(mHalfFramebuffer, mHDRFramebuffer);
+                        ToneMapFramebuffer(mHDRFramebuffer, mFramebuffer);
+                        break;
+                    case PixelFormat::RGBA32F:
+                        ToneMapFramebuffer(mHDRFramebuffer, mFramebuffer);
+                        break;
+                }
+                PublishMetric(Metric::ReadbackTime, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - readbackBegin).count());
+            }
         }
         catch (const cl::Error& err) {
             Log("CursedRay: OpenCL Error: %s", err.what());
         }
+        return presented;
     }
 }
@@ -0,0 +1,408 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "ImageEncoder.hpp"
+#include "Log.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    static void PutU16LE(std::vector<std::uint8_t>& bytes, std::uint32_t value)
+    {
+        bytes.push_back(static_cast<std::uint8_t>(value));
+        bytes.push_back(static_cast<std::uint8_t>(value >> 8));
+    }
+
+    ////////////////////////////////////////
+    static void PutU32LE(std::vector<std::uint8_t>& bytes, std::uint32_t value)
+    {
+        for (std::uint32_t shift{}; shift < 32; shift += 8) {
+            bytes.push_back(static_cast<std::uint8_t>(value >> shift));
+        }
+    }
+
+    ////////////////////////////////////////
+    static void PutU64LE(std::vector<std::uint8_t>& bytes, std::uint64_t value)
+    {
+        for (std::uint32_t shift{}; shift < 64; shift += 8) {
+            bytes.push_back(static_cast<std::uint8_t>(value >> shift));
+        }
+    }
+
+    ////////////////////////////////////////
+    static void PutU32BE(std::vector<std::uint8_t>& bytes, std::uint32_t value)
+    {
+        for (std::uint32_t shift{ 32 }; shift > 0; shift -= 8) {
+            bytes.push_back(static_cast<std::uint8_t>(value >> (shift - 8)));
+        }
+    }
+
+    ////////////////////////////////////////
+    static void PutFloatLE(std::vector<std::uint8_t>& bytes, float value)
+    {
+        std::uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        PutU32LE(bytes, bits);
+    }
+
+    ////////////////////////////////////////
+    static void PutString(std::vector<std::uint8_t>& bytes, const char* text)
+    {
+        // including the terminator, which both EXR attribute names and types need
+        bytes.insert(bytes.end(), text, text + std::strlen(text) + 1);
+    }
+
+    ////////////////////////////////////////
+    static bool WriteFile(const char* url, const std::vector<std::uint8_t>& bytes)
+    {
+        std::FILE* fp{ std::fopen(url, "wb") };
+        if (!fp) {
+            Log("CursedRay: Failed to open %s for writing", url);
+            return false;
+        }
+        bool success{ std::fwrite(bytes.data(), 1, bytes.size(), fp) == bytes.size() };
+        success = std::fclose(fp) == 0 && success;
+        if (!success) {
+            Log("CursedRay: Failed to write %s", url);
+        }
+        return success;
+    }
+
+    ////////////////////////////////////////
+    static std::uint32_t Crc32(const std::uint8_t* data, std::size_t size)
+    {
+        static const std::array<std::uint32_t, 256> table{ [] {
+            std::array<std::uint32_t, 256> entries{};
+            for (std::uint32_t i{}; i < entries.size(); ++i) {
+                std::uint32_t crc{ i };
+                for (int bit{}; bit < 8; ++bit) {
+                    crc = (crc & 1) ? 0xedb88320u ^ (crc >> 1) : crc >> 1;
+                }
+                entries[i] = crc;
+            }
+            return entries;
+        }() };
+
+        std::uint32_t crc{ 0xffffffffu };
+        for (std::size_t i{}; i < size; ++i) {
+            crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        }
+        return crc ^ 0xffffffffu;
+    }
+
+    ////////////////////////////////////////
+    static void PutPNGChunk(std::vector<std::uint8_t>& bytes, const char* type, const std::vector<std::uint8_t>& data)
+    {
+        PutU32BE(bytes, static_cast<std::uint32_t>(data.size()));
+        std::size_t begin{ bytes.size() };
+        bytes.insert(bytes.end(), type, type + 4);
+        bytes.insert(bytes.end(), data.begin(), data.end());
+        PutU32BE(bytes, Crc32(bytes.data() + begin, bytes.size() - begin));
+    }
+
+    ////////////////////////////////////////
+    bool GetImageFormat(const std::string& url, ImageFormat& format)
+    {
+        std::size_t dot{ url.rfind('.') };
+        if (dot == std::string::npos) {
+            return false;
+        }
+        std::string extension{ url.substr(dot + 1) };
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) {
+            return static_cast<char>(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+        });
+
+        if (extension == "png") {
+            format = ImageFormat::PNG;
+            return true;
+        }
+        if (extension == "qoi") {
+            format = ImageFormat::QOI;
+            return true;
+        }
+        if (extension == "exr") {
+            format = ImageFormat::EXR;
+            return true;
+        }
+        return false;
+    }
+
+    ////////////////////////////////////////
+    bool SaveFramebufferPNG(const char* url, const DisplayFramebuffer& framebuffer)
+    {
+        // stored deflate blocks: no compression, but no zlib dependency either; QOI is the compact option
+        std::size_t rowSize{ static_cast<std::size_t>(framebuffer.GetWidth()) * 4 };
+        std::vector<std::uint8_t> scanlines;
+        scanlines.reserve((rowSize + 1) * framebuffer.GetHeight());
+        for (std::uint32_t y{}; y < framebuffer.GetHeight(); ++y) {
+            const std::uint8_t* row{ framebuffer.GetData() + y * rowSize };
+            scanlines.push_back(0);
+            scanlines.insert(scanlines.end(), row, row + rowSize);
+        }
+
+        std::vector<std::uint8_t> zlib{ 0x78, 0x01 };
+        std::uint32_t adlerA{ 1 }, adlerB{};
+        for (std::size_t offset{}; offset < scanlines.size() || offset == 0;) {
+            std::size_t blockSize{ std::min<std::size_t>(scanlines.size() - offset, 0xffff) };
+            bool isFinal{ offset + blockSize == scanlines.size() };
+            zlib.push_back(isFinal ? 1 : 0);
+            PutU16LE(zlib, static_cast<std::uint32_t>(blockSize));
+            PutU16LE(zlib, static_cast<std::uint32_t>(~blockSize & 0xffff));
+            zlib.insert(zlib.end(), scanlines.begin() + static_cast<std::ptrdiff_t>(offset),
+                        scanlines.begin() + static_cast<std::ptrdiff_t>(offset + blockSize));
+            for (std::size_t i{ offset }; i < offset + blockSize; ++i) {
+                adlerA = (adlerA + scanlines[i]) % 65521;
+                adlerB = (adlerB + adlerA) % 65521;
+            }
+            offset += blockSize;
+            if (isFinal) {
+                break;
+            }
+        }
+        PutU32BE(zlib, (adlerB << 16) | adlerA);
+
+        std::vector<std::uint8_t> header;
+        PutU32BE(header, framebuffer.GetWidth());
+        PutU32BE(header, framebuffer.GetHeight());
+        header.insert(header.end(), { 8, 6, 0, 0, 0 });     /* 8 bit RGBA, no interlacing */
+
+        std::vector<std::uint8_t> bytes{ 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+        PutPNGChunk(bytes, "IHDR", header);
+        PutPNGChunk(bytes, "IDAT", zlib);
+        PutPNGChunk(bytes, "IEND", {});
+        return WriteFile(url, bytes);
+    }
+
+    ////////////////////////////////////////
+    bool SaveFramebufferQOI(const char* url, const DisplayFramebuffer& framebuffer)
+    {
+        struct Pixel
+        {
+            std::uint8_t r, g, b, a;
+            bool operator==(const Pixel&) const = default;
+        };
+
+        std::vector<std::uint8_t> bytes{ 'q', 'o', 'i', 'f' };
+        PutU32BE(bytes, framebuffer.GetWidth());
+        PutU32BE(bytes, framebuffer.GetHeight());
+        bytes.push_back(4);     /* RGBA */
+        bytes.push_back(0);     /* sRGB color, linear alpha */
+
+        std::array<Pixel, 64> index{};
+        Pixel previous{ 0, 0, 0, 255 };
+        std::uint32_t run{};
+        std::size_t numPixels{ framebuffer.GetNumPixels() };
+        for (std::size_t i{}; i < numPixels; ++i) {
+            const std::uint8_t* channels{ framebuffer.GetData() + i * 4 };
+            Pixel pixel{ channels[0], channels[1], channels[2], channels[3] };
+            if (pixel == previous) {
+                // runs are capped at 62, the two longer encodings are taken by QOI_OP_RGB and QOI_OP_RGBA
+                if (++run == 62 || i + 1 == numPixels) {
+                    bytes.push_back(static_cast<std::uint8_t>(0xc0 | (run - 1)));
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0) {
+                bytes.push_back(static_cast<std::uint8_t>(0xc0 | (run - 1)));
+                run = 0;
+            }
+
+            std::size_t hash{ (pixel.r * 3u + pixel.g * 5u + pixel.b * 7u + pixel.a * 11u) % 64 };
+            if (index[hash] == pixel) {
+                bytes.push_back(static_cast<std::uint8_t>(hash));
+            }
+            else if (pixel.a == previous.a) {
+                index[hash] = pixel;
+                // channel differences wrap around, as the format specifies
+                int dr{ static_cast<std::int8_t>(pixel.r - previous.r) };
+                int dg{ static_cast<std::int8_t>(pixel.g - previous.g) };
+                int db{ static_cast<std::int8_t>(pixel.b - previous.b) };
+                int drg{ dr - dg };
+                int dbg{ db - dg };
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                    bytes.push_back(static_cast<std::uint8_t>(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+                }
+                else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7) {
+                    bytes.push_back(static_cast<std::uint8_t>(0x80 | (dg + 32)));
+                    bytes.push_back(static_cast<std::uint8_t>((drg + 8) << 4 | (dbg + 8)));
+                }
+                else {
+                    bytes.insert(bytes.end(), { 0xfe, pixel.r, pixel.g, pixel.b });
+                }
+            }
+            else {
+                index[hash] = pixel;
+                bytes.insert(bytes.end(), { 0xff, pixel.r, pixel.g, pixel.b, pixel.a });
+            }
+            previous = pixel;
+        }
+        bytes.insert(bytes.end(), { 0, 0, 0, 0, 0, 0, 0, 1 });
+        return WriteFile(url, bytes);
+    }
+
+    ////////////////////////////////////////
+    bool SaveFramebufferEXR(const char* url, const HDRFramebuffer& framebuffer)
+    {
+        // single-part scanline file, uncompressed half channels
+        std::uint32_t width{ framebuffer.GetWidth() };
+        std::uint32_t height{ framebuffer.GetHeight() };
+        std::vector<std::uint16_t> halves(framebuffer.GetNumPixels() * 4);
+        ConvertFloatToHalf(framebuffer.GetData(), halves.data(), framebuffer.GetNumPixels());
+
+        std::vector<std::uint8_t> bytes;
+        PutU32LE(bytes, 20000630);
+        PutU32LE(bytes, 2);
+
+        // channels are stored in alphabetical order, mapped to their offsets in an RGBA pixel
+        constexpr std::array<std::pair<const char*, std::uint32_t>, 4> channels{ {
+            { "A", 3 }, { "B", 2 }, { "G", 1 }, { "R", 0 }
+        } };
+        PutString(bytes, "channels");
+        PutString(bytes, "chlist");
+        PutU32LE(bytes, static_cast<std::uint32_t>(channels.size() * 18 + 1));
+        for (const auto& [name, offset] : channels) {
+            PutString(bytes, name);
+            PutU32LE(bytes, 1);         /* HALF */
+            PutU32LE(bytes, 0);         /* pLinear and reserved */
+            PutU32LE(bytes, 1);         /* x sampling */
+            PutU32LE(bytes, 1);         /* y sampling */
+        }
+        bytes.push_back(0);
+
+        PutString(bytes, "compression");
+        PutString(bytes, "compression");
+        PutU32LE(bytes, 1);
+        bytes.push_back(0);
+
+        for (const char* window : { "dataWindow", "displayWindow" }) {
+            PutString(bytes, window);
+            PutString(bytes, "box2i");
+            PutU32LE(bytes, 16);
+            PutU32LE(bytes, 0);
+            PutU32LE(bytes, 0);
+            PutU32LE(bytes, width - 1);
+            PutU32LE(bytes, height - 1);
+        }
+
+        PutString(bytes, "lineOrder");
+        PutString(bytes, "lineOrder");
+        PutU32LE(bytes, 1);
+        bytes.push_back(0);
+
+        PutString(bytes, "pixelAspectRatio");
+        PutString(bytes, "float");
+        PutU32LE(bytes, 4);
+        PutFloatLE(bytes, 1.0f);
+
+        PutString(bytes, "screenWindowCenter");
+        PutString(bytes, "v2f");
+        PutU32LE(bytes, 8);
+        PutFloatLE(bytes, 0.0f);
+        PutFloatLE(bytes, 0.0f);
+
+        PutString(bytes, "screenWindowWidth");
+        PutString(bytes, "float");
+        PutU32LE(bytes, 4);
+        PutFloatLE(bytes, 1.0f);
+        bytes.push_back(0);
+
+        std::size_t blockSize{ 8 + static_cast<std::size_t>(width) * channels.size() * sizeof(std::uint16_t) };
+        std::size_t firstBlock{ bytes.size() + static_cast<std::size_t>(height) * sizeof(std::uint64_t) };
+        for (std::uint32_t y{}; y < height; ++y) {
+            PutU64LE(bytes, firstBlock + y * blockSize);
+        }
+        bytes.reserve(firstBlock + height * blockSize);
+        for (std::uint32_t y{}; y < height; ++y) {
+            PutU32LE(bytes, y);
+            PutU32LE(bytes, static_cast<std::uint32_t>(blockSize - 8));
+            const std::uint16_t* row{ halves.data() + static_cast<std::size_t>(y) * width * 4 };
+            for (const auto& [name, offset] : channels) {
+                for (std::uint32_t x{}; x < width; ++x) {
+                    PutU16LE(bytes, row[x * 4 + offset]);
+                }
+            }
+        }
+        return WriteFile(url, bytes);
+    }
+
+    ////////////////////////////////////////
+    EncoderPool::EncoderPool(std::size_t numThreads, std::size_t maxPending)
+        : mMaxPending{ std::max<std::size_t>(maxPending, 1) }, mIsStopping{}
+    {
+        for (std::size_t i{}; i < std::max<std::size_t>(numThreads, 1); ++i) {
+            mThreads.emplace_back(&EncoderPool::Run, this);
+        }
+    }
+
+    ////////////////////////////////////////
+    EncoderPool::~EncoderPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mIsStopping = true;
+        }
+        mCondition.notify_all();
+        for (std::thread& thread : mThreads) {
+            thread.join();
+        }
+    }
+
+    ////////////////////////////////////////
+    void EncoderPool::Run()
+    {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                mCondition.wait(lock, [this] { return mIsStopping || !mJobs.empty(); });
+                // stopping only ends a thread once the queue has been drained
+                if (mJobs.empty()) {
+                    return;
+                }
+                job = std::move(mJobs.front());
+                mJobs.pop_front();
+            }
+            mSpaceCondition.notify_one();
+            job();
+        }
+    }
+
+    ////////////////////////////////////////
+    void EncoderPool::Submit(std::function<void()> job)
+    {
+        {
+            // back-pressure: the producer waits for a free slot instead of queueing without bound
+            std::unique_lock<std::mutex> lock(mMutex);
+            mSpaceCondition.wait(lock, [this] { return mJobs.size() < mMaxPending; });
+            mJobs.push_back(std::move(job));
+        }
+        mCondition.notify_one();
+    }
+
+    ////////////////////////////////////////
+    std::size_t EncoderPool::GetNumPending()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mJobs.size();
+    }
+}
@@ -0,0 +1,148 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "LightTree.hpp"
+#include "Scene.hpp"
+#include "Log.hpp"
+
+#include <glm/common.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    static float GetLightPower(const Sphere& sphere)
+    {
+        // radiant exitance times area, the constant factors cancel out during selection
+        float luminance{ 0.2126f * sphere.mEmission.x + 0.7152f * sphere.mEmission.y + 0.0722f * sphere.mEmission.z };
+        return luminance * sphere.mCenterRadius.w * sphere.mCenterRadius.w;
+    }
+
+    ////////////////////////////////////////
+    LightTree::LightTree(const Scene& scene)
+    {
+        auto begin{ std::chrono::steady_clock::now() };
+
+        const std::vector<Sphere>& spheres{ scene.GetSpheres() };
+        mLights.resize(scene.GetNumLights());
+
+        std::vector<std::uint32_t> lightIndices;
+        for (std::uint32_t i{}; i < scene.GetNumSpheres(); ++i) {
+            if (spheres[i].mEmission.w >= 0.0f) {
+                std::uint32_t lightIndex{ static_cast<std::uint32_t>(spheres[i].mEmission.w) };
+                mLights[lightIndex].mSphereIndex = i;
+                lightIndices.push_back(lightIndex);
+            }
+        }
+
+        if (!lightIndices.empty()) {
+            mNodes.reserve(2 * lightIndices.size() - 1);
+            Build(lightIndices, 0, lightIndices.size(), 0, 0, spheres);
+        }
+
+        auto end{ std::chrono::steady_clock::now() };
+        Log("CursedRay: built light tree with %zu nodes over %zu lights in %f milliseconds",
+            mNodes.size(), mLights.size(), std::chrono::duration<double, std::milli>(end - begin).count());
+    }
+
+    ////////////////////////////////////////
+    std::uint32_t LightTree::Build(std::vector<std::uint32_t>& lightIndices,
+                                   std::size_t begin,
+                                   std::size_t end,
+                                   std::uint32_t bitTrail,
+                                   std::uint32_t depth,
+                                   const std::vector<Sphere>& spheres)
+    {
+        std::uint32_t nodeIndex{ static_cast<std::uint32_t>(mNodes.size()) };
+        mNodes.push_back(LightNode{});
+
+        glm::vec3 boundsMin(INFINITY), boundsMax(-INFINITY);
+        glm::vec3 centroidMin(INFINITY), centroidMax(-INFINITY);
+        float power{};
+        for (std::size_t i{ begin }; i < end; ++i) {
+            const Sphere& sphere{ spheres[mLights[lightIndices[i]].mSphereIndex] };
+            glm::vec3 center(sphere.mCenterRadius.x, sphere.mCenterRadius.y, sphere.mCenterRadius.z);
+            glm::vec3 extent(sphere.mCenterRadius.w);
+            boundsMin = glm::min(boundsMin, center - extent);
+            boundsMax = glm::max(boundsMax, center + extent);
+            centroidMin = glm::min(centroidMin, center);
+            centroidMax = glm::max(centroidMax, center);
+            power += GetLightPower(sphere);
+        }
+
+        LightNode node{};
+        node.mBoundsMin = glm::vec4(boundsMin, power);
+        node.mBoundsMax = glm::vec4(boundsMax, 0.0f);
+
+        if (end - begin == 1) {
+            Light& light{ mLights[lightIndices[begin]] };
+            light.mBitTrail = bitTrail;
+            light.mDepth = depth;
+
+            node.mLeftOrLight = lightIndices[begin];
+            node.mRight = LIGHT_NODE_LEAF;
+            mNodes[nodeIndex] = node;
+            return nodeIndex;
+        }
+
+        // median split of the centroids along the longest axis
+        glm::vec3 centroidExtent{ centroidMax - centroidMin };
+        int axis{ centroidExtent.x > centroidExtent.y ? (centroidExtent.x > centroidExtent.z ? 0 : 2)
+                                                      : (centroidExtent.y > centroidExtent.z ? 1 : 2) };
+        std::size_t middle{ begin + (end - begin) / 2 };
+        auto first{ lightIndices.begin() + static_cast<std::ptrdiff_t>(begin) };
+        std::nth_element(first,
+                         lightIndices.begin() + static_cast<std::ptrdiff_t>(middle),
+                         lightIndices.begin() + static_cast<std::ptrdiff_t>(end),
+                         [&](std::uint32_t a, std::uint32_t b) {
+                             return spheres[mLights[a].mSphereIndex].mCenterRadius[axis] <
+                                    spheres[mLights[b].mSphereIndex].mCenterRadius[axis];
+                         });
+
+        node.mLeftOrLight = Build(lightIndices, begin, middle, bitTrail, depth + 1, spheres);
+        node.mRight = Build(lightIndices, middle, end, bitTrail | (1u << depth), depth + 1, spheres);
+        mNodes[nodeIndex] = node;
+        return nodeIndex;
+    }
+
+    ////////////////////////////////////////
+    void LightTree::Refit(const Scene& scene)
+    {
+        // bounds and power follow moved or resized emitters, the bit trails only depend on the topology;
+        // children are stored after their parents, so a reverse sweep sees them first
+        const std::vector<Sphere>& spheres{ scene.GetSpheres() };
+        for (std::size_t i{ mNodes.size() }; i-- > 0;) {
+            LightNode& node{ mNodes[i] };
+            if (node.mRight == LIGHT_NODE_LEAF) {
+                const Sphere& sphere{ spheres[mLights[node.mLeftOrLight].mSphereIndex] };
+                glm::vec3 center(sphere.mCenterRadius.x, sphere.mCenterRadius.y, sphere.mCenterRadius.z);
+                glm::vec3 extent(sphere.mCenterRadius.w);
+                node.mBoundsMin = glm::vec4(center - extent, GetLightPower(sphere));
+                node.mBoundsMax = glm::vec4(center + extent, 0.0f);
+                continue;
+            }
+            const LightNode& left{ mNodes[node.mLeftOrLight] };
+            const LightNode& right{ mNodes[node.mRight] };
+            float power{ left.mBoundsMin.w + right.mBoundsMin.w };
+            node.mBoundsMin = glm::min(left.mBoundsMin, right.mBoundsMin);
+            node.mBoundsMin.w = power;
+            node.mBoundsMax = glm::max(left.mBoundsMax, right.mBoundsMax);
+        }
+    }
+}
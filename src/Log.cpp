@@ -22,11 +22,13 @@
 #include <cstring>
 #include <cstdio>
 #include <fstream>
+#include <mutex>
 
 namespace CursedRay
 {
     ////////////////////////////////////////
     static std::ofstream logFile{};
+    static std::mutex logMutex{};
 
     ////////////////////////////////////////
     void Log(const char* args, ...)
@@ -35,6 +37,8 @@ namespace CursedRay
         std::time(&timer);
         std::tm timeInfo{};
 
+        // the device context is set up on a background thread that logs alongside the main thread
+        std::lock_guard<std::mutex> lock(logMutex);
         if (!logFile.is_open()) {
             logFile = std::ofstream{DEFAULT_LOGFILE_NAME, std::ios_base::out | std::ios_base::ate};
         }
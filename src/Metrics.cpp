@@ -0,0 +1,85 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "Metrics.hpp"
+#include "Constants.hpp"
+
+#include <array>
+#include <atomic>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    struct MetricInfo
+    {
+        const char* mName;
+        const char* mUnit;
+        bool mIsGauge;
+    };
+
+    ////////////////////////////////////////
+    static constexpr std::array<MetricInfo, static_cast<std::size_t>(Metric::Count)> METRIC_INFOS{ {
+        { "frame", "ms", false },
+        { "path trace", "ms", false },
+        { "reproject", "ms", false },
+        { "resolve", "ms", false },
+        { "readback", "ms", false },
+        { "blit", "ms", false },
+        { "rays", "M/s", false },
+        { "samples", "spp", true },
+        { "device memory", "MiB", true },
+        { "presented", "frames", true },
+        { "dropped", "frames", true }
+    } };
+
+    ////////////////////////////////////////
+    static std::array<std::atomic<double>, static_cast<std::size_t>(Metric::Count)> metricValues{};
+    static std::array<std::atomic<bool>, static_cast<std::size_t>(Metric::Count)> metricIsSet{};
+
+    ////////////////////////////////////////
+    void PublishMetric(Metric metric, double value)
+    {
+        std::size_t index{ static_cast<std::size_t>(metric) };
+        std::atomic<double>& slot{ metricValues[index] };
+        if (METRIC_INFOS[index].mIsGauge || !metricIsSet[index].exchange(true, std::memory_order_relaxed)) {
+            slot.store(value, std::memory_order_relaxed);
+            return;
+        }
+
+        // retries only when two threads publish the same metric at the same time
+        double average{ slot.load(std::memory_order_relaxed) };
+        while (!slot.compare_exchange_weak(average, average + (value - average) * DEFAULT_METRICS_SMOOTHING, std::memory_order_relaxed))
+            ;
+    }
+
+    ////////////////////////////////////////
+    double GetMetric(Metric metric)
+    {
+        return metricValues[static_cast<std::size_t>(metric)].load(std::memory_order_relaxed);
+    }
+
+    ////////////////////////////////////////
+    const char* GetMetricName(Metric metric)
+    {
+        return METRIC_INFOS[static_cast<std::size_t>(metric)].mName;
+    }
+
+    ////////////////////////////////////////
+    const char* GetMetricUnit(Metric metric)
+    {
+        return METRIC_INFOS[static_cast<std::size_t>(metric)].mUnit;
+    }
+}
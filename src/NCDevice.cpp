@@ -16,8 +16,12 @@
 
 #include "NCDevice.hpp"
 #include "Constants.hpp"
+#include "DeviceSelector.hpp"
 #include "Framebuffer.hpp"
+#include "ImageEncoder.hpp"
 #include "Log.hpp"
+#include "Metrics.hpp"
+#include "TiledRenderer.hpp"
 
 #include <algorithm>
 #include <cstdarg>
@@ -102,6 +106,56 @@ namespace CursedRay
         return "unknown";
     }
 
+    ////////////////////////////////////////
+    const char* NCDeviceOptions::GetSamplerName() const
+    {
+        switch (mHWOptions.mSampler) {
+            case SamplerType::Random:
+                return "random";
+            case SamplerType::Sobol:
+                return "sobol";
+        }
+        return "unknown";
+    }
+
+    ////////////////////////////////////////
+    const char* NCDeviceOptions::GetSceneName() const
+    {
+        switch (mSceneType) {
+            case SceneType::Default:
+                return "default";
+            case SceneType::Lamps:
+                return "lamps";
+        }
+        return "unknown";
+    }
+
+    ////////////////////////////////////////
+    const char* NCDeviceOptions::GetIntegratorName() const
+    {
+        switch (mHWOptions.mIntegrator) {
+            case IntegratorType::PerPixel:
+                return "per-pixel";
+            case IntegratorType::Persistent:
+                return "persistent";
+        }
+        return "unknown";
+    }
+
+    ////////////////////////////////////////
+    const char* NCDeviceOptions::GetFramebufferFormatName() const
+    {
+        switch (mHWOptions.mFramebufferFormat) {
+            case PixelFormat::RGBA8:
+                return "rgba8";
+            case PixelFormat::RGBA16F:
+                return "rgba16f";
+            case PixelFormat::RGBA32F:
+                return "rgba32f";
+        }
+        return "unknown";
+    }
+
     ////////////////////////////////////////
     const char* NCDeviceOptions::GetClearColorValues() const
     {
@@ -137,8 +191,40 @@ namespace CursedRay
         std::printf("\t--blitter:\t\t Blitter to use\n\t\t\t\t Valid values are '1x1', '2x1', '2x2', '3x2',\n\t\t\t\t and 'pixel'\n\t\t\t\t Default is '%s'\n", GetBlitterName());
         std::printf("\t--log-level:\t\t Log level to use\n\t\t\t\t Valid values are 'fatal', 'error', 'panic',\n\t\t\t\t 'debug', 'info', 'warning', 'silent',\n\t\t\t\t 'trace', and 'verbose'\n\t\t\t\t Default is '%s'\n", GetLogLevelName());
         std::printf("\t--dump-logs:\t\t Dump logs to stdout at the end\n");
+        std::printf("\t--hud:\t\t\t Show frame, stage and blit times, Mrays/s, spp, device memory\n\t\t\t\t and presented and dropped frames\n\t\t\t\t 'h' toggles it while running\n");
         std::printf("\t--clear-color:\t\t Set background color\n\t\t\t\t Default is '%s'\n", GetClearColorValues());
+        std::printf("\t--env-map:\t\t Light the scene with an equirectangular PFM image instead of\n\t\t\t\t the background color\n");
         std::printf("\t--device-type:\t\t Type of the OpenCL device\n\t\t\t\t Valid values are 'cpu', 'gpu',\n\t\t\t\t 'accelerator', and 'default'\n\t\t\t\t Default is '%s'\n", GetDeviceTypeName());
+        std::printf("\t--device:\t\t OpenCL device to render on\n\t\t\t\t Valid values are '<platform>:<device>' as\n\t\t\t\t printed by --list-devices, and 'auto' to\n\t\t\t\t benchmark every device of --device-type\n\t\t\t\t Default is the first device of --device-type\n");
+        std::printf("\t--list-devices:\t\t Print the OpenCL platforms and devices\n");
+        std::printf("\t--retune:\t\t Benchmark work-group sizes and '--device auto' again instead of using the cached ones\n");
+        std::printf("\t--spp:\t\t\t Samples per pixel traced per frame\n\t\t\t\t Default is '%u'\n", DEFAULT_SAMPLES_PER_PIXEL);
+        std::printf("\t--sampler:\t\t Sample generator used by the path tracer\n\t\t\t\t Valid values are 'sobol' and 'random'\n\t\t\t\t Default is '%s'\n", GetSamplerName());
+        std::printf("\t--no-nee:\t\t Disable next-event estimation and rely on BSDF sampling alone\n");
+        std::printf("\t--scene:\t\t Built-in scene to render\n\t\t\t\t Valid values are 'default' and 'lamps'\n\t\t\t\t Default is '%s'\n", GetSceneName());
+        std::printf("\t--animate:\t\t Bounce the scene's spheres, updating the BVH every frame\n");
+        std::printf("\t--integrator:\t\t Path tracing kernel launch strategy\n\t\t\t\t Valid values are 'per-pixel' and 'persistent'\n\t\t\t\t Default is '%s'\n", GetIntegratorName());
+        std::printf("\t--rr-depth:\t\t Bounce after which Russian roulette starts\n\t\t\t\t Default is '%u'\n", DEFAULT_ROULETTE_DEPTH);
+        std::printf("\t--max-depth:\t\t Maximum number of bounces per path\n\t\t\t\t Default is '%u'\n", DEFAULT_MAX_DEPTH);
+        std::printf("\t--denoise-iterations:\t Number of a-trous denoiser passes\n\t\t\t\t Valid values are between '0' and '%u'\n\t\t\t\t Default is '%u'\n", MAX_DENOISE_ITERATIONS, DEFAULT_DENOISE_ITERATIONS);
+        std::printf("\t--no-reprojection:\t Restart accumulation whenever the camera moves\n");
+        std::printf("\t--max-history:\t\t Maximum number of reprojected samples per pixel\n\t\t\t\t Default is '%u'\n", DEFAULT_MAX_HISTORY_SAMPLES);
+        std::printf("\t--target-fps:\t\t Scale the render resolution and samples per frame down while moving to hold this frame rate\n");
+        std::printf("\t--framebuffer-format:\t Pixel format the device resolves into\n\t\t\t\t Valid values are 'rgba8', 'rgba16f', and 'rgba32f'\n\t\t\t\t Default is '%s'\n", GetFramebufferFormatName());
+        std::printf("\t--hdr-output:\t\t Write the last frame as linear radiance to a PFM file\n\t\t\t\t Implies 'rgba16f' unless a float format is given\n");
+        std::printf("\t--sequence:\t\t Render a turntable of this many frames without a terminal\n");
+        std::printf("\t--sequence-samples:\t Samples per pixel of every sequence frame or tiled render\n\t\t\t\t Default is '%u'\n", DEFAULT_SEQUENCE_SAMPLES);
+        std::printf("\t--output:\t\t File name pattern of sequence frames, '#'s become the frame number\n\t\t\t\t Valid extensions are '.png', '.qoi', and '.exr'\n\t\t\t\t Default is '%s'\n", DEFAULT_SEQUENCE_OUTPUT);
+        std::printf("\t--resolution:\t\t Width and height of sequence frames and tiled renders\n\t\t\t\t Default is '%u %u'\n", DEFAULT_SEQUENCE_WIDTH, DEFAULT_SEQUENCE_HEIGHT);
+        std::printf("\t--tiled:\t\t Render one still at --resolution in bucket tiles without a terminal,\n\t\t\t\t streaming them to this file\n\t\t\t\t Valid extensions are '.ppm' and '.pfm'\n");
+        std::printf("\t--max-memory:\t\t Memory budget of a tiled render in MiB, which sets the tile size\n\t\t\t\t Default is '%zu'\n", DEFAULT_MAX_MEMORY >> 20);
+        std::printf("\t--checkpoint:\t\t Periodically save the progressive render to this file\n");
+        std::printf("\t--checkpoint-every:\t Seconds between checkpoints\n\t\t\t\t Default is '%u'\n", DEFAULT_CHECKPOINT_INTERVAL);
+        std::printf("\t--resume:\t\t Continue the render saved in the checkpoint file\n");
+        std::printf("\t--publish-shm:\t\t Publish finished frames to a shared-memory ring of this name\n");
+        std::printf("\t--farm:\t\t\t Coordinate a render farm with this many local worker processes\n");
+        std::printf("\t--farm-listen:\t\t Address farm workers connect to\n\t\t\t\t Valid values are 'unix:<path>' and 'tcp:<host>:<port>'\n\t\t\t\t Default is '%s'\n", DEFAULT_FARM_ADDRESS);
+        std::printf("\t--worker:\t\t Run headless as a farm worker of the coordinator at this address\n");
         std::exit(EXIT_SUCCESS);
     }
 
@@ -268,6 +354,14 @@ namespace CursedRay
                 mClearColor.a = std::clamp(alphaChannel, 0.0f, 1.0f);
                 i += 4;
             }
+            else if (!std::strncmp("--env-map", argv[i], DEFAULT_ARG_STR_LEN)) {
+                if (i == argc - 1) {
+                    std::fprintf(stderr, "%s: --env-map requires 1 argument\n", argv[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                mHWOptions.mEnvironmentFile = argv[i + 1];
+                ++i;
+            }
             else if (!std::strncmp("--device-type", argv[i], DEFAULT_ARG_STR_LEN)) {
                 if (i == argc - 1) {
                     std::fprintf(stderr, "%s: --device-type requires 1 argument\n", argv[0]);
@@ -294,46 +388,489 @@ namespace CursedRay
                     std::exit(EXIT_FAILURE);
                 }
             }
+            else if (!std::strncmp("--device", argv[i], DEFAULT_ARG_STR_LEN)) {
+                if (i == argc - 1) {
+                    std::fprintf(stderr, "%s: --device requires 1 argument\n", argv[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                int platformIndex{}, deviceIndex{};
+                if (!std::strncmp("auto", argv[i + 1], DEFAULT_ARG_STR_LEN)) {
+                    mHWOptions.mAutoDevice = true;
+                    ++i;
+                }
+                else if (std::sscanf(argv[i + 1], "%d:%d", &platformIndex, &deviceIndex) == 2 && platformIndex >= 0 && deviceIndex >= 0) {
+                    mHWOptions.mAutoDevice = false;
+                    mHWOptions.mPlatformIndex = platformIndex;
+                    mHWOptions.mDeviceIndex = deviceIndex;
+                    ++i;
+                }
+                else {
+                    std::fprintf(stderr, "%s: %s is an invalid device, see --list-devices\n", argv[0], argv[i + 1]);
+                    std::exit(EXIT_FAILURE);
+                }
+            }
+            else if (!std::strncmp("--list-devices", argv[i], DEFAULT_ARG_STR_LEN)) {
+                ListDevices();
+                std::exit(EXIT_SUCCESS);
+            }
             else if (!std::strncmp("--dump-logs", argv[i], DEFAULT_ARG_STR_LEN)) {
                 mDumpLogs = true;
             }
+            else if (!std::strncmp("--hud", argv[i], DEFAULT_ARG_STR_LEN)) {
+                mShowHud = true;
+            }
+            else if (!std::strncmp("--retune", argv[i], DEFAULT_ARG_STR_LEN)) {
+                mHWOptions.mRetune = true;
+            }
+            else if (!std::strncmp("--spp", argv[i], DEFAULT_ARG_STR_LEN)) {
+                if (i == argc - 1) {
+                    std::fprintf(stderr, "%s: --spp requires 1 argument\n", argv[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                int samplesPerPixel{ std::atoi(argv[i + 1]) };
+                if (samplesPerPixel <= 0) {
+                    std::fprintf(stderr, "%s: %s is an invalid number of samples per pixel\n", argv[0], argv[i + 1]);
+                    std::exit(EXIT_FAILURE);
+                }
+                mHWOptions.mSamplesPerPixel = static_cast<uint>(samplesPerPixel);
+                ++i;
+            }
+            else if (!std::strncmp("--sampler", argv[i], DEFAULT_ARG_STR_LEN)) {
+                if (i == argc - 1) {
+                    std::fprintf(stderr, "%s: --sampler requires 1 argument\n", argv[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                if (!std::strncmp("sobol", argv[i + 1], DEFAULT_ARG_STR_LEN)) {
+                    mHWOptions.mSampler = SamplerType::Sobol;
+                    ++i;
+                }
+                else if (!std::strncmp("random", argv[i + 1], DEFAULT_ARG_STR_LEN)) {
+                    mHWOptions.mSampler = SamplerType::Random;
+                    ++i;
+                }
+                else {
+                    std::fprintf(stderr, "%s: %s is an invalid sampler\n", argv[0], argv[i + 1]);
+                    std::exit(EXIT_FAILURE);
+                }
+            }
+            else if (!std::strncmp("--no-nee", argv[i], DEFAULT_ARG_STR_LEN)) {
+                mHWOptions.mNextEventEstimation = false;
+            }
+            else if (!std::strncmp("--scene", argv[i], DEFAULT_ARG_STR_LEN)) {
+                if (i == argc - 1) {
+                    std::fprintf(stderr, "%s: --scene requires 1 argument\n", argv[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                if (!std::strncmp("default", argv[i + 1], DEFAULT_ARG_STR_LEN)) {
+                    mSceneType = SceneType::Default;
+                    ++i;
+                }
+                else if (!std::strncmp("lamps", argv[i + 1], DEFAULT_ARG_STR_LEN)) {
+                    mSceneType = SceneType::Lamps;
+                    ++i;
+                }
+                else {
+                    std::fprintf(stderr, "%s: %s is an invalid scene\n", argv[0], argv[i + 1]);
+                    std::exit(EXIT_FAILURE);
+                }
+            }
+            else if (!std::strncmp("--animate", argv[i], DEFAULT_ARG_STR_LEN)) {
+                mAnimate = true;
+            }
+            else if (!std::strncmp("--integrator", argv[i], DEFAULT_ARG_STR_LEN)) {
+                if (i == argc - 1) {
+                    std::fprintf(stderr, "%s: --integrator requires 1 argument\n", argv[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                if (!std::strncmp("per-pixel", argv[i + 1], DEFAULT_ARG_STR_LEN)) {
+                    mHWOptions.mIntegrator = IntegratorType::PerPixel;
+                    ++i;
+                }
+                else if (!std::strncmp("persistent", argv[i + 1], DEFAULT_ARG_STR_LEN)) {
+                    mHWOptions.mIntegrator = IntegratorType::Persistent;
+                    ++i;
+                }
+                else {
+                    std::fprintf(stderr, "%s: %s is an invalid integrator\n", argv[0], argv[i + 1]);
+                    std::exit(EXIT_FAILURE);
+                }
+            }
+            else if (!std::strncmp("--rr-depth", argv[i], DEFAULT_ARG_STR_LEN)) {
+                if (i == argc - 1) {
+                    std::fprintf(stderr, "%s: --rr-depth requires 1 argument\n", argv[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                int rouletteDepth{ std::atoi(argv[i + 1]) };
+                if (rouletteDepth <= 0) {
+                    std::fprintf(stderr, "%s: %s is an invalid Russian roulette depth\n", argv[0], argv[i + 1]);
+                    std::exit(EXIT_FAILURE);
+                }
+                mHWOptions.mRouletteDepth = static_cast<uint>(rouletteDepth);
+                ++i;
+            }
+            else if (!std::strncmp("--max-depth", argv[i], DEFAULT_ARG_STR_LEN)) {
+                if (i == argc - 1) {
+                    std::fprintf(stderr, "%s: --max-depth requires 1 argument\n", argv[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                int maxDepth{ std::atoi(argv[i + 1]) };
+                if (maxDepth <= 0) {
+                    std::fprintf(stderr, "%s: %s is an invalid maximum depth\n", argv[0], argv[i + 1]);
+                    std::exit(EXIT_FAILURE);
+                }
+                mHWOptions.mMaxDepth = static_cast<uint>(maxDepth);
+                ++i;
+            }
+            else if (!std::strncmp("--denoise-iterations", argv[i], DEFAULT_ARG_STR_LEN)) {
+                if (i == argc - 1) {
+                    std::fprintf(stderr, "%s: --denoise-iterations requires 1 argument\n", argv[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                int iterations{ std::atoi(argv[i + 1]) };
+                if (iterations < 0 || iterations > static_cast<int>(MAX_DENOISE_ITERATIONS)) {
+                    std::fprintf(stderr, "%s: %s is an invalid number of denoiser iterations\n", argv[0], argv[i + 1]);
+                    std::exit(EXIT_FAILURE);
+                }
+                mHWOptions.mDenoiseIterations = static_cast<uint>(iterations);
+                ++i;
+            }
+            else if (!std::strncmp("--no-reprojection", argv[i], DEFAULT_ARG_STR_LEN)) {
+                mHWOptions.mReprojection = false;
+            }
+            else if (!std::strncmp("--max-history", argv[i], DEFAULT_ARG_STR_LEN)) {
+                if (i == argc - 1) {
+                    std::fprintf(stderr, "%s: --max-history requires 1 argument\n", argv[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                int maxHistory{ std::atoi(argv[i + 1]) };
+                if (maxHistory <= 0) {
+                    std::fprintf(stderr, "%s: %s is an invalid number of history samples\n", argv[0], argv[i + 1]);
+                    std::exit(EXIT_FAILURE);
+                }
+                mHWOptions.mMaxHistorySamples = static_cast<uint>(maxHistory);
+                ++i;
+            }
+            else if (!std::strncmp("--target-fps", argv[i], DEFAULT_ARG_STR_LEN)) {
+                if (i == argc - 1) {
+                    std::fprintf(stderr, "%s: --target-fps requires 1 argument\n", argv[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                int targetFps{ std::atoi(argv[i + 1]) };
+                if (targetFps <= 0) {
+                    std::fprintf(stderr, "%s: %s is an invalid frame rate\n", argv[0], argv[i + 1]);
+                    std::exit(EXIT_FAILURE);
+                }
+                mTargetFps = static_cast<std::uint32_t>(targetFps);
+                ++i;
+            }
+            else if (!std::strncmp("--framebuffer-format", argv[i], DEFAULT_ARG_STR_LEN)) {
+                if (i == argc - 1) {
+                    std::fprintf(stderr, "%s: --framebuffer-format requires 1 argument\n", argv[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                if (!std::strncmp("rgba8", argv[i + 1], DEFAULT_ARG_STR_LEN)) {
+                    mHWOptions.mFramebufferFormat = PixelFormat::RGBA8;
+                    ++i;
+                }
+                else if (!std::strncmp("rgba16f", argv[i + 1], DEFAULT_ARG_STR_LEN)) {
+                    mHWOptions.mFramebufferFormat = PixelFormat::RGBA16F;
+                    ++i;
+                }
+                else if (!std::strncmp("rgba32f", argv[i + 1], DEFAULT_ARG_STR_LEN)) {
+                    mHWOptions.mFramebufferFormat = PixelFormat::RGBA32F;
+                    ++i;
+                }
+                else {
+                    std::fprintf(stderr, "%s: %s is an invalid framebuffer format\n", argv[0], argv[i + 1]);
+                    std::exit(EXIT_FAILURE);
+                }
+            }
+            else if (!std::strncmp("--hdr-output", argv[i], DEFAULT_ARG_STR_LEN)) {
+                if (i == argc - 1) {
+                    std::fprintf(stderr, "%s: --hdr-output requires 1 argument\n", argv[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                mHDROutputFile = argv[i + 1];
+                ++i;
+            }
+            else if (!std::strncmp("--sequence", argv[i], DEFAULT_ARG_STR_LEN)) {
+                if (i == argc - 1) {
+                    std::fprintf(stderr, "%s: --sequence requires 1 argument\n", argv[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                int numFrames{ std::atoi(argv[i + 1]) };
+                if (numFrames <= 0) {
+                    std::fprintf(stderr, "%s: %s is an invalid number of frames\n", argv[0], argv[i + 1]);
+                    std::exit(EXIT_FAILURE);
+                }
+                mSequenceFrames = static_cast<std::uint32_t>(numFrames);
+                ++i;
+            }
+            else if (!std::strncmp("--sequence-samples", argv[i], DEFAULT_ARG_STR_LEN)) {
+                if (i == argc - 1) {
+                    std::fprintf(stderr, "%s: --sequence-samples requires 1 argument\n", argv[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                int numSamples{ std::atoi(argv[i + 1]) };
+                if (numSamples <= 0) {
+                    std::fprintf(stderr, "%s: %s is an invalid number of samples\n", argv[0], argv[i + 1]);
+                    std::exit(EXIT_FAILURE);
+                }
+                mSequenceSamples = static_cast<std::uint32_t>(numSamples);
+                ++i;
+            }
+            else if (!std::strncmp("--output", argv[i], DEFAULT_ARG_STR_LEN)) {
+                if (i == argc - 1) {
+                    std::fprintf(stderr, "%s: --output requires 1 argument\n", argv[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                mOutputPattern = argv[i + 1];
+                ++i;
+            }
+            else if (!std::strncmp("--resolution", argv[i], DEFAULT_ARG_STR_LEN)) {
+                if (i >= argc - 2) {
+                    std::fprintf(stderr, "%s: --resolution requires 2 arguments\n", argv[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                int width{ std::atoi(argv[i + 1]) };
+                int height{ std::atoi(argv[i + 2]) };
+                if (width <= 0 || height <= 0) {
+                    std::fprintf(stderr, "%s: %s %s is an invalid resolution\n", argv[0], argv[i + 1], argv[i + 2]);
+                    std::exit(EXIT_FAILURE);
+                }
+                mResolutionWidth = static_cast<std::uint32_t>(width);
+                mResolutionHeight = static_cast<std::uint32_t>(height);
+                i += 2;
+            }
+            else if (!std::strncmp("--tiled", argv[i], DEFAULT_ARG_STR_LEN)) {
+                if (i == argc - 1) {
+                    std::fprintf(stderr, "%s: --tiled requires 1 argument\n", argv[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                mTiledOutputFile = argv[i + 1];
+                ++i;
+            }
+            else if (!std::strncmp("--max-memory", argv[i], DEFAULT_ARG_STR_LEN)) {
+                if (i == argc - 1) {
+                    std::fprintf(stderr, "%s: --max-memory requires 1 argument\n", argv[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                int maxMemory{ std::atoi(argv[i + 1]) };
+                if (maxMemory <= 0) {
+                    std::fprintf(stderr, "%s: %s is an invalid memory budget\n", argv[0], argv[i + 1]);
+                    std::exit(EXIT_FAILURE);
+                }
+                mMaxMemory = static_cast<std::size_t>(maxMemory) << 20;
+                ++i;
+            }
+            else if (!std::strncmp("--checkpoint", argv[i], DEFAULT_ARG_STR_LEN)) {
+                if (i == argc - 1) {
+                    std::fprintf(stderr, "%s: --checkpoint requires 1 argument\n", argv[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                mCheckpointFile = argv[i + 1];
+                ++i;
+            }
+            else if (!std::strncmp("--checkpoint-every", argv[i], DEFAULT_ARG_STR_LEN)) {
+                if (i == argc - 1) {
+                    std::fprintf(stderr, "%s: --checkpoint-every requires 1 argument\n", argv[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                int interval{ std::atoi(argv[i + 1]) };
+                if (interval <= 0) {
+                    std::fprintf(stderr, "%s: %s is an invalid checkpoint interval\n", argv[0], argv[i + 1]);
+                    std::exit(EXIT_FAILURE);
+                }
+                mCheckpointInterval = static_cast<std::uint32_t>(interval);
+                ++i;
+            }
+            else if (!std::strncmp("--resume", argv[i], DEFAULT_ARG_STR_LEN)) {
+                mResume = true;
+            }
+            else if (!std::strncmp("--publish-shm", argv[i], DEFAULT_ARG_STR_LEN)) {
+                if (i == argc - 1) {
+                    std::fprintf(stderr, "%s: --publish-shm requires 1 argument\n", argv[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                mPublishName = argv[i + 1];
+                ++i;
+            }
+            else if (!std::strncmp("--farm", argv[i], DEFAULT_ARG_STR_LEN)) {
+                if (i == argc - 1) {
+                    std::fprintf(stderr, "%s: --farm requires 1 argument\n", argv[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                int numWorkers{ std::atoi(argv[i + 1]) };
+                if (numWorkers < 0) {
+                    std::fprintf(stderr, "%s: %s is an invalid number of farm workers\n", argv[0], argv[i + 1]);
+                    std::exit(EXIT_FAILURE);
+                }
+                mIsFarmCoordinator = true;
+                mFarmWorkers = static_cast<std::uint32_t>(numWorkers);
+                ++i;
+            }
+            else if (!std::strncmp("--farm-listen", argv[i], DEFAULT_ARG_STR_LEN)) {
+                if (i == argc - 1) {
+                    std::fprintf(stderr, "%s: --farm-listen requires 1 argument\n", argv[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                mIsFarmCoordinator = true;
+                mFarmAddress = argv[i + 1];
+                ++i;
+            }
+            else if (!std::strncmp("--worker", argv[i], DEFAULT_ARG_STR_LEN)) {
+                if (i == argc - 1) {
+                    std::fprintf(stderr, "%s: --worker requires 1 argument\n", argv[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                mWorkerAddress = argv[i + 1];
+                ++i;
+            }
             else {
                 std::fprintf(stderr, "%s: %s is an invalid option\n", argv[0], argv[i]);
                 PrintHelp(argv);
                 std::exit(EXIT_FAILURE);
             }
         }
+
+        ImageFormat outputFormat{};
+        if (!GetImageFormat(mOutputPattern, outputFormat)) {
+            std::fprintf(stderr, "%s: %s does not end in .png, .qoi or .exr\n", argv[0], mOutputPattern.c_str());
+            std::exit(EXIT_FAILURE);
+        }
+        if (mSequenceFrames > 0 && outputFormat == ImageFormat::EXR && mHWOptions.mFramebufferFormat == PixelFormat::RGBA8) {
+            mHWOptions.mFramebufferFormat = PixelFormat::RGBA16F;
+        }
+
+        if (mResume && mCheckpointFile.empty()) {
+            std::fprintf(stderr, "%s: --resume requires --checkpoint\n", argv[0]);
+            std::exit(EXIT_FAILURE);
+        }
+
+        // an RGBA8 resolve has already thrown the HDR data away
+        if (!mHDROutputFile.empty() && mHWOptions.mFramebufferFormat == PixelFormat::RGBA8) {
+            mHWOptions.mFramebufferFormat = PixelFormat::RGBA16F;
+        }
+
+        // tiles are resolved in the precision of the file they are streamed to
+        if (!mTiledOutputFile.empty()) {
+            TiledImageFormat tiledFormat{};
+            if (!GetTiledImageFormat(mTiledOutputFile, tiledFormat)) {
+                std::fprintf(stderr, "%s: %s does not end in .ppm or .pfm\n", argv[0], mTiledOutputFile.c_str());
+                std::exit(EXIT_FAILURE);
+            }
+            mHWOptions.mFramebufferFormat = GetTiledFramebufferFormat(tiledFormat);
+        }
     }
 
     ////////////////////////////////////////
     void NCDevice::Blit(const std::vector<std::uint8_t>& pixels, std::int32_t width, std::int32_t height)
     {
+        auto blitBegin{ std::chrono::steady_clock::now() };
         if (ncblit_rgba(pixels.data(), width * 4, &mOptions) < 0) {
             Log("CursedRay: error in ncblit_rgba");
             notcurses_stop(mContext);
             std::exit(EXIT_FAILURE);
         }
+        DrawHud();
         if (notcurses_render(mContext) == -1) {
             Log("CursedRay: error in notcurses_render");
             notcurses_stop(mContext);
             std::exit(EXIT_FAILURE);
         }
+        PublishMetric(Metric::BlitTime, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - blitBegin).count());
     }
 
     ////////////////////////////////////////
-    void NCDevice::Blit(const Framebuffer& framebuffer)
+    void NCDevice::Blit(const DisplayFramebuffer& framebuffer)
     {
         assert(framebuffer.GetNumChannels() == 4 && "the number of channels in a given framebuffer must equal 4");
+        auto blitBegin{ std::chrono::steady_clock::now() };
         if (ncblit_rgba(framebuffer.GetData(), framebuffer.GetWidthSigned() * framebuffer.GetNumChannelsSigned(), &mOptions) < 0) {
             Log("CursedRay: error in ncblit_rgba, framebuffer %p", &framebuffer);
             notcurses_stop(mContext);
             std::exit(EXIT_FAILURE);
         }
+        DrawHud();
         if (notcurses_render(mContext) == -1) {
             Log("CursedRay: error in notcurses_render, framebuffer %p", &framebuffer);
             notcurses_stop(mContext);
             std::exit(EXIT_FAILURE);
         }
+        PublishMetric(Metric::BlitTime, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - blitBegin).count());
+    }
+
+    ////////////////////////////////////////
+    bool NCDevice::DrawHud()
+    {
+        // the blit may have added planes of its own, the overlay has to stay on top of them
+        // a plane that was just destroyed still needs a render to disappear
+        bool isSynced{ SyncHudPlane() };
+        if (mHudPlane == nullptr) {
+            return isSynced;
+        }
+        ncplane_move_top(mHudPlane);
+
+        auto now{ std::chrono::steady_clock::now() };
+        if (now - mHudUpdate < std::chrono::milliseconds(DEFAULT_HUD_INTERVAL_MS)) {
+            return false;
+        }
+        mHudUpdate = now;
+
+        ncplane_erase(mHudPlane);
+        for (std::uint32_t i{}; i < static_cast<std::uint32_t>(Metric::Count); ++i) {
+            Metric metric{ static_cast<Metric>(i) };
+            ncplane_printf_yx(mHudPlane, static_cast<int>(i), 1, "%-13s %9.2f %s", GetMetricName(metric), GetMetric(metric), GetMetricUnit(metric));
+        }
+        return true;
+    }
+
+    ////////////////////////////////////////
+    void NCDevice::ToggleHud()
+    {
+        // only the input loop toggles, a plain load and store cannot lose a flip
+        mIsHudRequested.store(!mIsHudRequested.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    ////////////////////////////////////////
+    bool NCDevice::SyncHudPlane()
+    {
+        bool isRequested{ mIsHudRequested.load(std::memory_order_relaxed) };
+        if (isRequested == (mHudPlane != nullptr)) {
+            return false;
+        }
+        if (!isRequested) {
+            ncplane_destroy(mHudPlane);
+            mHudPlane = nullptr;
+            return true;
+        }
+
+        ncplane_options hudOptions{};
+        hudOptions.rows = static_cast<unsigned>(Metric::Count);
+        hudOptions.cols = std::min(DEFAULT_HUD_WIDTH, mWidth);
+        hudOptions.name = "hud";
+        mHudPlane = ncplane_create(mPlane, &hudOptions);
+        if (mHudPlane == nullptr) {
+            Log("CursedRay: could not create the HUD plane");
+            mIsHudRequested.store(false, std::memory_order_relaxed);
+            return false;
+        }
+        ncplane_set_base(mHudPlane, " ", 0, NCCHANNELS_INITIALIZER(255, 255, 255, 0, 0, 0));
+        ncplane_set_fg_rgb8(mHudPlane, 255, 255, 255);
+        ncplane_set_bg_rgb8(mHudPlane, 0, 0, 0);
+        mHudUpdate = {};
+        return true;
+    }
+
+    ////////////////////////////////////////
+    void NCDevice::UpdateHud()
+    {
+        // only the overlay's cells change, the frame underneath is not blitted again
+        if (DrawHud() && notcurses_render(mContext) == -1) {
+            Log("CursedRay: error in notcurses_render");
+            notcurses_stop(mContext);
+            std::exit(EXIT_FAILURE);
+        }
     }
 
     ////////////////////////////////////////
@@ -344,12 +881,19 @@ namespace CursedRay
             ;
     }
 
+    ////////////////////////////////////////
+    std::uint32_t NCDevice::PollInput(ncinput& input) const
+    {
+        return notcurses_get_nblock(mContext, &input);
+    }
+
     ////////////////////////////////////////
     NCDevice::NCDevice(const NCDeviceOptions& options)
         : mContext{}, mPlane{}, mOptions{}, mContextOptions{},
           mWidth{}, mHeight{},
           mPixelsWidth{}, mPixelsHeight{},
           mCellWidth{}, mCellHeight{},
+          mHudPlane{}, mHudUpdate{}, mIsHudRequested{ options.ShowHud() },
           mDumpLogs{ options.DumpLogs() }
     {
         if (!setlocale(LC_ALL, "")) {
@@ -0,0 +1,85 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "Presenter.hpp"
+#include "NCDevice.hpp"
+#include "Metrics.hpp"
+
+#include <utility>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    Presenter::Presenter(NCDevice& device, const DisplayFramebuffer& framebuffer)
+        : mDevice{ device }, mFrames{ framebuffer },
+          mSignal{}, mIsStopping{}, mNumPresented{}, mNumDropped{}
+    {
+        mThread = std::thread([this]() { Run(); });
+    }
+
+    ////////////////////////////////////////
+    Presenter::~Presenter()
+    {
+        mIsStopping.store(true, std::memory_order_relaxed);
+        Signal();
+        mThread.join();
+    }
+
+    ////////////////////////////////////////
+    void Presenter::Run()
+    {
+        // loading the counter before looking for work means a signal raised meanwhile is never slept through
+        for (std::uint32_t signal{ mSignal.load(std::memory_order_acquire) };; signal = mSignal.load(std::memory_order_acquire)) {
+            if (mIsStopping.load(std::memory_order_relaxed)) {
+                return;
+            }
+            if (mFrames.Acquire()) {
+                mDevice.Blit(mFrames.GetFront());
+                std::uint64_t numPresented{ mNumPresented.fetch_add(1, std::memory_order_relaxed) + 1 };
+                PublishMetric(Metric::PresentedFrames, static_cast<double>(numPresented));
+            }
+            else {
+                mDevice.UpdateHud();
+            }
+            mSignal.wait(signal, std::memory_order_acquire);
+        }
+    }
+
+    ////////////////////////////////////////
+    void Presenter::Signal()
+    {
+        mSignal.fetch_add(1, std::memory_order_release);
+        mSignal.notify_one();
+    }
+
+    ////////////////////////////////////////
+    void Presenter::Submit(DisplayFramebuffer& framebuffer)
+    {
+        // swapping moves the pixel storage, the frame is handed over without a copy
+        std::swap(framebuffer, mFrames.GetBack());
+        if (!mFrames.Publish()) {
+            std::uint64_t numDropped{ mNumDropped.fetch_add(1, std::memory_order_relaxed) + 1 };
+            PublishMetric(Metric::DroppedFrames, static_cast<double>(numDropped));
+        }
+        Signal();
+    }
+
+    ////////////////////////////////////////
+    void Presenter::Wake()
+    {
+        Signal();
+    }
+}
@@ -0,0 +1,637 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "RenderFarm.hpp"
+#include "HWDevice.hpp"
+#include "Camera.hpp"
+#include "Constants.hpp"
+#include "IO.hpp"
+#include "Log.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <utility>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    struct FarmMessageHeader
+    {
+        std::uint32_t mMagic;
+        std::uint32_t mType;
+        std::uint64_t mSize;
+    };
+
+    ////////////////////////////////////////
+    constexpr std::uint32_t FARM_MESSAGE_MAGIC{ 0x31465243 };     /* "CRF1" */
+
+    ////////////////////////////////////////
+    static bool WriteAll(int socket, const void* data, std::size_t size)
+    {
+        const std::uint8_t* bytes{ static_cast<const std::uint8_t*>(data) };
+        while (size > 0) {
+            // MSG_NOSIGNAL turns a vanished peer into an error instead of SIGPIPE
+            ssize_t written{ ::send(socket, bytes, size, MSG_NOSIGNAL) };
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                return false;
+            }
+            bytes += written;
+            size -= static_cast<std::size_t>(written);
+        }
+        return true;
+    }
+
+    ////////////////////////////////////////
+    static bool ReadAll(int socket, void* data, std::size_t size)
+    {
+        std::uint8_t* bytes{ static_cast<std::uint8_t*>(data) };
+        while (size > 0) {
+            ssize_t received{ ::recv(socket, bytes, size, 0) };
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+            if (received <= 0) {
+                return false;
+            }
+            bytes += received;
+            size -= static_cast<std::size_t>(received);
+        }
+        return true;
+    }
+
+    ////////////////////////////////////////
+    static bool ReadAvailable(int socket, std::uint8_t* data, std::size_t size, std::size_t& received)
+    {
+        // reads whatever has arrived without waiting, false once the peer is gone
+        while (received < size) {
+            ssize_t result{ ::recv(socket, data + received, size - received, MSG_DONTWAIT) };
+            if (result < 0 && errno == EINTR) {
+                continue;
+            }
+            if (result < 0 && errno == EAGAIN) {
+                return true;
+            }
+            if (result <= 0) {
+                return false;
+            }
+            received += static_cast<std::size_t>(result);
+        }
+        return true;
+    }
+
+    ////////////////////////////////////////
+    static std::string GetWorkerCacheFile(const char* cacheFile, std::uint32_t workerIndex)
+    {
+        // "cray_tuning.cache" becomes "cray_tuning.worker2.cache"
+        std::string url{ cacheFile };
+        std::size_t extension{ url.rfind('.') };
+        return url.insert(extension == std::string::npos ? url.size() : extension, ".worker" + std::to_string(workerIndex));
+    }
+
+    ////////////////////////////////////////
+    static int OpenSocket(const std::string& address, bool isListening, std::string& socketPath)
+    {
+        if (address.rfind("tcp:", 0) == 0) {
+            std::size_t separator{ address.rfind(':') };
+            if (separator <= 4) {
+                Log("CursedRay: farm address %s is missing a port", address.c_str());
+                return -1;
+            }
+            std::string host{ address.substr(4, separator - 4) };
+            std::string port{ address.substr(separator + 1) };
+
+            addrinfo hints{};
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            hints.ai_flags = isListening ? AI_PASSIVE : 0;
+            addrinfo* results{};
+            if (int status{ ::getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &results) }; status != 0) {
+                Log("CursedRay: could not resolve %s: %s", address.c_str(), ::gai_strerror(status));
+                return -1;
+            }
+
+            int fd{ -1 };
+            for (addrinfo* result{ results }; result != nullptr && fd < 0; result = result->ai_next) {
+                fd = ::socket(result->ai_family, result->ai_socktype | SOCK_CLOEXEC, result->ai_protocol);
+                if (fd < 0) {
+                    continue;
+                }
+                int enable{ 1 };
+                bool isReady{};
+                if (isListening) {
+                    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+                    isReady = ::bind(fd, result->ai_addr, result->ai_addrlen) == 0 && ::listen(fd, SOMAXCONN) == 0;
+                }
+                else {
+                    // results are a few large messages, never wait to coalesce them
+                    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+                    isReady = ::connect(fd, result->ai_addr, result->ai_addrlen) == 0;
+                }
+                if (!isReady) {
+                    ::close(fd);
+                    fd = -1;
+                }
+            }
+            ::freeaddrinfo(results);
+            return fd;
+        }
+
+        // anything that is not tcp: is a unix socket path, with or without the prefix
+        std::string path{ address.rfind("unix:", 0) == 0 ? address.substr(5) : address };
+        sockaddr_un socketAddress{};
+        socketAddress.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(socketAddress.sun_path)) {
+            Log("CursedRay: %s is not a valid unix socket path", path.c_str());
+            return -1;
+        }
+        std::memcpy(socketAddress.sun_path, path.c_str(), path.size() + 1);
+
+        int fd{ ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0) };
+        if (fd < 0) {
+            return -1;
+        }
+        bool isReady{};
+        if (isListening) {
+            // a socket file left behind by a crashed coordinator would make bind fail
+            ::unlink(path.c_str());
+            isReady = ::bind(fd, reinterpret_cast<const sockaddr*>(&socketAddress), sizeof(socketAddress)) == 0 &&
+                      ::listen(fd, SOMAXCONN) == 0;
+            socketPath = path;
+        }
+        else {
+            isReady = ::connect(fd, reinterpret_cast<const sockaddr*>(&socketAddress), sizeof(socketAddress)) == 0;
+        }
+        if (!isReady) {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    ////////////////////////////////////////
+    static std::vector<cpu_set_t> GetNumaNodeCpus()
+    {
+        // NUMA nodes are numbered densely from 0, a single node leaves nothing to pin to
+        std::vector<cpu_set_t> nodes;
+        for (;;) {
+            std::string cpuList{ ReadTextFile(("/sys/devices/system/node/node" + std::to_string(nodes.size()) + "/cpulist").c_str()) };
+            if (cpuList.empty()) {
+                break;
+            }
+            cpu_set_t& cpus{ nodes.emplace_back() };
+            CPU_ZERO(&cpus);
+            // the list looks like "0-7,16-23"
+            for (const char* range{ cpuList.c_str() }; *range != '\0';) {
+                char* end{};
+                unsigned long first{ std::strtoul(range, &end, 10) };
+                unsigned long last{ first };
+                if (*end == '-') {
+                    last = std::strtoul(end + 1, &end, 10);
+                }
+                for (unsigned long cpu{ first }; cpu <= last && cpu < CPU_SETSIZE; ++cpu) {
+                    CPU_SET(cpu, &cpus);
+                }
+                range = *end == ',' ? end + 1 : end + std::strlen(end);
+            }
+        }
+        if (nodes.size() < 2) {
+            nodes.clear();
+        }
+        return nodes;
+    }
+
+    ////////////////////////////////////////
+    FarmConnection::FarmConnection()
+        : FarmConnection(-1)
+    {
+    }
+
+    ////////////////////////////////////////
+    FarmConnection::FarmConnection(int socket)
+        : mSocket{ socket }, mReceived{}, mIsPayload{}, mPendingType{}
+    {
+    }
+
+    ////////////////////////////////////////
+    FarmConnection::~FarmConnection()
+    {
+        if (mSocket >= 0) {
+            ::close(mSocket);
+        }
+    }
+
+    ////////////////////////////////////////
+    FarmConnection::FarmConnection(FarmConnection&& other) noexcept
+        : mSocket{ std::exchange(other.mSocket, -1) },
+          mPending{ std::move(other.mPending) }, mReceived{ std::exchange(other.mReceived, 0) },
+          mIsPayload{ std::exchange(other.mIsPayload, false) }, mPendingType{ other.mPendingType }
+    {
+    }
+
+    ////////////////////////////////////////
+    FarmConnection& FarmConnection::operator=(FarmConnection&& other) noexcept
+    {
+        if (this != &other) {
+            if (mSocket >= 0) {
+                ::close(mSocket);
+            }
+            mSocket = std::exchange(other.mSocket, -1);
+            mPending = std::move(other.mPending);
+            mReceived = std::exchange(other.mReceived, 0);
+            mIsPayload = std::exchange(other.mIsPayload, false);
+            mPendingType = other.mPendingType;
+        }
+        return *this;
+    }
+
+    ////////////////////////////////////////
+    bool FarmConnection::Send(FarmMessageType type, const void* header, std::size_t headerSize,
+                              const void* payload, std::size_t payloadSize)
+    {
+        FarmMessageHeader messageHeader{ FARM_MESSAGE_MAGIC, static_cast<std::uint32_t>(type), headerSize + payloadSize };
+        return WriteAll(mSocket, &messageHeader, sizeof(messageHeader)) &&
+               WriteAll(mSocket, header, headerSize) &&
+               WriteAll(mSocket, payload, payloadSize);
+    }
+
+    ////////////////////////////////////////
+    bool FarmConnection::Receive(FarmMessageType& type, std::vector<std::uint8_t>& message)
+    {
+        FarmMessageHeader messageHeader{};
+        if (!ReadAll(mSocket, &messageHeader, sizeof(messageHeader))) {
+            return false;
+        }
+        if (messageHeader.mMagic != FARM_MESSAGE_MAGIC || messageHeader.mSize > DEFAULT_FARM_MAX_MESSAGE_SIZE) {
+            Log("CursedRay: dropping a farm peer that sent a malformed message");
+            return false;
+        }
+        type = static_cast<FarmMessageType>(messageHeader.mType);
+        message.resize(static_cast<std::size_t>(messageHeader.mSize));
+        return ReadAll(mSocket, message.data(), message.size());
+    }
+
+    ////////////////////////////////////////
+    bool FarmConnection::TryReceive(FarmMessageType& type, std::vector<std::uint8_t>& message, bool& isComplete)
+    {
+        // picks up where the previous call stopped, a slow peer never holds up the caller
+        isComplete = false;
+        if (!mIsPayload) {
+            mPending.resize(sizeof(FarmMessageHeader));
+            if (!ReadAvailable(mSocket, mPending.data(), mPending.size(), mReceived)) {
+                return false;
+            }
+            if (mReceived < mPending.size()) {
+                return true;
+            }
+
+            FarmMessageHeader messageHeader{};
+            std::memcpy(&messageHeader, mPending.data(), sizeof(messageHeader));
+            if (messageHeader.mMagic != FARM_MESSAGE_MAGIC || messageHeader.mSize > DEFAULT_FARM_MAX_MESSAGE_SIZE) {
+                Log("CursedRay: dropping a farm peer that sent a malformed message");
+                return false;
+            }
+            mPendingType = static_cast<FarmMessageType>(messageHeader.mType);
+            mPending.resize(static_cast<std::size_t>(messageHeader.mSize));
+            mReceived = 0;
+            mIsPayload = true;
+        }
+
+        if (!ReadAvailable(mSocket, mPending.data(), mPending.size(), mReceived)) {
+            return false;
+        }
+        if (mReceived == mPending.size()) {
+            type = mPendingType;
+            message.swap(mPending);
+            mReceived = 0;
+            mIsPayload = false;
+            isComplete = true;
+        }
+        return true;
+    }
+
+    ////////////////////////////////////////
+    FarmCoordinator::FarmCoordinator(const char* address, std::uint32_t width, std::uint32_t height,
+                                     SceneType sceneType, std::uint32_t samplesPerFrame)
+        : mJob{}, mSamplesPerFrame{ samplesPerFrame },
+          mAccumulation(static_cast<std::size_t>(width) * height, glm::vec4(0.0f)), mMergedSamples{}
+    {
+        mJob.mWidth = width;
+        mJob.mHeight = height;
+        mJob.mSceneType = static_cast<std::uint32_t>(sceneType);
+        mJob.mNumFrames = DEFAULT_FARM_BATCH_FRAMES;
+
+        mListenSocket = OpenSocket(address, true, mSocketPath);
+        if (mListenSocket < 0) {
+            Log("CursedRay: could not listen on %s: %s", address, std::strerror(errno));
+            return;
+        }
+        Log("CursedRay: render farm listening on %s", address);
+    }
+
+    ////////////////////////////////////////
+    FarmCoordinator::~FarmCoordinator()
+    {
+        for (Worker& worker : mWorkers) {
+            worker.mConnection.Send(FarmMessageType::Shutdown, nullptr, 0);
+        }
+        mWorkers.clear();
+
+        for (pid_t process : mProcesses) {
+            ::waitpid(process, nullptr, 0);
+        }
+        if (mListenSocket >= 0) {
+            ::close(mListenSocket);
+        }
+        if (!mSocketPath.empty()) {
+            ::unlink(mSocketPath.c_str());
+        }
+    }
+
+    ////////////////////////////////////////
+    void FarmCoordinator::SpawnWorkers(std::uint32_t count, const char* address, int argc, char** argv)
+    {
+        // workers get the coordinator's own options, minus the ones that only make sense here
+        std::vector<char*> arguments{ argv[0] };
+        for (int i{ 1 }; i < argc; ++i) {
+            bool takesValue{ !std::strncmp(argv[i], "--farm", DEFAULT_ARG_STR_LEN) ||
+                             !std::strncmp(argv[i], "--farm-listen", DEFAULT_ARG_STR_LEN) ||
+                             !std::strncmp(argv[i], "--hdr-output", DEFAULT_ARG_STR_LEN) };
+            if (takesValue) {
+                ++i;
+                continue;
+            }
+            arguments.push_back(argv[i]);
+        }
+        std::string workerFlag{ "--worker" };
+        std::string workerAddress{ address };
+        arguments.push_back(workerFlag.data());
+        arguments.push_back(workerAddress.data());
+        arguments.push_back(nullptr);
+
+        // notcurses runs threads of its own by now, so the child may only make async-signal-safe calls
+        // before exec: everything that allocates, including the NUMA node CPU sets, is prepared here
+        std::vector<cpu_set_t> nodes{ GetNumaNodeCpus() };
+        for (std::uint32_t worker{}; worker < count; ++worker) {
+            // workers are dealt out over the nodes round-robin
+            const cpu_set_t* cpus{ nodes.empty() ? nullptr : &nodes[worker % nodes.size()] };
+            pid_t process{ ::fork() };
+            if (process == 0) {
+                // keep the worker away from the terminal notcurses is drawing on
+                int devNull{ ::open("/dev/null", O_RDWR) };
+                if (devNull >= 0) {
+                    ::dup2(devNull, STDIN_FILENO);
+                    ::dup2(devNull, STDOUT_FILENO);
+                    ::dup2(devNull, STDERR_FILENO);
+                }
+                if (cpus != nullptr) {
+                    ::sched_setaffinity(0, sizeof(*cpus), cpus);
+                }
+                ::execv("/proc/self/exe", arguments.data());
+                ::_exit(EXIT_FAILURE);
+            }
+            if (process < 0) {
+                Log("CursedRay: could not spawn a farm worker: %s", std::strerror(errno));
+                break;
+            }
+            mProcesses.push_back(process);
+        }
+        Log("CursedRay: spawned %zu farm workers", mProcesses.size());
+    }
+
+    ////////////////////////////////////////
+    void FarmCoordinator::SetView(const Camera& camera, const glm::vec4& clearColor)
+    {
+        FarmJob job{ mJob };
+        job.mCameraPosition[0] = camera.GetPosition().x;
+        job.mCameraPosition[1] = camera.GetPosition().y;
+        job.mCameraPosition[2] = camera.GetPosition().z;
+        job.mFocalLength = camera.GetFocalLength();
+        job.mYaw = camera.GetYaw();
+        job.mPitch = camera.GetPitch();
+        job.mClearColor[0] = clearColor.r;
+        job.mClearColor[1] = clearColor.g;
+        job.mClearColor[2] = clearColor.b;
+        job.mClearColor[3] = clearColor.a;
+        if (mJob.mGeneration > 0 && std::memcmp(&job, &mJob, sizeof(job)) == 0) {
+            return;
+        }
+
+        // batches in flight finish with the old view and are thrown away on arrival
+        job.mGeneration = mJob.mGeneration + 1;
+        job.mFirstSample = 0;
+        mJob = job;
+        std::fill(mAccumulation.begin(), mAccumulation.end(), glm::vec4(0.0f));
+        mMergedSamples = 0;
+    }
+
+    ////////////////////////////////////////
+    void FarmCoordinator::Accept()
+    {
+        int socket{ ::accept4(mListenSocket, nullptr, nullptr, SOCK_CLOEXEC) };
+        if (socket < 0) {
+            return;
+        }
+        // the lowest free index, so a restarted worker picks up the caches its predecessor left
+        std::uint32_t index{};
+        while (std::any_of(mWorkers.begin(), mWorkers.end(), [index](const Worker& worker) { return worker.mIndex == index; })) {
+            ++index;
+        }
+        mWorkers.push_back({ FarmConnection(socket), 0, index });
+        Log("CursedRay: farm worker %u connected", index);
+    }
+
+    ////////////////////////////////////////
+    bool FarmCoordinator::Dispatch(Worker& worker)
+    {
+        // each batch claims the next range of sample indices, no two workers ever trace the same one
+        FarmJob job{ mJob };
+        job.mWorkerIndex = worker.mIndex;
+        bool isSent{ worker.mConnection.Send(FarmMessageType::Job, &job, sizeof(job)) };
+        mJob.mFirstSample += mJob.mNumFrames * mSamplesPerFrame;
+        return isSent;
+    }
+
+    ////////////////////////////////////////
+    bool FarmCoordinator::Merge(const std::vector<std::uint8_t>& message)
+    {
+        FarmResult result{};
+        if (message.size() < sizeof(result)) {
+            return false;
+        }
+        std::memcpy(&result, message.data(), sizeof(result));
+        if (result.mNumPixels != mAccumulation.size() || message.size() != sizeof(result) + mAccumulation.size() * sizeof(glm::vec4)) {
+            return false;
+        }
+        if (result.mGeneration != mJob.mGeneration) {
+            return true;
+        }
+
+        // radiance sums and sample counts both add up, w carries the count
+        const std::uint8_t* pixels{ message.data() + sizeof(result) };
+        for (std::size_t i{}; i < mAccumulation.size(); ++i) {
+            glm::vec4 pixel;
+            std::memcpy(&pixel, pixels + i * sizeof(glm::vec4), sizeof(pixel));
+            mAccumulation[i] += pixel;
+        }
+        mMergedSamples += result.mNumSamples;
+        return true;
+    }
+
+    ////////////////////////////////////////
+    bool FarmCoordinator::Poll(int timeout)
+    {
+        if (mListenSocket < 0) {
+            return false;
+        }
+
+        std::vector<pollfd> sockets{ { mListenSocket, POLLIN, 0 } };
+        for (const Worker& worker : mWorkers) {
+            sockets.push_back({ worker.mConnection.GetSocket(), POLLIN, 0 });
+        }
+        if (::poll(sockets.data(), sockets.size(), timeout) <= 0) {
+            return false;
+        }
+
+        bool isMerged{};
+        std::vector<std::uint8_t> message;
+        for (std::size_t i{ sockets.size() - 1 }; i > 0; --i) {
+            if (sockets[i].revents == 0) {
+                continue;
+            }
+            // a result is the worker asking for more, the pull keeps fast workers busy
+            Worker& worker{ mWorkers[i - 1] };
+            FarmMessageType type{};
+            bool isComplete{};
+            bool isAlive{ worker.mConnection.TryReceive(type, message, isComplete) };
+            if (isAlive && !isComplete) {
+                continue;
+            }
+            if (isAlive && type == FarmMessageType::Result) {
+                std::uint32_t mergedSamples{ mMergedSamples };
+                isAlive = Merge(message);
+                worker.mSamplesDone += mMergedSamples - mergedSamples;
+                isMerged |= mMergedSamples != mergedSamples;
+            }
+            isAlive = isAlive && (type == FarmMessageType::Hello || type == FarmMessageType::Result) && Dispatch(worker);
+            if (!isAlive) {
+                Log("CursedRay: farm worker disconnected after %u samples", worker.mSamplesDone);
+                mWorkers.erase(mWorkers.begin() + static_cast<std::ptrdiff_t>(i - 1));
+            }
+        }
+        if (sockets.front().revents & POLLIN) {
+            Accept();
+        }
+        return isMerged;
+    }
+
+    ////////////////////////////////////////
+    void FarmCoordinator::Resolve(HDRFramebuffer& framebuffer) const
+    {
+        glm::vec4 clearColor(mJob.mClearColor[0], mJob.mClearColor[1], mJob.mClearColor[2], mJob.mClearColor[3]);
+        float* pixels{ framebuffer.GetData() };
+        std::size_t numPixels{ std::min(framebuffer.GetNumPixels(), mAccumulation.size()) };
+        for (std::size_t i{}; i < numPixels; ++i) {
+            const glm::vec4& sum{ mAccumulation[i] };
+            glm::vec4 radiance{ sum.w > 0.0f ? glm::vec4(sum.x / sum.w, sum.y / sum.w, sum.z / sum.w, 1.0f) : clearColor };
+            std::memcpy(pixels + i * 4, &radiance, sizeof(radiance));
+        }
+    }
+
+    ////////////////////////////////////////
+    bool RunFarmWorker(const char* address, const HWDeviceOptions& options)
+    {
+        FarmConnection connection;
+        std::string socketPath;
+        for (std::uint32_t attempt{}; attempt < DEFAULT_FARM_CONNECT_ATTEMPTS && !connection.IsOpen(); ++attempt) {
+            // remote workers may well be started before the coordinator
+            if (attempt > 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(DEFAULT_FARM_CONNECT_INTERVAL));
+            }
+            connection = FarmConnection(OpenSocket(address, false, socketPath));
+        }
+        if (!connection.IsOpen() || !connection.Send(FarmMessageType::Hello, nullptr, 0)) {
+            Log("CursedRay: could not reach the farm coordinator at %s", address);
+            return false;
+        }
+
+        // the device lives across jobs and is only rebuilt when the image or scene changes
+        std::unique_ptr<DisplayFramebuffer> framebuffer;
+        std::unique_ptr<Scene> scene;
+        std::unique_ptr<HWDevice> hwDevice;
+        FarmJob currentJob{};
+
+        std::vector<std::uint8_t> message;
+        std::vector<glm::vec4> accumulation;
+        for (FarmMessageType type{}; connection.Receive(type, message) && type == FarmMessageType::Job;) {
+            FarmJob job{};
+            if (message.size() != sizeof(job)) {
+                return false;
+            }
+            std::memcpy(&job, message.data(), sizeof(job));
+
+            if (!hwDevice || job.mWidth != currentJob.mWidth || job.mHeight != currentJob.mHeight || job.mSceneType != currentJob.mSceneType) {
+                hwDevice.reset();
+                framebuffer = std::make_unique<DisplayFramebuffer>(FramebufferOptions(job.mWidth, job.mHeight, glm::vec4(0.0f)));
+                scene = std::make_unique<Scene>(static_cast<SceneType>(job.mSceneType));
+                // local workers share the coordinator's working directory, each one keeps caches of its own
+                HWDeviceOptions workerOptions{ options };
+                workerOptions.mTuningCacheFile = GetWorkerCacheFile(DEFAULT_TUNING_CACHE_FILE, job.mWorkerIndex);
+                workerOptions.mDeviceCacheFile = GetWorkerCacheFile(DEFAULT_DEVICE_CACHE_FILE, job.mWorkerIndex);
+                hwDevice = std::make_unique<HWDevice>(*framebuffer, *scene, workerOptions);
+            }
+            currentJob = job;
+
+            Camera camera(glm::vec3(job.mCameraPosition[0], job.mCameraPosition[1], job.mCameraPosition[2]),
+                          job.mFocalLength, job.mYaw, job.mPitch);
+            glm::vec4 clearColor(job.mClearColor[0], job.mClearColor[1], job.mClearColor[2], job.mClearColor[3]);
+            hwDevice->ResetAccumulation();
+            hwDevice->SeekSamples(job.mFirstSample);
+            for (std::uint32_t frame{}; frame < job.mNumFrames; ++frame) {
+                hwDevice->EnqueuePathTrace(camera, clearColor);
+            }
+            hwDevice->ReadAccumulation(accumulation);
+
+            FarmResult result{ job.mGeneration, job.mFirstSample, job.mNumFrames * options.mSamplesPerPixel,
+                               static_cast<std::uint32_t>(accumulation.size()) };
+            if (!connection.Send(FarmMessageType::Result, &result, sizeof(result),
+                                 accumulation.data(), accumulation.size() * sizeof(glm::vec4))) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
@@ -0,0 +1,132 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "ResolutionController.hpp"
+#include "Constants.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    ResolutionController::ResolutionController(std::uint32_t displayWidth,
+                                               std::uint32_t displayHeight,
+                                               std::uint32_t samplesPerPixel,
+                                               std::uint32_t targetFps)
+        : mDisplayWidth{ displayWidth }, mDisplayHeight{ displayHeight },
+          mMaxSamplesPerPixel{ std::max<std::uint32_t>(samplesPerPixel, 1) },
+          mTargetFrameTime{ 1000.0 / std::max<std::uint32_t>(targetFps, 1) }, mFrameTime{},
+          mMovingLevel{}, mMovingSamplesPerPixel{ mMaxSamplesPerPixel },
+          mLevel{}, mSamplesPerPixel{ mMaxSamplesPerPixel },
+          mFramesSinceChange{}, mStillFrames{}
+    {
+    }
+
+    ////////////////////////////////////////
+    float ResolutionController::GetScale(std::uint32_t level)
+    {
+        return 1.0f - static_cast<float>(level) * DEFAULT_RENDER_SCALE_STEP;
+    }
+
+    ////////////////////////////////////////
+    std::uint32_t ResolutionController::GetNumLevels()
+    {
+        return static_cast<std::uint32_t>((1.0f - DEFAULT_MIN_RENDER_SCALE) / DEFAULT_RENDER_SCALE_STEP + 0.5f) + 1;
+    }
+
+    ////////////////////////////////////////
+    double ResolutionController::GetCost(std::uint32_t level, std::uint32_t samplesPerPixel) const
+    {
+        // tracing dominates, its cost follows the number of samples taken
+        double scale{ GetScale(level) };
+        return scale * scale * samplesPerPixel;
+    }
+
+    ////////////////////////////////////////
+    void ResolutionController::Apply(std::uint32_t level, std::uint32_t samplesPerPixel)
+    {
+        // rescale the smoothed time so the next decision does not act on the old setting's history
+        mFrameTime *= GetCost(level, samplesPerPixel) / GetCost(mLevel, mSamplesPerPixel);
+        mLevel = level;
+        mSamplesPerPixel = samplesPerPixel;
+        mFramesSinceChange = 0;
+    }
+
+    ////////////////////////////////////////
+    void ResolutionController::Update(double frameTime, bool isMoving)
+    {
+        mFrameTime = mFrameTime > 0.0 ? mFrameTime + DEFAULT_FRAME_TIME_SMOOTHING * (frameTime - mFrameTime) : frameTime;
+        ++mFramesSinceChange;
+
+        if (!isMoving) {
+            if (++mStillFrames == DEFAULT_RENDER_SCALE_STILL_FRAMES && (mLevel != 0 || mSamplesPerPixel != mMaxSamplesPerPixel)) {
+                mMovingLevel = mLevel;
+                mMovingSamplesPerPixel = mSamplesPerPixel;
+                Apply(0, mMaxSamplesPerPixel);
+            }
+            return;
+        }
+        if (mStillFrames >= DEFAULT_RENDER_SCALE_STILL_FRAMES) {
+            Apply(mMovingLevel, mMovingSamplesPerPixel);
+        }
+        mStillFrames = 0;
+
+        // give every setting a few frames to show up in the smoothed time before judging it
+        if (mFramesSinceChange < DEFAULT_RENDER_SCALE_SETTLE_FRAMES) {
+            return;
+        }
+
+        if (mFrameTime > mTargetFrameTime) {
+            if (mSamplesPerPixel > 1) {
+                Apply(mLevel, mSamplesPerPixel / 2);
+            }
+            else if (mLevel + 1 < GetNumLevels()) {
+                Apply(mLevel + 1, mSamplesPerPixel);
+            }
+            return;
+        }
+
+        // step back up in the reverse order, but only when the predicted time leaves some headroom
+        std::uint32_t level{ mLevel };
+        std::uint32_t samplesPerPixel{ mSamplesPerPixel };
+        if (level > 0) {
+            --level;
+        }
+        else if (samplesPerPixel < mMaxSamplesPerPixel) {
+            samplesPerPixel = std::min(samplesPerPixel * 2, mMaxSamplesPerPixel);
+        }
+        else {
+            return;
+        }
+        double predicted{ mFrameTime * GetCost(level, samplesPerPixel) / GetCost(mLevel, mSamplesPerPixel) };
+        if (predicted < mTargetFrameTime * DEFAULT_RENDER_SCALE_HEADROOM) {
+            Apply(level, samplesPerPixel);
+        }
+    }
+
+    ////////////////////////////////////////
+    std::uint32_t ResolutionController::GetRenderWidth() const
+    {
+        return std::max(1u, static_cast<std::uint32_t>(std::lround(static_cast<float>(mDisplayWidth) * GetScale(mLevel))));
+    }
+
+    ////////////////////////////////////////
+    std::uint32_t ResolutionController::GetRenderHeight() const
+    {
+        return std::max(1u, static_cast<std::uint32_t>(std::lround(static_cast<float>(mDisplayHeight) * GetScale(mLevel))));
+    }
+}
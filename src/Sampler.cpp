@@ -0,0 +1,191 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "Sampler.hpp"
+#include "Log.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    struct SobolPolynomial
+    {
+        std::uint32_t mDegree;
+        std::uint32_t mCoefficients;
+        std::array<std::uint32_t, 5> mInitialNumbers;
+    };
+
+    ////////////////////////////////////////
+    // primitive polynomials and initial direction numbers from Joe & Kuo (new-joe-kuo-6.21201),
+    // the first dimension is the van der Corput sequence and needs no entry
+    static constexpr std::array<SobolPolynomial, SOBOL_DIMENSIONS - 1> SOBOL_POLYNOMIALS{{
+        { 1, 0, { 1 } },
+        { 2, 1, { 1, 3 } },
+        { 3, 1, { 1, 3, 1 } },
+        { 3, 2, { 1, 1, 1 } },
+        { 4, 1, { 1, 1, 3, 3 } },
+        { 4, 4, { 1, 3, 5, 13 } },
+        { 5, 2, { 1, 1, 5, 5, 17 } }
+    }};
+
+    ////////////////////////////////////////
+    std::vector<std::uint32_t> GenerateSobolDirections()
+    {
+        std::vector<std::uint32_t> directions(SOBOL_DIMENSIONS * SOBOL_BITS);
+        for (std::uint32_t bit{}; bit < SOBOL_BITS; ++bit) {
+            directions[bit] = 1u << (SOBOL_BITS - 1 - bit);
+        }
+
+        for (std::uint32_t dim{ 1 }; dim < SOBOL_DIMENSIONS; ++dim) {
+            const SobolPolynomial& polynomial{ SOBOL_POLYNOMIALS[dim - 1] };
+            std::uint32_t* v{ directions.data() + dim * SOBOL_BITS };
+            std::uint32_t s{ polynomial.mDegree };
+
+            for (std::uint32_t bit{}; bit < s; ++bit) {
+                v[bit] = polynomial.mInitialNumbers[bit] << (SOBOL_BITS - 1 - bit);
+            }
+            for (std::uint32_t bit{ s }; bit < SOBOL_BITS; ++bit) {
+                v[bit] = v[bit - s] ^ (v[bit - s] >> s);
+                for (std::uint32_t k{ 1 }; k < s; ++k) {
+                    v[bit] ^= ((polynomial.mCoefficients >> (s - 1 - k)) & 1u) * v[bit - k];
+                }
+            }
+        }
+        return directions;
+    }
+
+    ////////////////////////////////////////
+    // void-and-cluster (Ulichney 1993) on a torus, returns the rank of every texel
+    std::vector<std::uint32_t> GenerateBlueNoise(std::uint32_t size)
+    {
+        auto begin{ std::chrono::steady_clock::now() };
+
+        const std::size_t numTexels{ static_cast<std::size_t>(size) * size };
+        constexpr float sigma{ 1.5f };
+
+        std::vector<float> gaussian(numTexels);
+        for (std::uint32_t y{}; y < size; ++y) {
+            for (std::uint32_t x{}; x < size; ++x) {
+                float dx{ static_cast<float>(std::min(x, size - x)) };
+                float dy{ static_cast<float>(std::min(y, size - y)) };
+                gaussian[y * size + x] = std::exp(-(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+            }
+        }
+
+        std::vector<std::uint8_t> pattern(numTexels);
+        std::vector<float> energy(numTexels);
+        auto splat{ [&](std::size_t texel, float sign) {
+            std::uint32_t tx{ static_cast<std::uint32_t>(texel % size) };
+            std::uint32_t ty{ static_cast<std::uint32_t>(texel / size) };
+            for (std::uint32_t y{}; y < size; ++y) {
+                std::uint32_t oy{ ((y + size - ty) % size) * size };
+                for (std::uint32_t x{}; x < size; ++x) {
+                    energy[y * size + x] += sign * gaussian[oy + (x + size - tx) % size];
+                }
+            }
+        } };
+        auto tightestCluster{ [&]() {
+            std::size_t best{};
+            float bestEnergy{ -1.0f };
+            for (std::size_t i{}; i < numTexels; ++i) {
+                if (pattern[i] && energy[i] > bestEnergy) {
+                    bestEnergy = energy[i];
+                    best = i;
+                }
+            }
+            return best;
+        } };
+        auto largestVoid{ [&]() {
+            std::size_t best{};
+            float bestEnergy{ INFINITY };
+            for (std::size_t i{}; i < numTexels; ++i) {
+                if (!pattern[i] && energy[i] < bestEnergy) {
+                    bestEnergy = energy[i];
+                    best = i;
+                }
+            }
+            return best;
+        } };
+
+        // initial binary pattern, relaxed until moving the tightest cluster does not change it
+        std::mt19937 generator{ 0x5eedu };
+        std::uniform_int_distribution<std::size_t> distribution(0, numTexels - 1);
+        const std::size_t numInitial{ std::max<std::size_t>(numTexels / 10, 1) };
+        for (std::size_t placed{}; placed < numInitial;) {
+            std::size_t texel{ distribution(generator) };
+            if (!pattern[texel]) {
+                pattern[texel] = 1;
+                splat(texel, 1.0f);
+                ++placed;
+            }
+        }
+        for (;;) {
+            std::size_t cluster{ tightestCluster() };
+            pattern[cluster] = 0;
+            splat(cluster, -1.0f);
+            std::size_t largest{ largestVoid() };
+            pattern[largest] = 1;
+            splat(largest, 1.0f);
+            if (largest == cluster) {
+                break;
+            }
+        }
+
+        std::vector<std::uint32_t> ranks(numTexels);
+        std::vector<std::uint8_t> prototype{ pattern };
+        std::vector<float> prototypeEnergy{ energy };
+
+        // phase 1: rank the initial points by removing tightest clusters
+        for (std::size_t rank{ numInitial }; rank > 0; --rank) {
+            std::size_t cluster{ tightestCluster() };
+            pattern[cluster] = 0;
+            splat(cluster, -1.0f);
+            ranks[cluster] = static_cast<std::uint32_t>(rank - 1);
+        }
+
+        // phases 2 and 3: fill the largest voids until every texel is ranked
+        pattern = prototype;
+        energy = prototypeEnergy;
+        for (std::size_t rank{ numInitial }; rank < numTexels; ++rank) {
+            std::size_t largest{ largestVoid() };
+            pattern[largest] = 1;
+            splat(largest, 1.0f);
+            ranks[largest] = static_cast<std::uint32_t>(rank);
+        }
+
+        auto end{ std::chrono::steady_clock::now() };
+        Log("CursedRay: generated %ux%u blue noise in %f milliseconds", size, size,
+            std::chrono::duration<double, std::milli>(end - begin).count());
+        return ranks;
+    }
+
+    ////////////////////////////////////////
+    std::string GetSamplerBuildOptions()
+    {
+        std::string options{ " -DSOBOL_DIMENSIONS=" };
+        options.append(std::to_string(SOBOL_DIMENSIONS));
+        options.append(" -DSOBOL_BITS=");
+        options.append(std::to_string(SOBOL_BITS));
+        options.append(" -DBLUE_NOISE_SIZE=");
+        options.append(std::to_string(BLUE_NOISE_SIZE));
+        return options;
+    }
+}
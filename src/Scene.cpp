@@ -0,0 +1,133 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "Scene.hpp"
+#include "Constants.hpp"
+#include "Log.hpp"
+
+#include <cmath>
+#include <numbers>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    Scene::Scene(SceneType type)
+        : mNumLights{}
+    {
+        switch (type) {
+            case SceneType::Default:
+                CreateDefaultScene();
+                break;
+            case SceneType::Lamps:
+                CreateLampsScene();
+                break;
+        }
+        Log("CursedRay: scene has %u spheres and %u lights", GetNumSpheres(), mNumLights);
+    }
+
+    ////////////////////////////////////////
+    void Scene::CreateDefaultScene()
+    {
+        AddSphere(glm::vec3(0.0f, -100.5f, -1.5f), 100.0f, glm::vec3(0.8f, 0.8f, 0.8f));
+        AddSphere(glm::vec3(0.0f, 0.0f, -1.5f), 0.5f, glm::vec3(0.7f, 0.3f, 0.3f));
+        AddSphere(glm::vec3(-1.0f, 0.0f, -1.5f), 0.5f, glm::vec3(0.3f, 0.7f, 0.3f));
+        AddSphere(glm::vec3(1.0f, 0.0f, -1.5f), 0.5f, glm::vec3(0.3f, 0.3f, 0.7f));
+        AddSphere(glm::vec3(0.0f, 1.5f, -1.5f), 0.3f, glm::vec3(0.0f), glm::vec3(12.0f, 11.0f, 10.0f));
+
+        AddBouncingSphere(1, 0.0f);
+        AddBouncingSphere(2, 1.0f / 3.0f);
+        AddBouncingSphere(3, 2.0f / 3.0f);
+    }
+
+    ////////////////////////////////////////
+    void Scene::CreateLampsScene()
+    {
+        // an enclosed room lit only by a ceiling grid of small lamps
+        AddSphere(glm::vec3(0.0f, -1000.5f, -3.0f), 1000.0f, glm::vec3(0.7f, 0.7f, 0.7f));
+        AddSphere(glm::vec3(0.0f, 0.0f, -3.0f), 12.0f, glm::vec3(0.6f, 0.55f, 0.5f));
+        AddSphere(glm::vec3(0.0f, 0.0f, -2.0f), 0.5f, glm::vec3(0.7f, 0.3f, 0.3f));
+        AddSphere(glm::vec3(-1.2f, 0.0f, -2.5f), 0.5f, glm::vec3(0.3f, 0.7f, 0.3f));
+        AddSphere(glm::vec3(1.2f, 0.0f, -2.5f), 0.5f, glm::vec3(0.3f, 0.3f, 0.7f));
+
+        AddBouncingSphere(2, 0.0f);
+        AddBouncingSphere(3, 1.0f / 3.0f);
+        AddBouncingSphere(4, 2.0f / 3.0f);
+
+        const std::uint32_t lampsPerSide{ DEFAULT_SCENE_LAMPS_PER_SIDE };
+        for (std::uint32_t row{}; row < lampsPerSide; ++row) {
+            for (std::uint32_t col{}; col < lampsPerSide; ++col) {
+                float u{ (static_cast<float>(col) + 0.5f) / static_cast<float>(lampsPerSide) };
+                float v{ (static_cast<float>(row) + 0.5f) / static_cast<float>(lampsPerSide) };
+                glm::vec3 center(-4.0f + 8.0f * u, 2.5f, -7.0f + 8.0f * v);
+                glm::vec3 tint(1.0f, 0.85f + 0.15f * u, 0.7f + 0.3f * v);
+                AddSphere(center, 0.04f, glm::vec3(0.0f), tint * 40.0f);
+            }
+        }
+    }
+
+    ////////////////////////////////////////
+    void Scene::AddSphere(const glm::vec3& center,
+                          float radius,
+                          const glm::vec3& albedo,
+                          const glm::vec3& emission)
+    {
+        bool isEmitter{ emission.x > 0.0f || emission.y > 0.0f || emission.z > 0.0f };
+        float lightIndex{ isEmitter ? static_cast<float>(mNumLights++) : -1.0f };
+        mSpheres.push_back(Sphere{ glm::vec4(center, radius),
+                                   glm::vec4(albedo, 1.0f),
+                                   glm::vec4(emission, lightIndex) });
+        mIsDirty.push_back(false);
+    }
+
+    ////////////////////////////////////////
+    void Scene::AddBouncingSphere(std::uint32_t index, float phase)
+    {
+        const glm::vec4& centerRadius{ mSpheres[index].mCenterRadius };
+        mBouncingSpheres.push_back(BouncingSphere{ index, glm::vec3(centerRadius.x, centerRadius.y, centerRadius.z), phase });
+    }
+
+    ////////////////////////////////////////
+    void Scene::TransformSphere(std::uint32_t index, const glm::vec3& center, float radius)
+    {
+        mSpheres[index].mCenterRadius = glm::vec4(center, radius);
+        if (!mIsDirty[index]) {
+            mIsDirty[index] = true;
+            mDirtySpheres.push_back(index);
+        }
+    }
+
+    ////////////////////////////////////////
+    void Scene::Animate(float time)
+    {
+        // spheres hop off the floor and land back on it once per period, out of step with each other
+        for (const BouncingSphere& bouncing : mBouncingSpheres) {
+            float cycle{ time / DEFAULT_SCENE_BOUNCE_PERIOD + bouncing.mPhase };
+            float height{ DEFAULT_SCENE_BOUNCE_HEIGHT * std::abs(std::sin(std::numbers::pi_v<float> * cycle)) };
+            TransformSphere(bouncing.mIndex,
+                            bouncing.mRestCenter + glm::vec3(0.0f, height, 0.0f),
+                            mSpheres[bouncing.mIndex].mCenterRadius.w);
+        }
+    }
+
+    ////////////////////////////////////////
+    void Scene::ClearDirtySpheres()
+    {
+        for (std::uint32_t index : mDirtySpheres) {
+            mIsDirty[index] = false;
+        }
+        mDirtySpheres.clear();
+    }
+}
@@ -0,0 +1,193 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "SceneBvh.hpp"
+#include "Scene.hpp"
+#include "Constants.hpp"
+#include "Log.hpp"
+
+#include <glm/common.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    static double GetSurfaceArea(const BvhNode& node)
+    {
+        glm::vec4 extent{ node.mBoundsMax - node.mBoundsMin };
+        return 2.0 * (static_cast<double>(extent.x) * extent.y +
+                      static_cast<double>(extent.y) * extent.z +
+                      static_cast<double>(extent.z) * extent.x);
+    }
+
+    ////////////////////////////////////////
+    static void GetSphereBounds(const Sphere& sphere, glm::vec4& boundsMin, glm::vec4& boundsMax)
+    {
+        glm::vec3 center(sphere.mCenterRadius.x, sphere.mCenterRadius.y, sphere.mCenterRadius.z);
+        glm::vec3 extent(sphere.mCenterRadius.w);
+        boundsMin = glm::vec4(center - extent, 0.0f);
+        boundsMax = glm::vec4(center + extent, 0.0f);
+    }
+
+    ////////////////////////////////////////
+    SceneBvh::SceneBvh(const Scene& scene)
+        : mInflationSum{}, mNumInteriorNodes{}
+    {
+        auto begin{ std::chrono::steady_clock::now() };
+
+        const std::vector<Sphere>& spheres{ scene.GetSpheres() };
+        mLeaves.resize(spheres.size());
+
+        std::vector<std::uint32_t> sphereIndices(spheres.size());
+        for (std::uint32_t i{}; i < scene.GetNumSpheres(); ++i) {
+            sphereIndices[i] = i;
+        }
+
+        if (!sphereIndices.empty()) {
+            mNodes.reserve(2 * sphereIndices.size() - 1);
+            Build(sphereIndices, 0, sphereIndices.size(), BVH_NODE_ROOT, spheres);
+        }
+
+        mBuildAreas.resize(mNodes.size());
+        for (std::size_t i{}; i < mNodes.size(); ++i) {
+            mBuildAreas[i] = GetSurfaceArea(mNodes[i]);
+        }
+        mNumInteriorNodes = mNodes.size() / 2;
+        mInflationSum = static_cast<double>(mNumInteriorNodes);
+
+        auto end{ std::chrono::steady_clock::now() };
+        Log("CursedRay: built scene BVH with %zu nodes over %zu spheres in %f milliseconds",
+            mNodes.size(), spheres.size(), std::chrono::duration<double, std::milli>(end - begin).count());
+    }
+
+    ////////////////////////////////////////
+    std::uint32_t SceneBvh::Build(std::vector<std::uint32_t>& sphereIndices,
+                                  std::size_t begin,
+                                  std::size_t end,
+                                  std::uint32_t parent,
+                                  const std::vector<Sphere>& spheres)
+    {
+        std::uint32_t nodeIndex{ static_cast<std::uint32_t>(mNodes.size()) };
+        mNodes.push_back(BvhNode{});
+
+        glm::vec4 boundsMin(INFINITY), boundsMax(-INFINITY);
+        glm::vec3 centroidMin(INFINITY), centroidMax(-INFINITY);
+        for (std::size_t i{ begin }; i < end; ++i) {
+            const Sphere& sphere{ spheres[sphereIndices[i]] };
+            glm::vec4 sphereMin, sphereMax;
+            GetSphereBounds(sphere, sphereMin, sphereMax);
+            boundsMin = glm::min(boundsMin, sphereMin);
+            boundsMax = glm::max(boundsMax, sphereMax);
+            glm::vec3 center(sphere.mCenterRadius.x, sphere.mCenterRadius.y, sphere.mCenterRadius.z);
+            centroidMin = glm::min(centroidMin, center);
+            centroidMax = glm::max(centroidMax, center);
+        }
+
+        BvhNode node{};
+        node.mBoundsMin = boundsMin;
+        node.mBoundsMax = boundsMax;
+        node.mParent = parent;
+
+        if (end - begin == 1) {
+            node.mLeftOrSphere = sphereIndices[begin];
+            node.mRight = BVH_NODE_LEAF;
+            mLeaves[sphereIndices[begin]] = nodeIndex;
+            mNodes[nodeIndex] = node;
+            return nodeIndex;
+        }
+
+        // median split of the centroids along the longest axis keeps the depth at log2 of the sphere count,
+        // well within the kernel's traversal stack
+        glm::vec3 centroidExtent{ centroidMax - centroidMin };
+        int axis{ centroidExtent.x > centroidExtent.y ? (centroidExtent.x > centroidExtent.z ? 0 : 2)
+                                                      : (centroidExtent.y > centroidExtent.z ? 1 : 2) };
+        std::size_t middle{ begin + (end - begin) / 2 };
+        std::nth_element(sphereIndices.begin() + static_cast<std::ptrdiff_t>(begin),
+                         sphereIndices.begin() + static_cast<std::ptrdiff_t>(middle),
+                         sphereIndices.begin() + static_cast<std::ptrdiff_t>(end),
+                         [&](std::uint32_t a, std::uint32_t b) {
+                             return spheres[a].mCenterRadius[axis] < spheres[b].mCenterRadius[axis];
+                         });
+
+        node.mLeftOrSphere = Build(sphereIndices, begin, middle, nodeIndex, spheres);
+        node.mRight = Build(sphereIndices, middle, end, nodeIndex, spheres);
+        mNodes[nodeIndex] = node;
+        return nodeIndex;
+    }
+
+    ////////////////////////////////////////
+    void SceneBvh::SetBounds(std::uint32_t nodeIndex, const glm::vec4& boundsMin, const glm::vec4& boundsMax)
+    {
+        // inflation is tracked incrementally so that refits never have to visit the whole tree,
+        // leaves only grow when their sphere does, which a rebuild could not improve on
+        BvhNode& node{ mNodes[nodeIndex] };
+        double previousArea{ GetSurfaceArea(node) };
+        node.mBoundsMin = boundsMin;
+        node.mBoundsMax = boundsMax;
+        if (node.mRight != BVH_NODE_LEAF && mBuildAreas[nodeIndex] > 0.0) {
+            mInflationSum += (GetSurfaceArea(node) - previousArea) / mBuildAreas[nodeIndex];
+        }
+    }
+
+    ////////////////////////////////////////
+    void SceneBvh::Refit(const Scene& scene,
+                         const std::vector<std::uint32_t>& dirtySpheres,
+                         std::vector<std::uint32_t>& refitNodes)
+    {
+        const std::vector<Sphere>& spheres{ scene.GetSpheres() };
+
+        std::vector<std::uint32_t> ancestors;
+        for (std::uint32_t sphereIndex : dirtySpheres) {
+            std::uint32_t leaf{ mLeaves[sphereIndex] };
+            glm::vec4 boundsMin, boundsMax;
+            GetSphereBounds(spheres[sphereIndex], boundsMin, boundsMax);
+            SetBounds(leaf, boundsMin, boundsMax);
+            refitNodes.push_back(leaf);
+
+            for (std::uint32_t parent{ mNodes[leaf].mParent }; parent != BVH_NODE_ROOT; parent = mNodes[parent].mParent) {
+                ancestors.push_back(parent);
+            }
+        }
+
+        // parents precede their children, so descending indices visit the tree bottom-up
+        std::sort(ancestors.begin(), ancestors.end(), std::greater<std::uint32_t>());
+        ancestors.erase(std::unique(ancestors.begin(), ancestors.end()), ancestors.end());
+        for (std::uint32_t nodeIndex : ancestors) {
+            const BvhNode& node{ mNodes[nodeIndex] };
+            const BvhNode& left{ mNodes[node.mLeftOrSphere] };
+            const BvhNode& right{ mNodes[node.mRight] };
+            SetBounds(nodeIndex, glm::min(left.mBoundsMin, right.mBoundsMin), glm::max(left.mBoundsMax, right.mBoundsMax));
+        }
+        refitNodes.insert(refitNodes.end(), ancestors.begin(), ancestors.end());
+    }
+
+    ////////////////////////////////////////
+    double SceneBvh::GetInflation() const
+    {
+        // 1 for a freshly built tree
+        return mNumInteriorNodes > 0 ? mInflationSum / static_cast<double>(mNumInteriorNodes) : 1.0;
+    }
+
+    ////////////////////////////////////////
+    bool SceneBvh::NeedsRebuild() const
+    {
+        return GetInflation() > DEFAULT_BVH_REBUILD_INFLATION;
+    }
+}
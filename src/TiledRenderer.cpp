@@ -0,0 +1,320 @@
+// CursedRay: Hardware-accelerated path tracer
+// Copyright (C) 2024 Omar Huseynov
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "TiledRenderer.hpp"
+#include "HWDevice.hpp"
+#include "ImageEncoder.hpp"
+#include "Camera.hpp"
+#include "Scene.hpp"
+#include "Log.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace CursedRay
+{
+    ////////////////////////////////////////
+    /* a region as the device resolved it, reused once the tile cropped out of it is on disk */
+    struct TileWrite
+    {
+        std::vector<std::byte> mStaging;
+        std::future<bool> mIsWritten;
+    };
+
+    ////////////////////////////////////////
+    static std::uint32_t GetRegionOrigin(std::uint32_t tile, std::uint32_t apron, std::uint32_t region, std::uint32_t image)
+    {
+        // centred on the core where it fits, shifted inwards at the image border
+        return std::min(tile - std::min(tile, apron), image - region);
+    }
+
+    ////////////////////////////////////////
+    static std::uint32_t GetTileSize(std::uint32_t region, std::uint32_t image, std::uint32_t apron)
+    {
+        // a region spanning the whole image needs no apron along that axis
+        return region >= image ? image : region - std::min(region, 2 * apron);
+    }
+
+    ////////////////////////////////////////
+    static bool WriteTile(TiledImageFile& file, std::byte* pixels, std::size_t bytesPerChannel, std::uint32_t regionWidth,
+                          std::uint32_t offsetX, std::uint32_t offsetY,
+                          std::uint32_t x, std::uint32_t y, std::uint32_t width, std::uint32_t height)
+    {
+        // rows of the core are packed from RGBA to RGB in place, a packed pixel never overtakes the next unread one
+        std::size_t pixelSize{ 4 * bytesPerChannel };
+        std::size_t packedSize{ 3 * bytesPerChannel };
+        for (std::uint32_t row{}; row < height; ++row) {
+            std::byte* rowPixels{ pixels + (static_cast<std::size_t>(offsetY + row) * regionWidth + offsetX) * pixelSize };
+            for (std::size_t i{}; i < width; ++i) {
+                std::memmove(rowPixels + i * packedSize, rowPixels + i * pixelSize, packedSize);
+            }
+            if (!file.WriteRow(x, y + row, rowPixels, width)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    ////////////////////////////////////////
+    TiledImageFile::TiledImageFile(const char* url, TiledImageFormat format, std::uint32_t width, std::uint32_t height)
+        : mFile{ -1 }, mFormat{ format }, mWidth{ width }, mHeight{ height }, mHeaderSize{}
+    {
+        // PFM rows are little-endian floats stored bottom to top, PPM rows are 8 bit and stored top to bottom
+        char header[64];
+        int headerSize{ std::snprintf(header, sizeof(header), format == TiledImageFormat::PFM ? "PF\n%u %u\n-1.0\n" : "P6\n%u %u\n255\n",
+                                      width, height) };
+        mHeaderSize = static_cast<std::size_t>(headerSize);
+
+        mFile = ::open(url, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (mFile < 0) {
+            Log("CursedRay: could not open %s: %s", url, std::strerror(errno));
+            return;
+        }
+        std::size_t size{ mHeaderSize + static_cast<std::size_t>(width) * height * GetBytesPerPixel() };
+        if (::pwrite(mFile, header, mHeaderSize, 0) != static_cast<ssize_t>(mHeaderSize) ||
+            ::ftruncate(mFile, static_cast<off_t>(size)) != 0) {
+            Log("CursedRay: could not size %s: %s", url, std::strerror(errno));
+            ::close(mFile);
+            mFile = -1;
+        }
+    }
+
+    ////////////////////////////////////////
+    TiledImageFile::~TiledImageFile()
+    {
+        if (mFile >= 0) {
+            ::close(mFile);
+        }
+    }
+
+    ////////////////////////////////////////
+    std::size_t TiledImageFile::GetBytesPerPixel() const
+    {
+        return 3 * std::size_t{ GetBytesPerChannel(GetTiledFramebufferFormat(mFormat)) };
+    }
+
+    ////////////////////////////////////////
+    bool TiledImageFile::WriteRow(std::uint32_t x, std::uint32_t y, const void* pixels, std::uint32_t numPixels)
+    {
+        // pwrite never moves a shared file offset, so writers of different tiles do not race
+        std::uint32_t row{ mFormat == TiledImageFormat::PFM ? mHeight - 1 - y : y };
+        std::size_t offset{ mHeaderSize + (static_cast<std::size_t>(row) * mWidth + x) * GetBytesPerPixel() };
+        std::size_t size{ numPixels * GetBytesPerPixel() };
+        const std::byte* bytes{ static_cast<const std::byte*>(pixels) };
+        for (std::size_t written{}; written < size;) {
+            ssize_t result{ ::pwrite(mFile, bytes + written, size - written, static_cast<off_t>(offset + written)) };
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                Log("CursedRay: could not write tile row %u: %s", y, std::strerror(errno));
+                return false;
+            }
+            written += static_cast<std::size_t>(result);
+        }
+        return true;
+    }
+
+    ////////////////////////////////////////
+    bool GetTiledImageFormat(const std::string& url, TiledImageFormat& format)
+    {
+        std::size_t dot{ url.rfind('.') };
+        if (dot == std::string::npos) {
+            return false;
+        }
+        std::string extension{ url.substr(dot + 1) };
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) {
+            return static_cast<char>(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+        });
+
+        if (extension == "ppm") {
+            format = TiledImageFormat::PPM;
+            return true;
+        }
+        if (extension == "pfm") {
+            format = TiledImageFormat::PFM;
+            return true;
+        }
+        return false;
+    }
+
+    ////////////////////////////////////////
+    PixelFormat GetTiledFramebufferFormat(TiledImageFormat format)
+    {
+        // tiles are read back in the precision the file stores, cropping is then a plain copy
+        switch (format) {
+            case TiledImageFormat::PPM:
+                return PixelFormat::RGBA8;
+            case TiledImageFormat::PFM:
+                return PixelFormat::RGBA32F;
+        }
+        return PixelFormat::RGBA8;
+    }
+
+    ////////////////////////////////////////
+    bool GetTileLayout(std::uint32_t width, std::uint32_t height, const HWDeviceOptions& options,
+                       std::size_t environmentSize, std::size_t maxMemory, TileLayout& layout)
+    {
+        // every a-trous pass reaches two taps of its step further, and the steps double from one
+        std::uint32_t apron{ options.mDenoiseIterations > 0 ? 2 * ((1u << options.mDenoiseIterations) - 1) : 0 };
+
+        // one arena block covers the arena's rounding as well as the scene and sampler tables, the environment
+        // map is counted twice as its host copy is only released once the device has uploaded it; per region pixel
+        // there are the device's buffers, the display framebuffer and the staging of every tile being written
+        std::size_t fixedSize{ DEFAULT_ARENA_BLOCK_SIZE + 2 * environmentSize };
+        std::size_t bytesPerPixel{ HWDevice::GetBytesPerPixel(options) +
+                                   4 * GetBytesPerChannel(PixelFormat::RGBA8) +
+                                   DEFAULT_TILE_WRITES_IN_FLIGHT * 4 * GetBytesPerChannel(options.mFramebufferFormat) };
+        std::size_t maxPixels{ maxMemory > fixedSize ? (maxMemory - fixedSize) / bytesPerPixel : 0 };
+
+        // square regions spend the least on aprons, a narrow image lets the region grow taller instead
+        std::uint32_t side{ static_cast<std::uint32_t>(std::sqrt(static_cast<double>(maxPixels))) / DEFAULT_TILE_ALIGNMENT * DEFAULT_TILE_ALIGNMENT };
+        layout.mImageWidth = width;
+        layout.mImageHeight = height;
+        layout.mApron = apron;
+        layout.mRegionWidth = std::min(width, side);
+        layout.mRegionHeight = 0;
+        if (layout.mRegionWidth > 0) {
+            std::size_t regionHeight{ std::min<std::size_t>(height, maxPixels / layout.mRegionWidth) };
+            if (regionHeight < height) {
+                regionHeight = regionHeight / DEFAULT_TILE_ALIGNMENT * DEFAULT_TILE_ALIGNMENT;
+            }
+            layout.mRegionHeight = static_cast<std::uint32_t>(regionHeight);
+        }
+        layout.mTileWidth = GetTileSize(layout.mRegionWidth, width, apron);
+        layout.mTileHeight = GetTileSize(layout.mRegionHeight, height, apron);
+
+        bool isWidthValid{ layout.mTileWidth >= std::min(width, DEFAULT_MIN_TILE_SIZE) };
+        bool isHeightValid{ layout.mTileHeight >= std::min(height, DEFAULT_MIN_TILE_SIZE) };
+        if (!isWidthValid || !isHeightValid) {
+            Log("CursedRay: %zu MiB leave no room for tiles around the %u pixel denoiser apron, "
+                "raise --max-memory or lower --denoise-iterations", maxMemory >> 20, apron);
+            return false;
+        }
+        layout.mNumTilesX = (width + layout.mTileWidth - 1) / layout.mTileWidth;
+        layout.mNumTilesY = (height + layout.mTileHeight - 1) / layout.mTileHeight;
+
+        Log("CursedRay: %ux%u image in %ux%u tiles of %ux%u, %ux%u with the apron, within %zu MiB",
+            width, height, layout.mNumTilesX, layout.mNumTilesY, layout.mTileWidth, layout.mTileHeight,
+            layout.mRegionWidth, layout.mRegionHeight, maxMemory >> 20);
+        return true;
+    }
+
+    ////////////////////////////////////////
+    bool RenderTiled(const char* url, const TileLayout& layout, const Scene& scene, const Camera& camera,
+                     const glm::vec4& clearColor, std::uint32_t numSamples, const HWDeviceOptions& options,
+                     HWDeviceContext& context)
+    {
+        TiledImageFormat format{};
+        if (!GetTiledImageFormat(url, format)) {
+            Log("CursedRay: %s does not end in .ppm or .pfm", url);
+            return false;
+        }
+        assert(options.mFramebufferFormat == GetTiledFramebufferFormat(format));
+        TiledImageFile file(url, format, layout.mImageWidth, layout.mImageHeight);
+        if (!file.IsOpen()) {
+            return false;
+        }
+
+        // the device is sized to one region for the whole render, nothing on it scales with the image
+        DisplayFramebuffer framebuffer(FramebufferOptions(layout.mRegionWidth, layout.mRegionHeight, clearColor));
+        HWDevice hwDevice(framebuffer, scene, options, context);
+        context.mEnvironment = EnvironmentMap{};
+
+        // a staging buffer is only reused once its tile has been written, which bounds host memory
+        // and keeps the device from running more than that many tiles ahead of the disk
+        std::size_t bytesPerChannel{ GetBytesPerChannel(options.mFramebufferFormat) };
+        std::size_t stagingSize{ static_cast<std::size_t>(layout.mRegionWidth) * layout.mRegionHeight * 4 * bytesPerChannel };
+        std::array<TileWrite, DEFAULT_TILE_WRITES_IN_FLIGHT> writes;
+        for (TileWrite& write : writes) {
+            write.mStaging.resize(stagingSize);
+        }
+        EncoderPool writers(DEFAULT_TILE_WRITES_IN_FLIGHT, DEFAULT_TILE_WRITES_IN_FLIGHT);
+
+        std::uint32_t samplesPerPixel{ std::max<std::uint32_t>(options.mSamplesPerPixel, 1) };
+        std::uint32_t numPasses{ (numSamples + samplesPerPixel - 1) / samplesPerPixel };
+        std::uint32_t numTiles{ layout.mNumTilesX * layout.mNumTilesY };
+        bool success{ true };
+        auto begin{ std::chrono::steady_clock::now() };
+        for (std::uint32_t tile{}; tile < numTiles && success; ++tile) {
+            std::uint32_t x{ tile % layout.mNumTilesX * layout.mTileWidth };
+            std::uint32_t y{ tile / layout.mNumTilesX * layout.mTileHeight };
+            std::uint32_t width{ std::min(layout.mTileWidth, layout.mImageWidth - x) };
+            std::uint32_t height{ std::min(layout.mTileHeight, layout.mImageHeight - y) };
+            std::uint32_t regionX{ GetRegionOrigin(x, layout.mApron, layout.mRegionWidth, layout.mImageWidth) };
+            std::uint32_t regionY{ GetRegionOrigin(y, layout.mApron, layout.mRegionHeight, layout.mImageHeight) };
+
+            hwDevice.SetViewport(regionX, regionY, layout.mImageWidth, layout.mImageHeight);
+            hwDevice.ResetAccumulation();
+            std::vector<cl::Event> traceEvents;
+            for (std::uint32_t pass{}; pass < numPasses; ++pass) {
+                traceEvents = hwDevice.EnqueuePathTrace(camera, clearColor);
+            }
+            hwDevice.EnqueueResolve(traceEvents);
+
+            TileWrite& write{ writes[tile % writes.size()] };
+            if (write.mIsWritten.valid() && !write.mIsWritten.get()) {
+                success = false;
+                break;
+            }
+            std::vector<cl::Event> readEvents{ hwDevice.EnqueueReadFramebuffer(write.mStaging.data()) };
+            if (readEvents.empty()) {
+                success = false;
+                break;
+            }
+
+            // the writer waits on the read itself, the device goes on with the next tile meanwhile
+            auto job{ std::make_shared<std::packaged_task<bool()>>([&file, &write, readEvents, bytesPerChannel,
+                                                                    regionWidth = layout.mRegionWidth,
+                                                                    offsetX = x - regionX, offsetY = y - regionY,
+                                                                    x, y, width, height]() {
+                try {
+                    cl::Event::waitForEvents(readEvents);
+                }
+                catch (const cl::Error& err) {
+                    Log("CursedRay: OpenCL Error: %s", err.what());
+                    return false;
+                }
+                return WriteTile(file, write.mStaging.data(), bytesPerChannel, regionWidth, offsetX, offsetY, x, y, width, height);
+            }) };
+            write.mIsWritten = job->get_future();
+            writers.Submit([job]() { (*job)(); });
+        }
+        for (TileWrite& write : writes) {
+            if (write.mIsWritten.valid()) {
+                success = write.mIsWritten.get() && success;
+            }
+        }
+
+        double renderTime{ std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() };
+        Log("CursedRay: rendered %u tiles to %s in %.2f seconds", numTiles, url, renderTime);
+        hwDevice.GetArena().LogUsage();
+        return success;
+    }
+}